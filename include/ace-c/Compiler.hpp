@@ -34,11 +34,13 @@ public:
         size_t nargs
     );
 
+    /** Emits a CALL, or a TAIL_CALL if the call replaces the current function */
     static std::unique_ptr<Buildable> BuildCall(
         AstVisitor *visitor,
         Module *mod,
         const std::shared_ptr<AstExpression> &target,
-        uint8_t nargs);
+        uint8_t nargs,
+        bool is_tail_call = false);
 
     static std::unique_ptr<Buildable> LoadMemberFromHash(AstVisitor *visitor, Module *mod, uint32_t hash);
 
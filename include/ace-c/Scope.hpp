@@ -15,7 +15,8 @@ enum ScopeType {
     SCOPE_TYPE_NORMAL,
     SCOPE_TYPE_FUNCTION,
     SCOPE_TYPE_TYPE_DEFINITION,
-    SCOPE_TYPE_LOOP
+    SCOPE_TYPE_LOOP,
+    SCOPE_TYPE_TRY
 };
 
 enum ScopeFunctionFlags : int {
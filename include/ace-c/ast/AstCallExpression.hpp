@@ -8,6 +8,10 @@
 #include <vector>
 #include <memory>
 
+// fwd declaration
+class AstFunctionExpression;
+class AstMember;
+
 class AstCallExpression : public AstExpression {
 public:
     AstCallExpression(
@@ -34,6 +38,9 @@ public:
 
     virtual void Visit(AstVisitor *visitor, Module *mod) override;
     virtual std::unique_ptr<Buildable> Build(AstVisitor *visitor, Module *mod) override;
+    /** Builds the call to take the place of the current function, for a
+        call that is returned directly. Nothing after it is executed. */
+    std::unique_ptr<Buildable> BuildTailCall(AstVisitor *visitor, Module *mod);
     virtual void Optimize(AstVisitor *visitor, Module *mod) override;
     
     virtual Pointer<AstStatement> Clone() const override;
@@ -51,6 +58,12 @@ protected:
     std::vector<int> m_arg_ordering;
     SymbolTypePtr_t m_return_type;
     bool m_is_method_call;
+    // the function being called, if it is known at compile time
+    std::shared_ptr<AstFunctionExpression> m_static_target;
+
+    /** The member being called, if this is a method call whose
+        object has already been passed as the first argument ('self') */
+    const AstMember *GetMethodTarget() const;
 
     inline Pointer<AstCallExpression> CloneImpl() const
     {
@@ -35,6 +35,13 @@ public:
     inline const SymbolTypePtr_t &GetReturnType() const { return m_return_type; }
     inline void SetReturnType(const SymbolTypePtr_t &return_type) { m_return_type = return_type; }
 
+    inline const std::vector<std::shared_ptr<AstParameter>> &GetParameters() const
+        { return m_parameters; }
+    inline bool IsClosure() const { return m_is_closure; }
+    /** Id of the function's StaticFunctionMarker once it has been built,
+        or -1 if it can't be called with a StaticFunctionCall */
+    inline int GetStaticId() const { return m_static_id; }
+
 protected:
     std::vector<std::shared_ptr<AstParameter>> m_parameters;
     std::shared_ptr<AstTypeSpecification> m_type_specification;
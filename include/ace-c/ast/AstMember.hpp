@@ -12,6 +12,8 @@ public:
     );
     virtual ~AstMember() = default;
 
+    inline const std::string &GetFieldName() const
+      { return m_field_name; }
     inline const std::shared_ptr<AstExpression> &GetTarget() const
       { return m_target; }
     
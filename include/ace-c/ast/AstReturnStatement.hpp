@@ -22,6 +22,7 @@ public:
 private:
     std::shared_ptr<AstExpression> m_expr;
     int m_num_pops;
+    bool m_is_tail_call;
 
     inline Pointer<AstReturnStatement> CloneImpl() const
     {
@@ -3,6 +3,8 @@
 
 #include <streambuf>
 #include <vector>
+#include <map>
+#include <memory>
 #include <cstdint>
 
 using byte = uint8_t;
@@ -21,6 +23,10 @@ struct BuildParams {
     size_t block_offset = 0;
     size_t local_offset = 0;
     std::vector<LabelInfo> labels;
+    // addresses of the functions marked with StaticFunctionMarker, by id.
+    // the params of nested chunks share the same map.
+    std::shared_ptr<std::map<int, LabelPosition>> static_functions
+        = std::make_shared<std::map<int, LabelPosition>>();
 };
 
 struct Buildable {
@@ -16,6 +16,8 @@ public:
     virtual void Visit(Jump *) = 0;
     virtual void Visit(Comparison *) = 0;
     virtual void Visit(FunctionCall *) = 0;
+    virtual void Visit(StaticFunctionMarker *) = 0;
+    virtual void Visit(StaticFunctionCall *) = 0;
     virtual void Visit(Return *) = 0;
     virtual void Visit(StoreLocal *) = 0;
     virtual void Visit(PopLocal *) = 0;
@@ -97,6 +97,30 @@ struct FunctionCall : public Buildable {
     virtual ~FunctionCall() = default;
 };
 
+/** Marks the start of a function body, so that calls anywhere
+    after it can jump straight to it with a StaticFunctionCall */
+struct StaticFunctionMarker final : public Buildable {
+    int static_id;
+
+    StaticFunctionMarker(int static_id)
+        : static_id(static_id)
+    {
+    }
+    virtual ~StaticFunctionMarker() = default;
+};
+
+struct StaticFunctionCall final : public Buildable {
+    int static_id;
+    uint8_t nargs;
+
+    StaticFunctionCall(int static_id, uint8_t nargs)
+        : static_id(static_id),
+          nargs(nargs)
+    {
+    }
+    virtual ~StaticFunctionCall() = default;
+};
+
 struct Return : public Buildable {
     Return() = default;
     virtual ~Return() = default;
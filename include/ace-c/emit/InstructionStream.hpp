@@ -31,7 +31,14 @@ public:
     inline int IncStackSize() { return ++m_stack_size; }
     inline int DecStackSize() { return --m_stack_size; }
 
+    /** The stack size at the first argument of the function being built,
+        which the locals of the function are addressed relative to */
+    inline int GetFrameBase() const { return m_frame_base; }
+    inline void SetFrameBase(int frame_base) { m_frame_base = frame_base; }
+
     inline int NewStaticId() { return m_static_id++; }
+    /** Id for a StaticFunctionMarker, so calls can refer to the function */
+    inline int NewStaticFunctionId() { return m_static_function_id++; }
 
     inline void AddStaticObject(const StaticObject &static_object)
         { m_static_objects.push_back(static_object); }
@@ -49,8 +56,12 @@ private:
     // incremented each time a variable is pushed,
     // decremented each time a stack frame is closed
     int m_stack_size;
+    // stack size where the current function's frame starts
+    int m_frame_base;
     // the current static object id
     int m_static_id;
+    // the current static function id
+    int m_static_function_id;
 
     std::vector<StaticObject> m_static_objects;
 };
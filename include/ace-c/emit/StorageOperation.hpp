@@ -23,6 +23,7 @@ enum class Methods {
 enum class Strategies {
     BY_OFFSET,
     BY_INDEX,
+    BY_FRAME_INDEX,
     BY_HASH,
 };
 
@@ -112,6 +113,7 @@ struct StorageOperation : public Buildable {
 
         void ByIndex(int index);
         void ByOffset(int offset);
+        void ByFrameIndex(int index);
         void ByHash(int hash);
 
         Strategies strategy;
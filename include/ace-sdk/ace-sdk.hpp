@@ -2,6 +2,7 @@
 #define ACE_SDK_HPP
 
 #include <stdint.h>
+#include <cstring>
 #include <sstream>
 
 #ifndef __cplusplus
@@ -52,6 +53,7 @@ struct VMState;
 struct Value;
 
 class ImmutableString;
+class StringBuilder;
 
 }
 }
@@ -67,7 +69,23 @@ typedef uint32_t bc_address_t;
 typedef uint8_t bc_reg_t;
 
 class HeapValue;
-    
+
+/** A value in a register, on the stack, or in an array or object.
+
+    By default, a value is a type tag next to a union of 8 bytes. When
+    built with ACE_NAN_BOXING defined, values are 8 bytes in total:
+    doubles are stored as they are (with any NaN made the canonical one),
+    and every other type is stored in the payload of a quiet NaN, with the
+    type in the sign bit and the three bits below the quiet bit, and the
+    data in the low 48 bits. Int64 values only have 48 bits in that build
+    (see FitsI64), and pointers have to fit in 48 bits, as they do on
+    x86-64 and AArch64.
+
+    Code that has to work with both representations (everything in the
+    VM, and natives built with ACE_NAN_BOXING) must go through the
+    accessors below rather than m_type and m_value, which only exist in
+    the default build. Natives have to be built with the same setting as
+    the VM they are loaded into. */
 struct Value {
     enum ValueType {
         /* These first four types are listed in order of precedence */
@@ -84,9 +102,13 @@ struct Value {
         FUNCTION,
         NATIVE_FUNCTION,
         ADDRESS,
-        FUNCTION_CALL,
         TRY_CATCH_INFO
-    } m_type;
+    };
+
+#ifdef ACE_NAN_BOXING
+    uint64_t m_bits;
+#else
+    ValueType m_type;
 
     union ValueData {
         int32_t i32;
@@ -108,69 +130,228 @@ struct Value {
 
         NativeFunctionPtr_t native_func;
         
-        struct {
-            bc_address_t addr;
-            int32_t varargs_push;
-        } call;
-
         bc_address_t addr;
 
         struct {
             bc_address_t catch_address;
         } try_catch_info;
     } m_value;
+#endif
 
     Value() = default;
     explicit Value(const Value &other);
 
+#ifdef ACE_NAN_BOXING
+    // the bits that make a NaN quiet, which every boxed value has set
+    static const uint64_t NAN_BITS = 0x7FF8000000000000ull;
+    static const uint64_t PAYLOAD_MASK = 0x0000FFFFFFFFFFFFull;
+
+    // the Int64 values that fit in the payload
+    static const int64_t MIN_I64 = -((int64_t)1 << 47);
+    static const int64_t MAX_I64 = ((int64_t)1 << 47) - 1;
+
+    /** The tag is the type plus one, so that the canonical NaN (tag 0)
+        is still a double */
+    inline unsigned GetTag() const
+        { return (unsigned)(((m_bits >> 60) & 0x8) | ((m_bits >> 48) & 0x7)); }
+    inline uint64_t GetPayload() const
+        { return m_bits & PAYLOAD_MASK; }
+    inline void SetBoxed(ValueType type, uint64_t payload)
+    {
+        const uint64_t tag = (uint64_t)type + 1;
+        m_bits = NAN_BITS | ((tag & 0x8) << 60) | ((tag & 0x7) << 48) | (payload & PAYLOAD_MASK);
+    }
+
+    inline ValueType GetType() const
+    {
+        return ((m_bits & NAN_BITS) == NAN_BITS && GetTag() != 0)
+            ? (ValueType)(GetTag() - 1)
+            : F64;
+    }
+
+    inline int32_t GetI32() const { return (int32_t)(uint32_t)m_bits; }
+    // sign extend the 48 bit payload
+    inline int64_t GetI64() const { return (int64_t)(m_bits << 16) >> 16; }
+    inline float GetF32() const
+        { const uint32_t bits = (uint32_t)m_bits; float f; std::memcpy(&f, &bits, sizeof(f)); return f; }
+    inline double GetF64() const
+        { double d; std::memcpy(&d, &m_bits, sizeof(d)); return d; }
+    inline bool GetBoolean() const { return (m_bits & 1) != 0; }
+    inline Value *GetValueRef() const { return (Value*)(uintptr_t)GetPayload(); }
+    inline HeapValue *GetHeapPointer() const { return (HeapValue*)(uintptr_t)GetPayload(); }
+    inline bc_address_t GetFunctionAddress() const { return (bc_address_t)m_bits; }
+    inline uint8_t GetFunctionNargs() const { return (uint8_t)(m_bits >> 32); }
+    inline uint8_t GetFunctionFlags() const { return (uint8_t)(m_bits >> 40); }
+    inline NativeFunctionPtr_t GetNativeFunction() const { return (NativeFunctionPtr_t)(uintptr_t)GetPayload(); }
+    inline bc_address_t GetAddress() const { return (bc_address_t)m_bits; }
+    inline bc_address_t GetCatchAddress() const { return (bc_address_t)m_bits; }
+
+    inline void SetI32(int32_t i32) { SetBoxed(I32, (uint32_t)i32); }
+    inline void SetI64(int64_t i64) { SetBoxed(I64, (uint64_t)i64); }
+    inline void SetF32(float f)
+        { uint32_t bits; std::memcpy(&bits, &f, sizeof(bits)); SetBoxed(F32, bits); }
+    inline void SetF64(double d)
+    {
+        if (d != d) {
+            m_bits = NAN_BITS;
+        } else {
+            std::memcpy(&m_bits, &d, sizeof(d));
+        }
+    }
+    inline void SetBoolean(bool b) { SetBoxed(BOOLEAN, b); }
+    inline void SetValueRef(Value *value_ref) { SetBoxed(VALUE_REF, (uintptr_t)value_ref); }
+    inline void SetHeapPointer(HeapValue *ptr) { SetBoxed(HEAP_POINTER, (uintptr_t)ptr); }
+    inline void SetFunction(bc_address_t addr, uint8_t nargs, uint8_t flags)
+        { SetBoxed(FUNCTION, addr | ((uint64_t)nargs << 32) | ((uint64_t)flags << 40)); }
+    inline void SetNativeFunction(NativeFunctionPtr_t native_func)
+        { SetBoxed(NATIVE_FUNCTION, (uintptr_t)native_func); }
+    inline void SetAddress(bc_address_t addr) { SetBoxed(ADDRESS, addr); }
+    inline void SetTryCatchInfo(bc_address_t catch_address) { SetBoxed(TRY_CATCH_INFO, catch_address); }
+#else
+    static const int64_t MIN_I64 = INT64_MIN;
+    static const int64_t MAX_I64 = INT64_MAX;
+
     inline Value::ValueType GetType()  const { return m_type; }
     inline Value::ValueData GetValue() const { return m_value; }
 
+    inline int32_t GetI32() const { return m_value.i32; }
+    inline int64_t GetI64() const { return m_value.i64; }
+    inline float GetF32() const { return m_value.f; }
+    inline double GetF64() const { return m_value.d; }
+    inline bool GetBoolean() const { return m_value.b; }
+    inline Value *GetValueRef() const { return m_value.value_ref; }
+    inline HeapValue *GetHeapPointer() const { return m_value.ptr; }
+    inline bc_address_t GetFunctionAddress() const { return m_value.func.m_addr; }
+    inline uint8_t GetFunctionNargs() const { return m_value.func.m_nargs; }
+    inline uint8_t GetFunctionFlags() const { return m_value.func.m_flags; }
+    inline NativeFunctionPtr_t GetNativeFunction() const { return m_value.native_func; }
+    inline bc_address_t GetAddress() const { return m_value.addr; }
+    inline bc_address_t GetCatchAddress() const { return m_value.try_catch_info.catch_address; }
+
+    inline void SetI32(int32_t i32) { m_type = I32; m_value.i32 = i32; }
+    inline void SetI64(int64_t i64) { m_type = I64; m_value.i64 = i64; }
+    inline void SetF32(float f) { m_type = F32; m_value.f = f; }
+    inline void SetF64(double d) { m_type = F64; m_value.d = d; }
+    inline void SetBoolean(bool b) { m_type = BOOLEAN; m_value.b = b; }
+    inline void SetValueRef(Value *value_ref) { m_type = VALUE_REF; m_value.value_ref = value_ref; }
+    inline void SetHeapPointer(HeapValue *ptr) { m_type = HEAP_POINTER; m_value.ptr = ptr; }
+    inline void SetFunction(bc_address_t addr, uint8_t nargs, uint8_t flags)
+    {
+        m_type = FUNCTION;
+        m_value.func.m_addr = addr;
+        m_value.func.m_nargs = nargs;
+        m_value.func.m_flags = flags;
+    }
+    inline void SetNativeFunction(NativeFunctionPtr_t native_func)
+        { m_type = NATIVE_FUNCTION; m_value.native_func = native_func; }
+    inline void SetAddress(bc_address_t addr) { m_type = ADDRESS; m_value.addr = addr; }
+    inline void SetTryCatchInfo(bc_address_t catch_address)
+        { m_type = TRY_CATCH_INFO; m_value.try_catch_info.catch_address = catch_address; }
+#endif
+
+    /** True if SetI64() keeps the whole of the given value. Only ever
+        false when values are NaN-boxed, so code that makes an Int64
+        that could be out of range checks with this, rather than have
+        it silently cut down to 48 bits. */
+    static inline bool FitsI64(int64_t i64)
+        { return i64 >= MIN_I64 && i64 <= MAX_I64; }
+
     inline bool GetInteger(int64_t *out) const
     {
-        switch (m_type) {
-            case I32: *out = m_value.i32; return true;
-            case I64: *out = m_value.i64; return true;
-            default:                      return false;
+        switch (GetType()) {
+            case I32: *out = GetI32(); return true;
+            case I64: *out = GetI64(); return true;
+            default:                   return false;
         }
     }
 
     inline bool GetFloatingPoint(double *out) const
     {
-        switch (m_type) {
-            case F32: *out = m_value.f; return true;
-            case F64: *out = m_value.d; return true;
-            default:                    return false;
+        switch (GetType()) {
+            case F32: *out = GetF32(); return true;
+            case F64: *out = GetF64(); return true;
+            default:                   return false;
         }
     }
 
     inline bool GetNumber(double *out) const
     {
-        switch (m_type) {
-            case I32: *out = m_value.i32; return true;
-            case I64: *out = m_value.i64; return true;
-            case F32: *out = m_value.f;   return true;
-            case F64: *out = m_value.d;   return true;
-            default:                      return false;
+        switch (GetType()) {
+            case I32: *out = GetI32(); return true;
+            case I64: *out = GetI64(); return true;
+            case F32: *out = GetF32(); return true;
+            case F64: *out = GetF64(); return true;
+            default:                   return false;
         }
     }
 
-    void Mark();
-
     const char *GetTypeString() const;
     ImmutableString ToString() const;
-    void ToRepresentation(std::stringstream &ss,
+    /** Appends the string ToString() would return */
+    void ToString(StringBuilder &out) const;
+    void ToRepresentation(StringBuilder &out,
         bool add_type_name = true) const;
 };
 
+#ifdef ACE_NAN_BOXING
+static_assert(sizeof(Value) == 8, "NaN-boxed values should be 8 bytes");
+#endif
+
 } // namespace vm
 
 namespace sdk {
 
+/** The arguments of a native function call. args points straight into
+    the caller's stack, where the arguments were pushed in order, so no
+    array is built for the call. The view is only valid for the duration
+    of the call. */
 struct Params {
     vm::InstructionHandler *handler;
-    vm::Value **args;
+    vm::Value *args;
     int nargs;
+
+    /** The argument at the given index, which must be less than nargs */
+    inline vm::Value &Arg(int index) const
+        { return args[index]; }
+
+    /** The argument at the given index as an integer (I32 or I64),
+        or false if the argument is not an integer */
+    inline bool GetInteger(int index, int64_t *out) const
+        { return args[index].GetInteger(out); }
+
+    /** The argument at the given index as a number of any type,
+        or false if the argument is not a number */
+    inline bool GetNumber(int index, double *out) const
+        { return args[index].GetNumber(out); }
+};
+
+/** Keeps the values a native function is working with alive while it
+    allocates. Any allocation can run the garbage collector, which only
+    knows about values that can be reached from the stack, the registers
+    or a handle scope, so a heap value that has only been stored in a
+    local variable (or in an Array or Object that is not on the heap yet)
+    has to be added to a scope before the next allocation. Values stay
+    rooted until the scope is destroyed; scopes can be nested.
+
+    Values may be stored into a heap value that is in a scope without
+    going through the write barrier. Storing into any other heap value
+    still needs VMState::WriteBarrier. */
+class HandleScope {
+public:
+    explicit HandleScope(const Params &params);
+    explicit HandleScope(vm::ExecutionThread *thread);
+    HandleScope(const HandleScope &other) = delete;
+    ~HandleScope();
+
+    HandleScope &operator=(const HandleScope &other) = delete;
+
+    void Add(const vm::Value &value);
+    void Add(vm::HeapValue *ptr);
+
+private:
+    vm::ExecutionThread *m_thread;
+    // number of handles the thread had when the scope was opened
+    size_t m_base;
 };
 
 } // namespace sdk
@@ -2,10 +2,10 @@
 #define ARRAY_HPP
 
 #include <ace-vm/Value.hpp>
+#include <ace-vm/StringBuilder.hpp>
 
 #include <common/my_assert.hpp>
 
-#include <sstream>
 
 namespace ace {
 namespace vm {
@@ -20,6 +20,7 @@ public:
     inline bool operator==(const Array &other) const { return this == &other; }
 
     inline size_t GetSize() const { return m_size; }
+    inline size_t GetCapacity() const { return m_capacity; }
     inline Value *GetBuffer() const { return m_buffer; }
     inline Value &AtIndex(int index) { return m_buffer[index]; }
     inline const Value &AtIndex(int index) const { return m_buffer[index]; }
@@ -28,10 +29,9 @@ public:
     void Resize(size_t capacity);
     void Push(const Value &value);
     void PushMany(size_t n, Value *values);
-    void PushMany(size_t n, Value **values);
     void Pop();
 
-    void GetRepresentation(std::stringstream &ss, bool add_type_name = true) const;
+    void GetRepresentation(StringBuilder &out, bool add_type_name = true) const;
 
 private:
     size_t m_size;
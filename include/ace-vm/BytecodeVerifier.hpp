@@ -0,0 +1,67 @@
+#ifndef BYTECODE_VERIFIER_HPP
+#define BYTECODE_VERIFIER_HPP
+
+#include <ace-vm/DecodedProgram.hpp>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace ace {
+namespace vm {
+
+/** Checks a decoded program before it is run, so that the interpreter
+    can skip bounds checks on registers, the stack and static memory.
+
+    Verification fails if any of these do not hold:
+      - register operands are less than VM_NUM_REGISTERS
+      - jump, catch and function addresses are the start of an instruction
+      - static memory indices are less than StaticMemory::static_size
+      - the stack height at each instruction is the same along every path
+        to it, never drops below the start of the block of code (program
+        or function) and is zero at RET
+      - stack offsets and local indices stay within the locals and
+        arguments of the block */
+class BytecodeVerifier {
+public:
+    BytecodeVerifier(const DecodedProgram *program);
+    BytecodeVerifier(const BytecodeVerifier &other) = delete;
+    ~BytecodeVerifier() = default;
+
+    bool Verify();
+
+    inline const std::string &GetErrorMessage() const
+        { return m_error_message; }
+    /** Only valid after Verify() has returned true */
+    inline size_t GetMaxStackHeight() const
+        { return m_max_stack_height; }
+
+private:
+    struct BlockState {
+        // stack height relative to the start of the program or function
+        int height;
+        // number of slots below the start that may be read by offset
+        // or local index (the arguments of a function)
+        int frame_size;
+    };
+
+    bool Error(uint32_t index, const char *fmt, ...);
+
+    bool CheckOperands(uint32_t index);
+    bool CheckRegister(uint32_t index, uint8_t reg);
+    bool CheckFunctionAddress(uint32_t index, bc_address_t addr);
+
+    bool Enter(uint32_t index, const BlockState &state, uint32_t from);
+    bool CheckStack();
+
+    const DecodedProgram *m_program;
+    std::vector<BlockState> m_states;
+    std::vector<uint32_t> m_worklist;
+    std::string m_error_message;
+    size_t m_max_stack_height;
+};
+
+} // namespace vm
+} // namespace ace
+
+#endif
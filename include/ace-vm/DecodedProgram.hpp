@@ -0,0 +1,231 @@
+#ifndef DECODED_PROGRAM_HPP
+#define DECODED_PROGRAM_HPP
+
+#include <ace-vm/BytecodeStream.hpp>
+
+#include <common/typedefs.hpp>
+#include <common/my_assert.hpp>
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+namespace ace {
+namespace vm {
+
+// forward declarations
+class TypeInfo;
+class HeapValue;
+
+/** Type layout read from a STORE_STATIC_TYPE or LOAD_TYPE instruction */
+struct DecodedType {
+    const char *name;
+    uint16_t name_len;
+    uint16_t size;
+    std::vector<char*> names;
+    // the interned TypeInfo for a LOAD_TYPE, once it has been run
+    // (see VMState::InternType)
+    std::atomic<HeapValue*> interned { nullptr };
+};
+
+/** String literal read from a LOAD_STRING instruction */
+struct DecodedString {
+    const char *data;
+    uint32_t len;
+    // the interned string, once it has been run
+    // (see VMState::InternString)
+    std::atomic<HeapValue*> interned { nullptr };
+};
+
+/** The number of arguments a function takes, and its FunctionFlags */
+struct DecodedFunction {
+    uint8_t nargs;
+    uint8_t flags;
+};
+
+/** Per-instruction cache for member access by hash (LOAD_MEM_HASH,
+    MOV_MEM_HASH, HAS_MEM_HASH and CALL_METHOD), remembering which member
+    index the hash was found at for the last few types of object seen there. */
+struct InlineCache {
+    static const uint8_t NUM_ENTRIES = 4;
+
+    struct Entry {
+        const TypeInfo *type;
+        uint32_t index;
+    };
+
+    Entry entries[NUM_ENTRIES];
+    uint8_t size;
+    // set once more than NUM_ENTRIES types have been seen. the cache
+    // is not looked at after that, so lookups go straight to the object.
+    bool megamorphic;
+
+    /** Remember the member index for the type, replacing
+        the entry for the type if there is one already. */
+    inline void Add(const TypeInfo *type, uint32_t index)
+    {
+        for (uint8_t i = 0; i < size; i++) {
+            if (entries[i].type == type) {
+                entries[i].index = index;
+                return;
+            }
+        }
+
+        if (size == NUM_ENTRIES) {
+            megamorphic = true;
+            return;
+        }
+
+        entries[size++] = Entry { type, index };
+    }
+};
+
+/** A fixed-width instruction, with all operands already read.
+    Byte sized operands (registers, nargs, flags, small indices) go into
+    a, b and c in the order they are encoded. 16 and 32 bit operands go
+    into u32, and 64 bit constants or pointers to pooled data into imm.
+    Jump targets, and the functions of CALL_STATIC, are instruction
+    indices, not byte offsets (the original offset is kept in imm.addr).
+    Member access by hash, and CALL_METHOD, have their inline cache
+    in imm.cache. */
+struct DecodedInstruction {
+    uint8_t opcode;
+    uint8_t a;
+    uint8_t b;
+    uint8_t c;
+    uint32_t u32;
+
+    union {
+        aint32 i32;
+        aint64 i64;
+        afloat32 f32;
+        afloat64 f64;
+        const char *str;
+        DecodedString *string;
+        DecodedType *type;
+        InlineCache *cache;
+        bc_address_t addr;
+    } imm;
+};
+
+static_assert(sizeof(DecodedInstruction) == 16, "DecodedInstruction should stay 16 bytes");
+
+/** Type-specialized opcodes that ADD, SUB, MUL, DIV, MOD and CMP are
+    rewritten into while the program runs, once they keep seeing the same
+    operand types (see DispatchLoop in VM.cpp). They only ever exist in a
+    decoded program, never in bytecode, so they start after the opcodes
+    of the Instructions enum. Each generic opcode has an I32, I64, F32
+    and F64 variant, in that order. */
+enum QuickenedInstructions : uint8_t {
+    ADD_I32 = 0x80,
+    ADD_I64,
+    ADD_F32,
+    ADD_F64,
+    SUB_I32,
+    SUB_I64,
+    SUB_F32,
+    SUB_F64,
+    MUL_I32,
+    MUL_I64,
+    MUL_F32,
+    MUL_F64,
+    DIV_I32,
+    DIV_I64,
+    DIV_F32,
+    DIV_F64,
+    MOD_I32,
+    MOD_I64,
+    MOD_F32,
+    MOD_F64,
+    CMP_I32,
+    CMP_I64,
+    CMP_F32,
+    CMP_F64,
+};
+
+class DecodedProgram {
+public:
+    DecodedProgram();
+    DecodedProgram(const DecodedProgram &other) = delete;
+    ~DecodedProgram() = default;
+
+    DecodedProgram &operator=(const DecodedProgram &other) = delete;
+
+    /** Decode every instruction in the buffer of the given stream,
+        replacing anything that was decoded before. The end of the
+        program is marked by an EXIT instruction. */
+    void Decode(const BytecodeStream &bs);
+
+    inline const DecodedInstruction *GetInstructions() const
+        { return m_instructions.data(); }
+    /** Instructions may be rewritten in place while the program runs */
+    inline DecodedInstruction *GetInstructions()
+        { return m_instructions.data(); }
+    inline size_t Size() const
+        { return m_instructions.size(); }
+
+    /** Instruction index at the given byte offset. Offsets that do not
+        start an instruction map to the final EXIT instruction. */
+    inline uint32_t IndexOf(bc_address_t addr) const
+        { return addr < m_indices.size() ? m_indices[addr] : m_exit_index; }
+    /** Byte offset that the instruction at the given index was read from */
+    inline bc_address_t OffsetOf(uint32_t index) const
+        { ASSERT(index < m_offsets.size()); return m_offsets[index]; }
+    /** True if an instruction starts at the byte offset. The end of
+        the buffer counts, as it is where EXIT is. */
+    inline bool IsInstructionStart(bc_address_t addr) const
+        { return addr < m_indices.size() && m_offsets[m_indices[addr]] == addr; }
+
+    /** The function that starts at the instruction index, as declared
+        by a LOAD_FUNC or STORE_STATIC_FUNCTION, or nullptr if none is. */
+    inline const DecodedFunction *FindFunction(uint32_t index) const
+    {
+        auto it = m_functions.find(index);
+        return it != m_functions.end() ? &it->second : nullptr;
+    }
+
+    /** Set once the program has passed BytecodeVerifier, which allows
+        it to be run without bounds checks. */
+    inline bool IsVerified() const
+        { return m_verified; }
+    /** The most stack slots the verified program uses, either from its
+        start or from the start of any function. */
+    inline size_t GetMaxStackHeight() const
+        { return m_max_stack_height; }
+    inline void SetVerified(size_t max_stack_height)
+        { m_verified = true; m_max_stack_height = max_stack_height; }
+
+    /** Drop the interned values that LOAD_TYPE and LOAD_STRING
+        instructions have remembered, for when the state that owns them is reset. */
+    void ForgetInterned();
+
+private:
+    const char *ReadString(BytecodeStream &bs, size_t len);
+    void DecodeType(BytecodeStream &bs, DecodedInstruction &ins);
+    void DecodeString(BytecodeStream &bs, DecodedInstruction &ins);
+
+    std::vector<DecodedInstruction> m_instructions;
+    // byte offset of each instruction
+    std::vector<bc_address_t> m_offsets;
+    // instruction index for each byte offset
+    std::vector<uint32_t> m_indices;
+    uint32_t m_exit_index;
+
+    bool m_verified;
+    size_t m_max_stack_height;
+
+    // string and type data referenced by instructions
+    std::vector<std::unique_ptr<char[]>> m_strings;
+    std::vector<std::unique_ptr<DecodedString>> m_decoded_strings;
+    std::vector<std::unique_ptr<DecodedType>> m_types;
+    std::unique_ptr<InlineCache[]> m_inline_caches;
+    // declared functions, by the index of their first instruction
+    std::unordered_map<uint32_t, DecodedFunction> m_functions;
+};
+
+} // namespace vm
+} // namespace ace
+
+#endif
@@ -22,7 +22,9 @@ public:
     static Exception InvalidArgsException(const char *expected_str, int received);
     static Exception NullReferenceException();
     static Exception DivisionByZeroException();
+    static Exception IntegerOverflowException();
     static Exception OutOfBoundsException();
+    static Exception StackOverflowException();
     static Exception MemberNotFoundException();
     static Exception FileOpenException(const char *file_name);
     static Exception UnopenedFileWriteException();
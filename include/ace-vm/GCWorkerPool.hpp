@@ -0,0 +1,46 @@
+#ifndef GC_WORKER_POOL_HPP
+#define GC_WORKER_POOL_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+namespace ace {
+namespace vm {
+
+/** Threads that the garbage collector splits marking and sweeping
+    across. The thread that calls Run() takes part as worker 0, so a
+    pool of N workers starts N - 1 threads. */
+class GCWorkerPool {
+public:
+    explicit GCWorkerPool(size_t num_workers);
+    GCWorkerPool(const GCWorkerPool &other) = delete;
+    ~GCWorkerPool();
+
+    inline size_t GetNumWorkers() const { return m_threads.size() + 1; }
+
+    /** Calls task(index) on every worker, and waits for all of them */
+    void Run(const std::function<void(size_t)> &task);
+
+private:
+    void WorkerMain(size_t index);
+
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mtx;
+    std::condition_variable m_start_cv;
+    std::condition_variable m_done_cv;
+    const std::function<void(size_t)> *m_task;
+    // incremented by each Run(), so workers know there is a new task
+    uint64_t m_generation;
+    size_t m_num_running;
+    bool m_stop;
+};
+
+} // namespace vm
+} // namespace ace
+
+#endif
@@ -2,18 +2,58 @@
 #define HEAP_MEMORY_HPP
 
 #include <ace-vm/HeapValue.hpp>
+#include <ace-vm/GCWorkerPool.hpp>
 
 #include <ostream>
+#include <cstdint>
+
+#define HEAP_PAGE_NUM_CELLS 512
 
 namespace ace {
 namespace vm {
 
-struct HeapNode {
+/** Storage for one heap value. Cells that are not in use
+    link to the next free cell of their page instead. */
+union HeapCell {
     HeapValue value;
-    HeapNode *before;
-    HeapNode *after;
+    HeapCell *next_free;
+
+    HeapCell() {}
+    ~HeapCell() {}
 };
 
+/** A fixed number of cells, allocated together. Cells below the bump
+    index have been handed out at least once; the ones that have been
+    freed since are on the page's free list. */
+struct HeapPage {
+    HeapCell cells[HEAP_PAGE_NUM_CELLS];
+    // set for each cell that holds a value
+    uint8_t live[HEAP_PAGE_NUM_CELLS];
+
+    HeapCell *free_list;
+    size_t bump;
+    size_t num_live;
+
+    // all pages of the heap
+    HeapPage *next;
+    // pages with room left, in the order they are allocated from
+    HeapPage *next_available;
+    // pages that young values have been allocated in since the last
+    // collection. only these are looked at by a minor collection.
+    HeapPage *next_nursery;
+    bool in_nursery;
+    // not swept yet by the lazy sweep in progress
+    bool sweep_pending;
+
+    HeapPage();
+};
+
+/** Values start out young, and are promoted to the old generation (the
+    GC_OLD flag) when they survive a collection. Promotion does not move
+    them: every page that a young value has been allocated in is in the
+    nursery, and a minor collection sweeps only the young values on those
+    pages, so its cost depends on the number of values allocated since the
+    last collection rather than on the size of the heap. */
 class Heap {
     friend std::ostream &operator<<(std::ostream &os, const Heap &heap);
 public:
@@ -22,17 +62,76 @@ public:
     ~Heap();
 
     inline size_t Size() const { return m_num_objects; }
+    inline size_t GetNumPages() const { return m_num_pages; }
+    /** Bytes used by the values on the heap. Exact after a full sweep; in
+        between, values count their cell when they are allocated and the
+        rest once it has been added with CountBytes(). */
+    inline size_t GetNumBytes() const { return m_old_bytes + m_young_bytes; }
+    inline size_t GetNumYoungBytes() const { return m_young_bytes; }
+    /** Counts towards the young generation, like the value it is for */
+    inline void CountBytes(size_t num_bytes) { m_young_bytes += num_bytes; }
+    /** Counts towards the old generation, for values that were promoted */
+    inline void CountOldBytes(size_t num_bytes) { m_old_bytes += num_bytes; }
 
     /** Destroy everything on the heap */
     void Purge();
     /** Allocate a new value on the heap. */
     HeapValue *Alloc();
-    /** Delete all nodes that are not marked */
-    void Sweep();
+    /** Delete all values that are not marked, and unmark the rest for
+        the next collection. With more than one worker, pages are swept
+        in parallel. */
+    void Sweep(GCWorkerPool *workers = nullptr);
+    /** Delete all young values that are not marked, and promote the
+        rest to the old generation. Old values are left alone. */
+    void SweepYoung();
+
+    /** Starts a sweep that is done a few pages at a time. Until it is
+        done, a page is only allocated from once it has been swept, so
+        values allocated in the meantime are never freed by it. */
+    void BeginSweep();
+    /** Sweeps pages until at least `budget` cells have been looked at.
+        Returns true once every page has been swept. */
+    bool SweepStep(size_t budget);
+    inline bool IsSweeping() const { return m_sweeping; }
+
+    /** Calls visit(value) for each value on the heap */
+    template <typename Visit>
+    void ForEachValue(Visit &&visit)
+    {
+        for (HeapPage *page = m_pages; page != nullptr; page = page->next) {
+            for (size_t i = 0; i < page->bump; i++) {
+                if (page->live[i]) {
+                    visit(&page->cells[i].value);
+                }
+            }
+        }
+    }
 
 private:
-    HeapNode *m_head;
+    HeapPage *AddPage();
+    /** Frees unmarked values on the page (only young ones if young_only
+        is set), rebuilding its free list. Marked values are unmarked and
+        promoted; returns their size. Only touches the page, so different
+        pages can be swept at the same time. */
+    size_t SweepPage(HeapPage *page, bool young_only);
+    /** Relink the pages that have room left */
+    void UpdateAvailable();
+
+    // every page
+    HeapPage *m_pages;
+    // the page currently allocated from, followed by the others with room
+    HeapPage *m_available;
+    HeapPage *m_nursery;
     size_t m_num_objects;
+    size_t m_num_pages;
+    size_t m_old_bytes;
+    size_t m_young_bytes;
+
+    // state of the lazy sweep
+    bool m_sweeping;
+    HeapPage **m_sweep_link;
+    size_t m_sweep_bytes;
+    bool m_kept_empty_page;
 };
 
 } // namespace vm
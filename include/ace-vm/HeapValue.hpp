@@ -1,19 +1,56 @@
 #ifndef HEAP_VALUE_HPP
 #define HEAP_VALUE_HPP
 
+#include <ace-vm/ImmutableString.hpp>
+#include <ace-vm/Array.hpp>
+#include <ace-vm/Object.hpp>
+#include <ace-vm/TypeInfo.hpp>
+
 #include <type_traits>
 #include <typeinfo>
+#include <new>
 #include <cstdint>
 #include <cstdlib>
 #include <stdio.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace ace {
 namespace vm {
 
 enum HeapValueFlags {
     GC_MARKED = 0x01,
+    // survived a collection, so only a full collection can free it
+    GC_OLD = 0x02,
+    // old value in a remembered set (see VMState::WriteBarrier)
+    GC_REMEMBERED = 0x04,
 };
 
+/** What a heap value holds. The builtin types have their own tag; values
+    of any other type (libraries, files, ...) are HEAP_NATIVE, and told
+    apart by the id their type is registered with. */
+enum HeapValueType : uint8_t {
+    HEAP_NULL = 0,
+    HEAP_STRING,
+    HEAP_ARRAY,
+    HEAP_OBJECT,
+    HEAP_TYPE_INFO,
+    HEAP_NATIVE,
+};
+
+template <typename T> struct HeapTypeOf     { static const HeapValueType value = HEAP_NATIVE; };
+template <> struct HeapTypeOf<ImmutableString> { static const HeapValueType value = HEAP_STRING; };
+template <> struct HeapTypeOf<Array>        { static const HeapValueType value = HEAP_ARRAY; };
+template <> struct HeapTypeOf<Object>       { static const HeapValueType value = HEAP_OBJECT; };
+template <> struct HeapTypeOf<TypeInfo>     { static const HeapValueType value = HEAP_TYPE_INFO; };
+
+/** A value on the heap. Strings, arrays and objects are stored in the
+    heap value itself, so allocating one takes no memory besides its
+    heap cell (and whatever the payload owns, like string data). Type
+    infos are larger than the others and rare, so they are boxed, as are
+    native types, which are destroyed and compared through a holder. */
 class HeapValue {
 public:
     HeapValue();
@@ -21,72 +58,106 @@ public:
     HeapValue &operator=(const HeapValue &other) = delete;
     ~HeapValue();
 
-    inline bool operator==(const HeapValue &other) const
-    {
-        if (m_holder == other.m_holder) {
-            return true;
-        }
-
-        if (m_holder != NULL && other.m_holder != NULL) {
-            return (*m_holder) == (*other.m_holder);
-        }
-
-        return false;
-    }
+    bool operator==(const HeapValue &other) const;
 
-    inline size_t GetTypeId() const { return m_holder != nullptr ? m_holder->m_type_id : 0; }
-    inline intptr_t GetId() const { return (intptr_t)m_ptr; }
-    inline bool IsNull() const { return m_holder == nullptr; }
+    inline HeapValueType GetType() const { return m_type; }
+    /** Builtin types have the id of their tag; native types come after */
+    inline size_t GetTypeId() const
+        { return m_type == HEAP_NATIVE ? HEAP_NATIVE + GetBoxed().native_id : m_type; }
+    inline intptr_t GetId() const { return (intptr_t)GetRawPointer(); }
+    inline bool IsNull() const { return m_type == HEAP_NULL; }
     inline int &GetFlags() { return m_flags; }
     inline int GetFlags() const { return m_flags; }
+    /** Sets GC_MARKED, returning false if it was set already. Safe to
+        call from several collector threads at once. */
+    inline bool TryMark()
+    {
+#ifdef _MSC_VER
+        return !(_InterlockedOr(reinterpret_cast<volatile long*>(&m_flags), GC_MARKED) & GC_MARKED);
+#else
+        return !(__atomic_fetch_or(&m_flags, (int)GC_MARKED, __ATOMIC_RELAXED) & GC_MARKED);
+#endif
+    }
+    /** Approximate number of bytes allocated for the value, including
+        memory it owns (string data, array buffers and object slots),
+        but not the heap cell it is stored in. */
+    size_t GetSize() const;
 
     template <typename T>
-    inline bool TypeCompatible() const 
-        { return GetTypeId() == GetTypeId<typename std::decay<T>::type>(); }
+    inline bool TypeCompatible() const
+    {
+        typedef typename std::decay<T>::type Type;
+
+        return HeapTypeOf<Type>::value != HEAP_NATIVE
+            ? m_type == HeapTypeOf<Type>::value
+            : m_type == HEAP_NATIVE && GetBoxed().native_id == GetNativeTypeId<Type>();
+    }
 
     template <typename T>
     inline void Assign(const T &value)
     {
-        if (m_holder != nullptr) { delete m_holder; }
-        auto holder = new DerivedHolder<typename std::decay<T>::type>(value);
-        m_ptr = reinterpret_cast<void*>(&holder->m_value);
-        m_holder = holder;
+        typedef typename std::decay<T>::type Type;
+
+        Destroy();
+        Construct(value, std::integral_constant<bool, IsInline<Type>()>());
+        m_type = HeapTypeOf<Type>::value;
     }
 
     template <typename T>
     inline T &Get()
     {
         if (!TypeCompatible<T>()) { throw std::bad_cast(); }
-        return *reinterpret_cast<typename std::decay<T>::type*>(m_ptr);
+        return *GetRawPointer<T>();
     }
 
     template <typename T>
     inline const T &Get() const
     {
         if (!TypeCompatible<T>()) { throw std::bad_cast(); }
-        return *reinterpret_cast<const typename std::decay<T>::type*>(m_ptr);
+        return *const_cast<HeapValue*>(this)->GetRawPointer<T>();
     }
 
     template <typename T>
     inline auto GetRawPointer() -> typename std::decay<T>::type*
-        { return reinterpret_cast<typename std::decay<T>::type*>(m_ptr); }
+    {
+        typedef typename std::decay<T>::type Type;
+
+        return IsInline<Type>()
+            ? reinterpret_cast<Type*>(&m_storage)
+            : reinterpret_cast<Type*>(GetBoxed().ptr);
+    }
+
+    /** Address of the payload, whatever its type */
+    inline void *GetRawPointer() const
+    {
+        switch (m_type) {
+            case HEAP_NULL: return nullptr;
+            case HEAP_STRING: // fallthrough
+            case HEAP_ARRAY:  // fallthrough
+            case HEAP_OBJECT: return const_cast<Storage*>(&m_storage);
+            default:          return GetBoxed().ptr;
+        }
+    }
 
     template <typename T>
     inline auto GetPointer() -> typename std::decay<T>::type*
         { return TypeCompatible<T>() ? GetRawPointer<T>() : nullptr; }
 
+    /** Hands out the id of a native type, the first time a value of
+        the type is stored */
+    static uint32_t RegisterNativeType();
+
 private:
     // base class for an 'any' holder with pure virtual functions
     struct BaseHolder {
-        BaseHolder(size_t type_id) : m_type_id(type_id) {}
         virtual ~BaseHolder() = default;
         virtual bool operator==(const BaseHolder &other) const = 0;
-        size_t m_type_id;
+        virtual size_t GetSize() const = 0;
     };
 
     // derived class that can hold any type
     template <typename T> struct DerivedHolder : public BaseHolder {
-        explicit DerivedHolder(const T &value) : BaseHolder(GetTypeId<T>()), m_value(value) {}
+        explicit DerivedHolder(const T &value) : m_value(value) {}
 
         virtual bool operator==(const BaseHolder &other) const override
         {
@@ -94,15 +165,60 @@ private:
             return (other_casted != nullptr && other_casted->m_value == m_value);
         }
 
+        virtual size_t GetSize() const override { return sizeof(*this); }
+
         T m_value;
     };
 
-    BaseHolder *m_holder;
-    void *m_ptr;
+    // what the storage holds for a type that is not stored inline
+    struct Boxed {
+        void *ptr;
+        // only for native types
+        BaseHolder *holder;
+        uint32_t native_id;
+    };
+
+    typedef std::aligned_union<0, ImmutableString, Array, Object, Boxed>::type Storage;
+
+    HeapValueType m_type;
     int m_flags;
+    Storage m_storage;
+
+    template <typename T>
+    static inline constexpr bool IsInline()
+    {
+        return HeapTypeOf<T>::value == HEAP_STRING
+            || HeapTypeOf<T>::value == HEAP_ARRAY
+            || HeapTypeOf<T>::value == HEAP_OBJECT;
+    }
+
+    template <typename T>
+    static inline uint32_t GetNativeTypeId()
+    {
+        static const uint32_t id = RegisterNativeType();
+        return id;
+    }
+
+    template <typename T>
+    inline void Construct(const T &value, std::true_type /* inline */)
+        { new (&m_storage) T(value); }
+
+    template <typename T>
+    inline void Construct(const T &value, std::false_type /* inline */)
+    {
+        if (HeapTypeOf<T>::value != HEAP_NATIVE) {
+            GetBoxed().ptr = new T(value);
+        } else {
+            auto holder = new DerivedHolder<T>(value);
+            GetBoxed() = Boxed { &holder->m_value, holder, GetNativeTypeId<T>() };
+        }
+    }
+
+    inline Boxed &GetBoxed() { return *reinterpret_cast<Boxed*>(&m_storage); }
+    inline const Boxed &GetBoxed() const { return *reinterpret_cast<const Boxed*>(&m_storage); }
 
-    template <typename T> struct Type { static void id() {} };
-    template <typename T> static inline size_t GetTypeId() { /*return reinterpret_cast<size_t>(&Type<T>::id);*/ return typeid(T).hash_code(); }
+    /** Destroys the payload, leaving the value null */
+    void Destroy();
 };
 
 } // namespace vm
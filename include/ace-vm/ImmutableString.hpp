@@ -1,14 +1,32 @@
 #ifndef IMMUTABLE_STRING_HPP
 #define IMMUTABLE_STRING_HPP
 
+#include <atomic>
 #include <cstring>
+#include <cstdint>
 
 namespace ace {
 namespace vm {
 
+/** A string that cannot be changed once it has been created, so copies
+    share the same data, which is reference counted. The hash of the
+    string (the same as hash_fnv_1 of its data) is computed once, when
+    it is created.
+
+    Interned strings are kept in a table for the lifetime of the program,
+    and there is only ever one interned string with the same contents, so
+    two interned strings are equal if and only if they share their data.
+    String literals and names are interned; strings built at run time
+    are not, as the table would only ever grow. */
 class ImmutableString {
+    friend class StringBuilder;
 public:
     static ImmutableString Concat(const ImmutableString &a, const ImmutableString &b);
+    /** The interned string with the given contents,
+        adding it to the table the first time */
+    static ImmutableString Intern(const char *str, size_t len);
+    static inline ImmutableString Intern(const char *str)
+        { return Intern(str, std::strlen(str)); }
 
 public:
     ImmutableString(const char *str);
@@ -16,21 +34,70 @@ public:
     ImmutableString(const ImmutableString &other);
     ~ImmutableString();
 
+    ImmutableString &operator=(const ImmutableString &other);
+
     inline bool operator==(const ImmutableString &other) const
-        { return m_length == other.m_length && !std::strcmp(m_data, other.m_data); }
+    {
+        if (m_data == other.m_data) {
+            return true;
+        }
+
+        if (m_data->interned && other.m_data->interned) {
+            return false;
+        }
+
+        return m_data->length == other.m_data->length
+            && m_data->hash == other.m_data->hash
+            && !std::memcmp(m_data->chars, other.m_data->chars, m_data->length);
+    }
 
     inline const char *GetData() const
-        { return m_data; }
+        { return m_data->chars; }
     inline size_t GetLength() const
-        { return m_length; }
+        { return m_data->length; }
+    inline uint32_t GetHash() const
+        { return m_data->hash; }
+    inline bool IsInterned() const
+        { return m_data->interned; }
 
 private:
-    char *m_data;
-    // cache length
-    size_t m_length;
+    // header of the shared data, followed by the characters
+    struct Data {
+        // not counted for interned strings, which are never freed
+        std::atomic<uint32_t> refs;
+        uint32_t hash;
+        size_t length;
+        bool interned;
+        char chars[1];
+    };
+
+    static Data *AllocData(size_t len);
+    static Data *CreateData(const char *str, size_t len);
+
+    // buffers for StringBuilder to write the characters of a string into,
+    // with room in front for the header, so that no copy is needed once
+    // the string is finished. passing a null buffer allocates a new one.
+    static char *ResizeBuffer(char *chars, size_t capacity);
+    static void FreeBuffer(char *chars);
+    /** Takes over the buffer, which holds len characters */
+    static ImmutableString FromBuffer(char *chars, size_t len);
+
+    // takes over the reference to the data
+    explicit ImmutableString(Data *data);
+
+    inline void Retain() const
+    {
+        if (!m_data->interned) {
+            m_data->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void Release();
+
+    Data *m_data;
 };
 
 } // namespace vm
 } // namespace ace
 
-#endif
\ No newline at end of file
+#endif
@@ -2,6 +2,7 @@
 #define INSTRUCTION_HANDLER_HPP
 
 #include <ace-vm/BytecodeStream.hpp>
+#include <ace-vm/DecodedProgram.hpp>
 #include <ace-vm/VM.hpp>
 #include <ace-vm/Value.hpp>
 #include <ace-vm/HeapValue.hpp>
@@ -14,23 +15,80 @@
 #include <common/my_assert.hpp>
 #include <common/typedefs.hpp>
 
+#include <mutex>
+#include <cmath>
 #include <stdint.h>
 
 namespace ace {
 namespace vm {
 
+// operations for the type-specialized arithmetic handlers.
+// Valid() is false where the generic handler would throw.
+struct AddOp {
+    template <typename T> static inline bool Valid(T) { return true; }
+    template <typename T> static inline T Apply(T a, T b) { return a + b; }
+};
+
+struct SubOp {
+    template <typename T> static inline bool Valid(T) { return true; }
+    template <typename T> static inline T Apply(T a, T b) { return a - b; }
+};
+
+struct MulOp {
+    template <typename T> static inline bool Valid(T) { return true; }
+    template <typename T> static inline T Apply(T a, T b) { return a * b; }
+};
+
+struct DivOp {
+    template <typename T> static inline bool Valid(T b) { return b != 0; }
+    template <typename T> static inline T Apply(T a, T b) { return a / b; }
+};
+
+struct ModOp {
+    template <typename T> static inline bool Valid(T b) { return b != 0; }
+    static inline aint64 Apply(aint64 a, aint64 b) { return a % b; }
+    static inline afloat64 Apply(afloat64 a, afloat64 b) { return std::fmod(a, b); }
+};
+
 struct InstructionHandler {
     VMState *state;
     ExecutionThread *thread;
+    // the raw bytecode that the program was decoded from
     BytecodeStream *bs;
+    DecodedProgram *program;
+    // index of the next instruction in the program
+    uint32_t pc;
 
     InstructionHandler(VMState *state,
       ExecutionThread *thread,
-      BytecodeStream *bs)
+      BytecodeStream *bs,
+      DecodedProgram *program,
+      uint32_t pc = 0)
       : state(state),
         thread(thread),
-        bs(bs)
+        bs(bs),
+        program(program),
+        pc(pc)
+    {
+    }
+
+    /** Stack access for the handlers below that have an unchecked
+        version, used when running verified bytecode. */
+    template <bool Checked>
+    static inline Value &StackAt(Stack &stack, size_t index)
+    {
+        return Checked ? stack[index] : stack.GetUnchecked(index);
+    }
+
+    /** Stores an Int64 result, throwing if it is out of the range
+        that a value can hold (see Value::FitsI64) */
+    inline void SetI64Checked(Value &value, aint64 i64)
     {
+        if (!Value::FitsI64(i64)) {
+            state->ThrowException(thread, Exception::IntegerOverflowException());
+        }
+
+        value.SetI64(i64);
     }
 
     inline void StoreStaticString(uint32_t len, const char *str)
@@ -38,11 +96,10 @@ struct InstructionHandler {
         // the value will be freed on
         // the destructor call of state->m_static_memory
         HeapValue *hv = new HeapValue();
-        hv->Assign(ImmutableString(str));
+        hv->Assign(ImmutableString::Intern(str, len));
 
         Value sv;
-        sv.m_type = Value::HEAP_POINTER;
-        sv.m_value.ptr = hv;
+        sv.SetHeapPointer(hv);
 
         state->m_static_memory.Store(std::move(sv));
     }
@@ -50,8 +107,7 @@ struct InstructionHandler {
     inline void StoreStaticAddress(bc_address_t addr)
     {
         Value sv;
-        sv.m_type = Value::ADDRESS;
-        sv.m_value.addr = addr;
+        sv.SetAddress(addr);
 
         state->m_static_memory.Store(std::move(sv));
     }
@@ -61,10 +117,7 @@ struct InstructionHandler {
         uint8_t flags)
     {
         Value sv;
-        sv.m_type = Value::FUNCTION;
-        sv.m_value.func.m_addr = addr;
-        sv.m_value.func.m_nargs = nargs;
-        sv.m_value.func.m_flags = flags;
+        sv.SetFunction(addr, nargs, flags);
 
         state->m_static_memory.Store(std::move(sv));
     }
@@ -79,8 +132,7 @@ struct InstructionHandler {
         hv->Assign(TypeInfo(type_name, size, names));
 
         Value sv;
-        sv.m_type = Value::HEAP_POINTER;
-        sv.m_value.ptr = hv;
+        sv.SetHeapPointer(hv);
         state->m_static_memory.Store(std::move(sv));
     }
 
@@ -88,74 +140,91 @@ struct InstructionHandler {
     {
         // get register value given
         Value &value = thread->m_regs[reg];
-        value.m_type = Value::I32;
-        value.m_value.i32 = i32;
+        value.SetI32(i32);
     }
 
     inline void LoadI64(bc_reg_t reg, aint64 i64)
     {
         // get register value given
         Value &value = thread->m_regs[reg];
-        value.m_type = Value::I64;
-        value.m_value.i64 = i64;
+        SetI64Checked(value, i64);
     }
 
     inline void LoadF32(bc_reg_t reg, afloat32 f32)
     {
         // get register value given
         Value &value = thread->m_regs[reg];
-        value.m_type = Value::F32;
-        value.m_value.f = f32;
+        value.SetF32(f32);
     }
 
     inline void LoadF64(bc_reg_t reg, afloat64 f64)
     {
         // get register value given
         Value &value = thread->m_regs[reg];
-        value.m_type = Value::F64;
-        value.m_value.d = f64;
+        value.SetF64(f64);
     }
 
+    template <bool Checked = true>
     inline void LoadOffset(bc_reg_t reg, uint16_t offset)
     {
         // read value from stack at (sp - offset)
         // into the the register
-        thread->m_regs[reg] = thread->m_stack[thread->m_stack.GetStackPointer() - offset];
+        thread->m_regs[reg] = StackAt<Checked>(thread->m_stack,
+            thread->m_stack.GetStackPointer() - offset);
     }
 
+    template <bool Checked = true>
+    inline void LoadLocal(bc_reg_t reg, uint16_t index)
+    {
+        // read value from stack at the index from the
+        // start of the current function's frame
+        thread->m_regs[reg] = StackAt<Checked>(thread->m_stack,
+            thread->m_frames.Top().base + index);
+    }
+
+    template <bool Checked = true>
     inline void LoadIndex(bc_reg_t reg, uint16_t index)
     {
         // read value from stack at the index into the the register
         // NOTE: read from main thread
-        thread->m_regs[reg] = state->MAIN_THREAD->m_stack[index];
+        if (state->GetNumThreads() > 1) {
+            std::lock_guard<std::mutex> lock(state->m_globals_mtx);
+            thread->m_regs[reg] = StackAt<Checked>(state->MAIN_THREAD->m_stack, index);
+        } else {
+            thread->m_regs[reg] = StackAt<Checked>(state->MAIN_THREAD->m_stack, index);
+        }
     }
 
+    template <bool Checked = true>
     inline void LoadStatic(bc_reg_t reg, uint16_t index)
     {
         // read value from static memory
         // at the index into the the register
-        thread->m_regs[reg] = state->m_static_memory[index];
+        thread->m_regs[reg] = Checked
+            ? state->m_static_memory[index]
+            : state->m_static_memory.GetUnchecked(index);
     }
 
-    inline void LoadString(bc_reg_t reg, uint32_t len, const char *str)
+    inline void LoadString(bc_reg_t reg, DecodedString *string)
     {
-        // allocate heap value
-        HeapValue *hv = state->HeapAlloc(thread);
-        if (hv != nullptr) {
-            hv->Assign(ImmutableString(str));
+        // strings cannot be changed, so every run of the
+        // instruction can load the same interned value
+        HeapValue *hv = string->interned.load(std::memory_order_acquire);
 
-            // assign register value to the allocated object
-            Value &sv = thread->m_regs[reg];
-            sv.m_type = Value::HEAP_POINTER;
-            sv.m_value.ptr = hv;
+        if (hv == nullptr) {
+            hv = state->InternString(string->data, string->len);
+            string->interned.store(hv, std::memory_order_release);
         }
+
+        // assign register value to the interned string
+        Value &sv = thread->m_regs[reg];
+        sv.SetHeapPointer(hv);
     }
 
     inline void LoadAddr(bc_reg_t reg, bc_address_t addr)
     {
         Value &sv = thread->m_regs[reg];
-        sv.m_type = Value::ADDRESS;
-        sv.m_value.addr = addr;
+        sv.SetAddress(addr);
     }
 
     inline void LoadFunc(bc_reg_t reg,
@@ -164,36 +233,31 @@ struct InstructionHandler {
         uint8_t flags)
     {
         Value &sv = thread->m_regs[reg];
-        sv.m_type = Value::FUNCTION;
-        sv.m_value.func.m_addr = addr;
-        sv.m_value.func.m_nargs = nargs;
-        sv.m_value.func.m_flags = flags;
+        sv.SetFunction(addr, nargs, flags);
     }
 
-    inline void LoadType(bc_reg_t reg,
-        uint16_t type_name_len,
-        const char *type_name,
-        uint16_t size,
-        char **names)
+    inline void LoadType(bc_reg_t reg, DecodedType *type)
     {
-        // allocate heap value
-        HeapValue *hv = state->HeapAlloc(thread);
-        ASSERT(hv != nullptr);
+        // types are interned, so that objects created in a
+        // loop do not each come with a new TypeInfo
+        HeapValue *hv = type->interned.load(std::memory_order_acquire);
 
-        hv->Assign(TypeInfo(type_name, size, names));
+        if (hv == nullptr) {
+            hv = state->InternType(type->name, type->size, type->names.data());
+            type->interned.store(hv, std::memory_order_release);
+        }
 
-        // assign register value to the allocated object
+        // assign register value to the interned type
         Value &sv = thread->m_regs[reg];
-        sv.m_type = Value::HEAP_POINTER;
-        sv.m_value.ptr = hv;
+        sv.SetHeapPointer(hv);
     }
 
     inline void LoadMem(bc_reg_t dst, bc_reg_t src, uint8_t index)
     {
         Value &sv = thread->m_regs[src];
         
-        if (sv.m_type == Value::HEAP_POINTER) {
-            HeapValue *hv = sv.m_value.ptr;
+        if (sv.GetType() == Value::HEAP_POINTER) {
+            HeapValue *hv = sv.GetHeapPointer();
             if (hv == nullptr) {
                 state->ThrowException(
                     thread,
@@ -206,7 +270,7 @@ struct InstructionHandler {
                 ASSERT(type_ptr != nullptr);
                 ASSERT(index < type_ptr->GetSize());
                 
-                thread->m_regs[dst] = obj_ptr->GetMember(index).value;
+                thread->m_regs[dst] = obj_ptr->GetMember(index);
                 return;
             }
         }
@@ -217,12 +281,52 @@ struct InstructionHandler {
         );
     }
 
-    inline void LoadMemHash(bc_reg_t dst_reg, bc_reg_t src_reg, uint32_t hash)
+    /** Find a member by hash, trying the instruction's inline cache
+        before the shape of the object's type. */
+    inline Value *LookupMemberCached(Object *object, uint32_t hash, InlineCache *cache)
+    {
+        const TypeInfo *type = object->GetTypePtr();
+
+        if (!cache->megamorphic) {
+            for (uint8_t i = 0; i < cache->size; i++) {
+                const InlineCache::Entry &entry = cache->entries[i];
+
+                if (entry.type == type) {
+                    // a collected type's memory may be reused for a type with
+                    // a different layout, so check that the slot matches
+                    const ObjectShape &shape = type->GetShape();
+
+                    if (entry.index < shape.GetSize() && shape.GetHash(entry.index) == hash) {
+                        thread->m_ic_stats.hits++;
+                        return &object->GetMember(entry.index);
+                    }
+                    break;
+                }
+            }
+        }
+
+        thread->m_ic_stats.misses++;
+
+        const int index = type->GetShape().Lookup(hash);
+        if (index == -1) {
+            return nullptr;
+        }
+
+        // the cache is shared by every thread running the
+        // program, so it is only filled in while there is one
+        if (!cache->megamorphic && state->GetNumThreads() == 1) {
+            cache->Add(type, (uint32_t)index);
+        }
+
+        return &object->GetMember(index);
+    }
+
+    inline void LoadMemHash(bc_reg_t dst_reg, bc_reg_t src_reg, uint32_t hash, InlineCache *cache)
     {
         Value &sv = thread->m_regs[src_reg];
 
-        if (sv.m_type == Value::HEAP_POINTER) {
-            HeapValue *hv = sv.m_value.ptr;
+        if (sv.GetType() == Value::HEAP_POINTER) {
+            HeapValue *hv = sv.GetHeapPointer();
 
             if (hv == nullptr) {
                 state->ThrowException(
@@ -231,8 +335,8 @@ struct InstructionHandler {
                 );
                 return;
             } else if (Object *object = hv->GetPointer<Object>()) {
-                if (Member *member = object->LookupMemberFromHash(hash)) {
-                    thread->m_regs[dst_reg] = member->value;
+                if (Value *member = LookupMemberCached(object, hash, cache)) {
+                    thread->m_regs[dst_reg] = *member;
                 } else {
                     state->ThrowException(
                         thread,
@@ -253,7 +357,7 @@ struct InstructionHandler {
     {
         Value &sv = thread->m_regs[src_reg];
 
-        if (sv.m_type != Value::HEAP_POINTER) {
+        if (sv.GetType() != Value::HEAP_POINTER) {
             state->ThrowException(
                 thread,
                 Exception("Not an Array")
@@ -261,7 +365,7 @@ struct InstructionHandler {
             return;
         }
 
-        HeapValue *ptr = sv.m_value.ptr;
+        HeapValue *ptr = sv.GetHeapPointer();
         if (ptr == nullptr) {
             state->ThrowException(
                 thread,
@@ -318,58 +422,70 @@ struct InstructionHandler {
     inline void LoadRef(bc_reg_t dst_reg, bc_reg_t src_reg)
     {
         Value &src = thread->m_regs[dst_reg];
-        src.m_type = Value::VALUE_REF;
-        src.m_value.value_ref = &thread->m_regs[src_reg];
+        src.SetValueRef(&thread->m_regs[src_reg]);
     }
 
     inline void LoadDeref(bc_reg_t dst_reg, bc_reg_t src_reg)
     {
         Value &src = thread->m_regs[src_reg];
-        ASSERT_MSG(src.m_type == Value::VALUE_REF, "Value type must be VALUE_REF in order to deref");
-        ASSERT(src.m_value.value_ref != nullptr);
+        ASSERT_MSG(src.GetType() == Value::VALUE_REF, "Value type must be VALUE_REF in order to deref");
+        ASSERT(src.GetValueRef() != nullptr);
 
-        thread->m_regs[dst_reg] = *src.m_value.value_ref;
+        thread->m_regs[dst_reg] = *src.GetValueRef();
     }
 
     inline void LoadNull(bc_reg_t reg)
     {
         Value &sv = thread->m_regs[reg];
-        sv.m_type = Value::HEAP_POINTER;
-        sv.m_value.ptr = nullptr;
+        sv.SetHeapPointer(nullptr);
     }
 
     inline void LoadTrue(bc_reg_t reg)
     {
         Value &sv = thread->m_regs[reg];
-        sv.m_type = Value::BOOLEAN;
-        sv.m_value.b = true;
+        sv.SetBoolean(true);
     }
 
     inline void LoadFalse(bc_reg_t reg)
     {
         Value &sv = thread->m_regs[reg];
-        sv.m_type = Value::BOOLEAN;
-        sv.m_value.b = false;
+        sv.SetBoolean(false);
     }
 
+    template <bool Checked = true>
     inline void MovOffset(uint16_t offset, bc_reg_t reg)
     {
         // copy value from register to stack value at (sp - offset)
-        thread->m_stack[thread->m_stack.GetStackPointer() - offset] =
+        StackAt<Checked>(thread->m_stack, thread->m_stack.GetStackPointer() - offset) =
             thread->m_regs[reg];
     }
 
+    template <bool Checked = true>
+    inline void MovLocal(uint16_t index, bc_reg_t reg)
+    {
+        // copy value from register to stack value at the
+        // index from the start of the current function's frame
+        StackAt<Checked>(thread->m_stack, thread->m_frames.Top().base + index) =
+            thread->m_regs[reg];
+    }
+
+    template <bool Checked = true>
     inline void MovIndex(uint16_t index, bc_reg_t reg)
     {
         // copy value from register to stack value at index
         // NOTE: storing on main thread
-        state->MAIN_THREAD->m_stack[index] = thread->m_regs[reg];
+        if (state->GetNumThreads() > 1) {
+            std::lock_guard<std::mutex> lock(state->m_globals_mtx);
+            StackAt<Checked>(state->MAIN_THREAD->m_stack, index) = thread->m_regs[reg];
+        } else {
+            StackAt<Checked>(state->MAIN_THREAD->m_stack, index) = thread->m_regs[reg];
+        }
     }
 
     inline void MovMem(bc_reg_t dst_reg, uint8_t index, bc_reg_t src_reg)
     {
         Value &sv = thread->m_regs[dst_reg];
-        if (sv.m_type != Value::HEAP_POINTER) {
+        if (sv.GetType() != Value::HEAP_POINTER) {
             state->ThrowException(
                 thread,
                 Exception("Not an Object")
@@ -377,7 +493,7 @@ struct InstructionHandler {
             return;
         }
 
-        HeapValue *hv = sv.m_value.ptr;
+        HeapValue *hv = sv.GetHeapPointer();
         if (hv == nullptr) {
             state->ThrowException(
                 thread,
@@ -406,14 +522,15 @@ struct InstructionHandler {
             return;
         }
         
-        object->GetMember(index).value = thread->m_regs[src_reg];
+        object->GetMember(index) = thread->m_regs[src_reg];
+        state->WriteBarrier(thread, hv, thread->m_regs[src_reg]);
     }
 
-    inline void MovMemHash(bc_reg_t dst_reg, uint32_t hash, bc_reg_t src_reg)
+    inline void MovMemHash(bc_reg_t dst_reg, uint32_t hash, bc_reg_t src_reg, InlineCache *cache)
     {
         Value &sv = thread->m_regs[dst_reg];
 
-        if (sv.m_type != Value::HEAP_POINTER) {
+        if (sv.GetType() != Value::HEAP_POINTER) {
             state->ThrowException(
                 thread,
                 Exception("Not an Object")
@@ -421,7 +538,7 @@ struct InstructionHandler {
             return;
         }
 
-        HeapValue *hv = sv.m_value.ptr;
+        HeapValue *hv = sv.GetHeapPointer();
         if (hv == nullptr) {
             state->ThrowException(
                 thread,
@@ -439,7 +556,7 @@ struct InstructionHandler {
             return;
         }
 
-        Member *member = object->LookupMemberFromHash(hash);
+        Value *member = LookupMemberCached(object, hash, cache);
         if (member == nullptr) {
             state->ThrowException(
                 thread,
@@ -449,14 +566,15 @@ struct InstructionHandler {
         }
         
         // set value in member
-        member->value = thread->m_regs[src_reg];
+        *member = thread->m_regs[src_reg];
+        state->WriteBarrier(thread, hv, thread->m_regs[src_reg]);
     }
 
     inline void MovArrayIdx(bc_reg_t dst_reg, uint32_t index, bc_reg_t src_reg)
     {
         Value &sv = thread->m_regs[dst_reg];
 
-        if (sv.m_type != Value::HEAP_POINTER) {
+        if (sv.GetType() != Value::HEAP_POINTER) {
             state->ThrowException(
                 thread,
                 Exception("Not an Array")
@@ -464,7 +582,7 @@ struct InstructionHandler {
             return;
         }
 
-        HeapValue *hv = sv.m_value.ptr;
+        HeapValue *hv = sv.GetHeapPointer();
         if (hv == nullptr) {
             state->ThrowException(
                 thread,
@@ -503,6 +621,7 @@ struct InstructionHandler {
         }*/
         
         array->AtIndex(index) = thread->m_regs[src_reg];
+        state->WriteBarrier(thread, hv, thread->m_regs[src_reg]);
     }
 
     inline void MovReg(bc_reg_t dst_reg, bc_reg_t src_reg)
@@ -510,44 +629,58 @@ struct InstructionHandler {
         thread->m_regs[dst_reg] = thread->m_regs[src_reg];
     }
 
-    inline void HasMemHash(bc_reg_t dst_reg, bc_reg_t src_reg, uint32_t hash)
+    inline void HasMemHash(bc_reg_t dst_reg, bc_reg_t src_reg, uint32_t hash, InlineCache *cache)
     {
         Value &src = thread->m_regs[src_reg];
 
         Value &dst = thread->m_regs[dst_reg];
-        dst.m_type = Value::BOOLEAN;
 
-        if (src.m_type == Value::HEAP_POINTER && src.m_value.ptr != nullptr) {
-            if (Object *object = src.m_value.ptr->GetPointer<Object>()) {
-                dst.m_value.b = (object->LookupMemberFromHash(hash) != nullptr);
+        if (src.GetType() == Value::HEAP_POINTER && src.GetHeapPointer() != nullptr) {
+            if (Object *object = src.GetHeapPointer()->GetPointer<Object>()) {
+                dst.SetBoolean(LookupMemberCached(object, hash, cache) != nullptr);
                 return;
             }
         }
 
         // not found, set it to false
-        dst.m_value.b = false;
+        dst.SetBoolean(false);
     }
 
+    template <bool Checked = true>
     inline void Push(bc_reg_t reg)
     {
         // push a copy of the register value to the top of the stack
-        thread->m_stack.Push(thread->m_regs[reg]);
+        if (Checked) {
+            thread->m_stack.Push(thread->m_regs[reg]);
+        } else {
+            thread->m_stack.PushUnchecked(thread->m_regs[reg]);
+        }
     }
 
+    template <bool Checked = true>
     inline void Pop()
     {
-        thread->m_stack.Pop();
+        if (Checked) {
+            thread->m_stack.Pop();
+        } else {
+            thread->m_stack.PopUnchecked();
+        }
     }
 
+    template <bool Checked = true>
     inline void PopN(uint8_t n)
     {
-        thread->m_stack.Pop(n);
+        if (Checked) {
+            thread->m_stack.Pop(n);
+        } else {
+            thread->m_stack.PopUnchecked(n);
+        }
     }
 
     inline void PushArray(bc_reg_t dst_reg, bc_reg_t src_reg)
     {
         Value &dst = thread->m_regs[dst_reg];
-        if (dst.m_type != Value::HEAP_POINTER) {
+        if (dst.GetType() != Value::HEAP_POINTER) {
             state->ThrowException(
                 thread,
                 Exception("Not an Array")
@@ -555,7 +688,7 @@ struct InstructionHandler {
             return;
         }
 
-        HeapValue *hv = dst.m_value.ptr;
+        HeapValue *hv = dst.GetHeapPointer();
         if (hv == nullptr) {
             state->ThrowException(
                 thread,
@@ -573,7 +706,14 @@ struct InstructionHandler {
             return;
         }
 
+        const size_t capacity = array->GetCapacity();
+
         array->Push(thread->m_regs[src_reg]);
+        state->WriteBarrier(thread, hv, thread->m_regs[src_reg]);
+
+        if (array->GetCapacity() != capacity) {
+            state->NoteGrowth(thread, hv, (array->GetCapacity() - capacity) * sizeof(Value));
+        }
     }
 
     inline void Echo(bc_reg_t reg)
@@ -586,36 +726,38 @@ struct InstructionHandler {
         utf::fputs(UTF8_CSTR("\n"), stdout);
     }
 
-    inline void Jmp(bc_address_t addr)
+    // jump targets are instruction indices
+
+    inline void Jmp(uint32_t target)
     {
-        bs->Seek(addr);
+        pc = target;
     }
 
-    inline void Je(bc_address_t addr)
+    inline void Je(uint32_t target)
     {
         if (thread->m_regs.m_flags == EQUAL) {
-            bs->Seek(addr);
+            pc = target;
         }
     }
 
-    inline void Jne(bc_address_t addr)
+    inline void Jne(uint32_t target)
     {
         if (thread->m_regs.m_flags != EQUAL) {
-            bs->Seek(addr);
+            pc = target;
         }
     }
 
-    inline void Jg(bc_address_t addr)
+    inline void Jg(uint32_t target)
     {
         if (thread->m_regs.m_flags == GREATER) {
-            bs->Seek(addr);
+            pc = target;
         }
     }
 
-    inline void Jge(bc_address_t addr)
+    inline void Jge(uint32_t target)
     {
         if (thread->m_regs.m_flags == GREATER || thread->m_regs.m_flags == EQUAL) {
-            bs->Seek(addr);
+            pc = target;
         }
     }
 
@@ -628,32 +770,120 @@ struct InstructionHandler {
         );
     }
 
+    template <bool Checked = true>
+    inline void CallStatic(uint32_t target, bc_address_t addr, uint8_t nargs)
+    {
+        if (Checked) {
+            // the program did not pass the verifier, so the function
+            // may not take nargs arguments. call it as a value instead,
+            // which checks them.
+            const DecodedFunction *function = program->FindFunction(target);
+
+            if (function == nullptr) {
+                state->ThrowException(
+                    thread,
+                    Exception("Not a Function")
+                );
+                return;
+            }
+
+            Value value;
+            value.SetFunction(addr, function->nargs, function->flags);
+            VM::Invoke(this, value, nargs);
+
+            return;
+        }
+
+        // the compiler only calls functions this way when it knows them
+        // to take exactly nargs arguments, and the verifier agrees, so
+        // unlike VM::Invoke there is nothing to check about the callee.
+        if (thread->m_frames.IsFull() ||
+            thread->m_stack.GetStackPointer() + program->GetMaxStackHeight() + 1 >= Stack::STACK_SIZE) {
+            state->ThrowException(
+                thread,
+                Exception::StackOverflowException()
+            );
+
+            return;
+        }
+
+        CallFrame &frame = thread->m_frames.Push();
+        frame.return_pc = pc;
+        frame.base = (uint32_t)(thread->m_stack.GetStackPointer() - nargs);
+        frame.nargs = nargs;
+        frame.function_address = addr;
+
+        pc = target;
+    }
+
+    /** Calls the member with the hash of the first argument ('self'),
+        which is already on the stack, so nothing has to be moved. */
+    inline void CallMethod(uint32_t hash, uint8_t nargs, InlineCache *cache)
+    {
+        ASSERT(nargs > 0 && thread->m_stack.GetStackPointer() >= nargs);
+
+        const Value &self = thread->m_stack[thread->m_stack.GetStackPointer() - nargs];
+
+        if (self.GetType() == Value::HEAP_POINTER) {
+            HeapValue *hv = self.GetHeapPointer();
+
+            if (hv == nullptr) {
+                state->ThrowException(
+                    thread,
+                    Exception::NullReferenceException()
+                );
+                return;
+            } else if (Object *object = hv->GetPointer<Object>()) {
+                if (Value *member = LookupMemberCached(object, hash, cache)) {
+                    // the object is kept alive by 'self', and members
+                    // do not move, so the value can be used in place
+                    VM::Invoke(this, *member, nargs);
+                } else {
+                    state->ThrowException(
+                        thread,
+                        Exception::MemberNotFoundException()
+                    );
+                }
+                return;
+            }
+        }
+
+        state->ThrowException(
+            thread,
+            Exception("Not an Object")
+        );
+    }
+
+    inline void TailCall(bc_reg_t reg, uint8_t nargs)
+    {
+        VM::TailInvoke(
+            this,
+            thread->m_regs[reg],
+            nargs
+        );
+    }
+
     inline void Ret()
     {
-        // get top of stack (should be the address before jumping)
-        Value &top = thread->GetStack().Top();
-        ASSERT(top.GetType() == Value::FUNCTION_CALL);
-        
+        const CallFrame &frame = thread->m_frames.Top();
+
         // leave function and return to previous position
-        bs->Seek(top.GetValue().call.addr);
+        pc = frame.return_pc;
 
-        // increase stack size by the amount required by the call
-        thread->GetStack().m_sp += top.GetValue().call.varargs_push - 1;
-        // NOTE: the -1 is because we will be popping the FUNCTION_CALL 
-        // object from the stack anyway...
+        // put the arguments back the way the caller pushed them (variadic
+        // arguments were gathered into one array), for it to pop them
+        thread->m_stack.m_sp = frame.base + frame.nargs;
 
-        // decrease function depth
-        thread->m_func_depth--;
+        thread->m_frames.Pop();
     }
 
-    inline void BeginTry(bc_address_t addr)
+    inline void BeginTry(uint32_t catch_target)
     {
         thread->m_exception_state.m_try_counter++;
 
         // increase stack size to store data about this try block
         Value info;
-        info.m_type = Value::TRY_CATCH_INFO;
-        info.m_value.try_catch_info.catch_address = addr;
+        info.SetTryCatchInfo(catch_target);
 
         // store the info
         thread->m_stack.Push(info);
@@ -662,7 +892,7 @@ struct InstructionHandler {
     inline void EndTry()
     {
         // pop the try catch info from the stack
-        ASSERT(thread->m_stack.Top().m_type == Value::TRY_CATCH_INFO);
+        ASSERT(thread->m_stack.Top().GetType() == Value::TRY_CATCH_INFO);
         ASSERT(thread->m_exception_state.m_try_counter > 0);
 
         // pop try catch info
@@ -674,9 +904,9 @@ struct InstructionHandler {
     {
         // read value from register
         Value &type_sv = thread->m_regs[src];
-        ASSERT(type_sv.m_type == Value::HEAP_POINTER);
+        ASSERT(type_sv.GetType() == Value::HEAP_POINTER);
 
-        TypeInfo *type_ptr = type_sv.m_value.ptr->GetPointer<TypeInfo>();
+        TypeInfo *type_ptr = type_sv.GetHeapPointer()->GetPointer<TypeInfo>();
         ASSERT(type_ptr != nullptr);
 
         // allocate heap object
@@ -688,8 +918,7 @@ struct InstructionHandler {
 
         // assign register value to the allocated object
         Value &sv = thread->m_regs[dst];
-        sv.m_type = Value::HEAP_POINTER;
-        sv.m_value.ptr = hv;
+        sv.SetHeapPointer(hv);
     }
 
     inline void NewArray(bc_reg_t dst, uint32_t size)
@@ -702,8 +931,7 @@ struct InstructionHandler {
 
         // assign register value to the allocated object
         Value &sv = thread->m_regs[dst];
-        sv.m_type = Value::HEAP_POINTER;
-        sv.m_value.ptr = hv;
+        sv.SetHeapPointer(hv);
     }
 
     inline void Cmp(bc_reg_t lhs_reg, bc_reg_t rhs_reg)
@@ -732,11 +960,11 @@ struct InstructionHandler {
             thread->m_regs.m_flags = (a.f == b.f)
                 ? EQUAL : ((a.f > b.f)
                 ? GREATER : NONE);
-        } else if (lhs->m_type == Value::BOOLEAN && rhs->m_type == Value::BOOLEAN) {
-            thread->m_regs.m_flags = (lhs->m_value.b == rhs->m_value.b)
-                ? EQUAL : ((lhs->m_value.b > rhs->m_value.b)
+        } else if (lhs->GetType() == Value::BOOLEAN && rhs->GetType() == Value::BOOLEAN) {
+            thread->m_regs.m_flags = (lhs->GetBoolean() == rhs->GetBoolean())
+                ? EQUAL : ((lhs->GetBoolean() > rhs->GetBoolean())
                 ? GREATER : NONE);
-        } else if (lhs->m_type == Value::HEAP_POINTER && rhs->m_type == Value::HEAP_POINTER) {
+        } else if (lhs->GetType() == Value::HEAP_POINTER && rhs->GetType() == Value::HEAP_POINTER) {
             int res = VM::CompareAsPointers(lhs, rhs);
             if (res != -1) {
                 thread->m_regs.m_flags = res;
@@ -749,9 +977,9 @@ struct InstructionHandler {
                     )
                 );
             }
-        } else if (lhs->m_type == Value::FUNCTION && rhs->m_type == Value::FUNCTION) {
+        } else if (lhs->GetType() == Value::FUNCTION && rhs->GetType() == Value::FUNCTION) {
             thread->m_regs.m_flags = VM::CompareAsFunctions(lhs, rhs);
-        } else if (lhs->m_type == Value::NATIVE_FUNCTION && rhs->m_type == Value::NATIVE_FUNCTION) {
+        } else if (lhs->GetType() == Value::NATIVE_FUNCTION && rhs->GetType() == Value::NATIVE_FUNCTION) {
             thread->m_regs.m_flags = VM::CompareAsNativeFunctions(lhs, rhs);
         } else {
             state->ThrowException(
@@ -778,11 +1006,11 @@ struct InstructionHandler {
             thread->m_regs.m_flags = !i ? EQUAL : NONE;
         } else if (lhs->GetFloatingPoint(&f)) {
             thread->m_regs.m_flags = !f ? EQUAL : NONE;
-        } else if (lhs->m_type == Value::BOOLEAN) {
-            thread->m_regs.m_flags = !lhs->m_value.b ? EQUAL : NONE;
-        } else if (lhs->m_type == Value::HEAP_POINTER) {
-            thread->m_regs.m_flags = !lhs->m_value.ptr ? EQUAL : NONE;
-        } else if (lhs->m_type == Value::FUNCTION) {
+        } else if (lhs->GetType() == Value::BOOLEAN) {
+            thread->m_regs.m_flags = !lhs->GetBoolean() ? EQUAL : NONE;
+        } else if (lhs->GetType() == Value::HEAP_POINTER) {
+            thread->m_regs.m_flags = !lhs->GetHeapPointer() ? EQUAL : NONE;
+        } else if (lhs->GetType() == Value::FUNCTION) {
             // functions are never null
             thread->m_regs.m_flags = NONE;
         } else {
@@ -808,7 +1036,7 @@ struct InstructionHandler {
         Value *rhs = &thread->m_regs[rhs_reg];
 
         Value result;
-        result.m_type = MATCH_TYPES(lhs->m_type, rhs->m_type);
+        const Value::ValueType result_type = MATCH_TYPES(lhs->GetType(), rhs->GetType());
 
         union {
             aint64 i;
@@ -817,17 +1045,17 @@ struct InstructionHandler {
 
         if (lhs->GetInteger(&a.i) && rhs->GetInteger(&b.i)) {
             aint64 result_value = a.i + b.i;
-            if (result.m_type == Value::I32) {
-                result.m_value.i32 = result_value;
+            if (result_type == Value::I32) {
+                result.SetI32(result_value);
             } else {
-                result.m_value.i64 = result_value;
+                SetI64Checked(result, result_value);
             }
         } else if (lhs->GetNumber(&a.f) && rhs->GetNumber(&b.f)) {
             afloat64 result_value = a.f + b.f;
-            if (result.m_type == Value::F32) {
-                result.m_value.f = result_value;
+            if (result_type == Value::F32) {
+                result.SetF32(result_value);
             } else {
-                result.m_value.d = result_value;
+                result.SetF64(result_value);
             }
         } else {
             state->ThrowException(
@@ -854,7 +1082,7 @@ struct InstructionHandler {
         Value *rhs = &thread->m_regs[rhs_reg];
 
         Value result;
-        result.m_type = MATCH_TYPES(lhs->m_type, rhs->m_type);
+        const Value::ValueType result_type = MATCH_TYPES(lhs->GetType(), rhs->GetType());
 
         union {
             aint64 i;
@@ -863,17 +1091,17 @@ struct InstructionHandler {
 
         if (lhs->GetInteger(&a.i) && rhs->GetInteger(&b.i)) {
             aint64 result_value = a.i - b.i;
-            if (result.m_type == Value::I32) {
-                result.m_value.i32 = result_value;
+            if (result_type == Value::I32) {
+                result.SetI32(result_value);
             } else {
-                result.m_value.i64 = result_value;
+                SetI64Checked(result, result_value);
             }
         } else if (lhs->GetNumber(&a.f) && rhs->GetNumber(&b.f)) {
             afloat64 result_value = a.f - b.f;
-            if (result.m_type == Value::F32) {
-                result.m_value.f = result_value;
+            if (result_type == Value::F32) {
+                result.SetF32(result_value);
             } else {
-                result.m_value.d = result_value;
+                result.SetF64(result_value);
             }
         } else {
             state->ThrowException(
@@ -900,7 +1128,7 @@ struct InstructionHandler {
         Value *rhs = &thread->m_regs[rhs_reg];
 
         Value result;
-        result.m_type = MATCH_TYPES(lhs->m_type, rhs->m_type);
+        const Value::ValueType result_type = MATCH_TYPES(lhs->GetType(), rhs->GetType());
 
         union {
             aint64 i;
@@ -909,17 +1137,17 @@ struct InstructionHandler {
 
         if (lhs->GetInteger(&a.i) && rhs->GetInteger(&b.i)) {
             aint64 result_value = a.i * b.i;
-            if (result.m_type == Value::I32) {
-                result.m_value.i32 = result_value;
+            if (result_type == Value::I32) {
+                result.SetI32(result_value);
             } else {
-                result.m_value.i64 = result_value;
+                SetI64Checked(result, result_value);
             }
         } else if (lhs->GetNumber(&a.f) && rhs->GetNumber(&b.f)) {
             afloat64 result_value = a.f * b.f;
-            if (result.m_type == Value::F32) {
-                result.m_value.f = result_value;
+            if (result_type == Value::F32) {
+                result.SetF32(result_value);
             } else {
-                result.m_value.d = result_value;
+                result.SetF64(result_value);
             }
         } else {
             state->ThrowException(
@@ -944,7 +1172,7 @@ struct InstructionHandler {
         Value *rhs = &thread->m_regs[rhs_reg];
 
         Value result;
-        result.m_type = MATCH_TYPES(lhs->m_type, rhs->m_type);
+        const Value::ValueType result_type = MATCH_TYPES(lhs->GetType(), rhs->GetType());
 
         union {
             aint64 i;
@@ -957,10 +1185,10 @@ struct InstructionHandler {
                 state->ThrowException(thread, Exception::DivisionByZeroException());
             } else {
                 aint64 result_value = a.i / b.i;
-                if (result.m_type == Value::I32) {
-                    result.m_value.i32 = result_value;
+                if (result_type == Value::I32) {
+                    result.SetI32(result_value);
                 } else {
-                    result.m_value.i64 = result_value;
+                    SetI64Checked(result, result_value);
                 }
             }
         } else if (lhs->GetNumber(&a.f) && rhs->GetNumber(&b.f)) {
@@ -969,10 +1197,10 @@ struct InstructionHandler {
                 state->ThrowException(thread, Exception::DivisionByZeroException());
             } else {
                 afloat64 result_value = a.f / b.f;
-                if (result.m_type == Value::F32) {
-                    result.m_value.f = result_value;
+                if (result_type == Value::F32) {
+                    result.SetF32(result_value);
                 } else {
-                    result.m_value.d = result_value;
+                    result.SetF64(result_value);
                 }
             }
         } else {
@@ -998,7 +1226,7 @@ struct InstructionHandler {
         Value *rhs = &thread->m_regs[rhs_reg];
 
         Value result;
-        result.m_type = MATCH_TYPES(lhs->m_type, rhs->m_type);
+        const Value::ValueType result_type = MATCH_TYPES(lhs->GetType(), rhs->GetType());
 
         union {
             aint64 i;
@@ -1014,10 +1242,10 @@ struct InstructionHandler {
                 );
             } else {
                 aint64 result_value = a.i % b.i;
-                if (result.m_type == Value::I32) {
-                    result.m_value.i32 = result_value;
+                if (result_type == Value::I32) {
+                    result.SetI32(result_value);
                 } else {
-                    result.m_value.i64 = result_value;
+                    result.SetI64(result_value);
                 }
             }
         } else if (lhs->GetNumber(&a.f) && rhs->GetNumber(&b.f)) {
@@ -1029,10 +1257,10 @@ struct InstructionHandler {
                 );
             } else {
                 afloat64 result_value = std::fmod(a.f, b.f);
-                if (result.m_type == Value::F32) {
-                    result.m_value.f = result_value;
+                if (result_type == Value::F32) {
+                    result.SetF32(result_value);
                 } else {
-                    result.m_value.d = result_value;
+                    result.SetF64(result_value);
                 }
             }
         } else {
@@ -1051,6 +1279,155 @@ struct InstructionHandler {
         thread->m_regs[dst_reg] = result;
     }
 
+    // type-specialized versions of the handlers above, run by quickened
+    // instructions. each one returns false without touching anything if
+    // the operands are not of the type it is for, so that the generic
+    // handler can be run instead. the results are the same as the
+    // generic handler would give for those types.
+
+    template <typename Op>
+    inline bool ArithI32(bc_reg_t lhs_reg, bc_reg_t rhs_reg, bc_reg_t dst_reg)
+    {
+        const Value &lhs = thread->m_regs[lhs_reg];
+        const Value &rhs = thread->m_regs[rhs_reg];
+
+        if (lhs.GetType() != Value::I32 || rhs.GetType() != Value::I32 || !Op::Valid(rhs.GetI32())) {
+            return false;
+        }
+
+        // computed as 64 bit, like the generic handler
+        const aint64 result = Op::Apply((aint64)lhs.GetI32(), (aint64)rhs.GetI32());
+
+        Value &dst = thread->m_regs[dst_reg];
+        dst.SetI32((aint32)result);
+
+        return true;
+    }
+
+    template <typename Op>
+    inline bool ArithI64(bc_reg_t lhs_reg, bc_reg_t rhs_reg, bc_reg_t dst_reg)
+    {
+        const Value &lhs = thread->m_regs[lhs_reg];
+        const Value &rhs = thread->m_regs[rhs_reg];
+
+        if (lhs.GetType() != Value::I64 || rhs.GetType() != Value::I64 || !Op::Valid(rhs.GetI64())) {
+            return false;
+        }
+
+        const aint64 result = Op::Apply(lhs.GetI64(), rhs.GetI64());
+
+        // the generic handler throws for it
+        if (!Value::FitsI64(result)) {
+            return false;
+        }
+
+        Value &dst = thread->m_regs[dst_reg];
+        dst.SetI64(result);
+
+        return true;
+    }
+
+    template <typename Op>
+    inline bool ArithF32(bc_reg_t lhs_reg, bc_reg_t rhs_reg, bc_reg_t dst_reg)
+    {
+        const Value &lhs = thread->m_regs[lhs_reg];
+        const Value &rhs = thread->m_regs[rhs_reg];
+
+        if (lhs.GetType() != Value::F32 || rhs.GetType() != Value::F32 || !Op::Valid(rhs.GetF32())) {
+            return false;
+        }
+
+        // computed as 64 bit, like the generic handler
+        const afloat64 result = Op::Apply((afloat64)lhs.GetF32(), (afloat64)rhs.GetF32());
+
+        Value &dst = thread->m_regs[dst_reg];
+        dst.SetF32((afloat32)result);
+
+        return true;
+    }
+
+    template <typename Op>
+    inline bool ArithF64(bc_reg_t lhs_reg, bc_reg_t rhs_reg, bc_reg_t dst_reg)
+    {
+        const Value &lhs = thread->m_regs[lhs_reg];
+        const Value &rhs = thread->m_regs[rhs_reg];
+
+        if (lhs.GetType() != Value::F64 || rhs.GetType() != Value::F64 || !Op::Valid(rhs.GetF64())) {
+            return false;
+        }
+
+        const afloat64 result = Op::Apply(lhs.GetF64(), rhs.GetF64());
+
+        Value &dst = thread->m_regs[dst_reg];
+        dst.SetF64(result);
+
+        return true;
+    }
+
+    inline bool CmpI32(bc_reg_t lhs_reg, bc_reg_t rhs_reg)
+    {
+        const Value &lhs = thread->m_regs[lhs_reg];
+        const Value &rhs = thread->m_regs[rhs_reg];
+
+        if (lhs.GetType() != Value::I32 || rhs.GetType() != Value::I32) {
+            return false;
+        }
+
+        const aint32 a = lhs.GetI32();
+        const aint32 b = rhs.GetI32();
+        thread->m_regs.m_flags = (a == b) ? EQUAL : ((a > b) ? GREATER : NONE);
+
+        return true;
+    }
+
+    inline bool CmpI64(bc_reg_t lhs_reg, bc_reg_t rhs_reg)
+    {
+        const Value &lhs = thread->m_regs[lhs_reg];
+        const Value &rhs = thread->m_regs[rhs_reg];
+
+        if (lhs.GetType() != Value::I64 || rhs.GetType() != Value::I64) {
+            return false;
+        }
+
+        const aint64 a = lhs.GetI64();
+        const aint64 b = rhs.GetI64();
+        thread->m_regs.m_flags = (a == b) ? EQUAL : ((a > b) ? GREATER : NONE);
+
+        return true;
+    }
+
+    inline bool CmpF32(bc_reg_t lhs_reg, bc_reg_t rhs_reg)
+    {
+        const Value &lhs = thread->m_regs[lhs_reg];
+        const Value &rhs = thread->m_regs[rhs_reg];
+
+        if (lhs.GetType() != Value::F32 || rhs.GetType() != Value::F32) {
+            return false;
+        }
+
+        const afloat32 a = lhs.GetF32();
+        const afloat32 b = rhs.GetF32();
+        thread->m_regs.m_flags = (a == b) ? EQUAL : ((a > b) ? GREATER : NONE);
+
+        return true;
+    }
+
+    inline bool CmpF64(bc_reg_t lhs_reg, bc_reg_t rhs_reg)
+    {
+        const Value &lhs = thread->m_regs[lhs_reg];
+        const Value &rhs = thread->m_regs[rhs_reg];
+
+        if (lhs.GetType() != Value::F64 || rhs.GetType() != Value::F64) {
+            return false;
+        }
+
+        const afloat64 a = lhs.GetF64();
+        const afloat64 b = rhs.GetF64();
+        thread->m_regs.m_flags = (a == b) ? EQUAL : ((a > b) ? GREATER : NONE);
+
+        return true;
+    }
+
     inline void And(bc_reg_t lhs_reg,
         bc_reg_t rhs_reg,
         bc_reg_t dst_reg)
@@ -1060,16 +1437,16 @@ struct InstructionHandler {
         Value *rhs = &thread->m_regs[rhs_reg];
 
         Value result;
-        result.m_type = MATCH_TYPES(lhs->m_type, rhs->m_type);
+        const Value::ValueType result_type = MATCH_TYPES(lhs->GetType(), rhs->GetType());
 
         aint64 a, b;
 
         if (lhs->GetInteger(&a) && rhs->GetInteger(&b)) {
             aint64 result_value = a & b;
-            if (result.m_type == Value::I32) {
-                result.m_value.i32 = result_value;
+            if (result_type == Value::I32) {
+                result.SetI32(result_value);
             } else {
-                result.m_value.i64 = result_value;
+                result.SetI64(result_value);
             }
         } else {
             state->ThrowException(
@@ -1096,16 +1473,16 @@ struct InstructionHandler {
         Value *rhs = &thread->m_regs[rhs_reg];
 
         Value result;
-        result.m_type = MATCH_TYPES(lhs->m_type, rhs->m_type);
+        const Value::ValueType result_type = MATCH_TYPES(lhs->GetType(), rhs->GetType());
 
         aint64 a, b;
 
         if (lhs->GetInteger(&a) && rhs->GetInteger(&b)) {
             aint64 result_value = a | b;
-            if (result.m_type == Value::I32) {
-                result.m_value.i32 = result_value;
+            if (result_type == Value::I32) {
+                result.SetI32(result_value);
             } else {
-                result.m_value.i64 = result_value;
+                result.SetI64(result_value);
             }
         } else {
             state->ThrowException(
@@ -1132,16 +1509,16 @@ struct InstructionHandler {
         Value *rhs = &thread->m_regs[rhs_reg];
 
         Value result;
-        result.m_type = MATCH_TYPES(lhs->m_type, rhs->m_type);
+        const Value::ValueType result_type = MATCH_TYPES(lhs->GetType(), rhs->GetType());
 
         aint64 a, b;
 
         if (lhs->GetInteger(&a) && rhs->GetInteger(&b)) {
             aint64 result_value = a ^ b;
-            if (result.m_type == Value::I32) {
-                result.m_value.i32 = result_value;
+            if (result_type == Value::I32) {
+                result.SetI32(result_value);
             } else {
-                result.m_value.i64 = result_value;
+                result.SetI64(result_value);
             }
         } else {
             state->ThrowException(
@@ -1168,16 +1545,16 @@ struct InstructionHandler {
         Value *rhs = &thread->m_regs[rhs_reg];
 
         Value result;
-        result.m_type = MATCH_TYPES(lhs->m_type, rhs->m_type);
+        const Value::ValueType result_type = MATCH_TYPES(lhs->GetType(), rhs->GetType());
 
         aint64 a, b;
 
         if (lhs->GetInteger(&a) && rhs->GetInteger(&b)) {
             aint64 result_value = a << b;
-            if (result.m_type == Value::I32) {
-                result.m_value.i32 = result_value;
+            if (result_type == Value::I32) {
+                result.SetI32(result_value);
             } else {
-                result.m_value.i64 = result_value;
+                SetI64Checked(result, result_value);
             }
         } else {
             state->ThrowException(
@@ -1204,16 +1581,16 @@ struct InstructionHandler {
         Value *rhs = &thread->m_regs[rhs_reg];
 
         Value result;
-        result.m_type = MATCH_TYPES(lhs->m_type, rhs->m_type);
+        const Value::ValueType result_type = MATCH_TYPES(lhs->GetType(), rhs->GetType());
 
         aint64 a, b;
 
         if (lhs->GetInteger(&a) && rhs->GetInteger(&b)) {
             aint64 result_value = a >> b;
-            if (result.m_type == Value::I32) {
-                result.m_value.i32 = result_value;
+            if (result_type == Value::I32) {
+                result.SetI32(result_value);
             } else {
-                result.m_value.i64 = result_value;
+                result.SetI64(result_value);
             }
         } else {
             state->ThrowException(
@@ -1242,16 +1619,16 @@ struct InstructionHandler {
         };
 
         if (value->GetInteger(&i)) {
-            if (value->m_type == Value::I32) {
-                value->m_value.i32 = -i;
+            if (value->GetType() == Value::I32) {
+                value->SetI32(-i);
             } else {
-                value->m_value.i64 = -i;
+                SetI64Checked(*value, -i);
             }
         } else if (value->GetFloatingPoint(&f)) {
-            if (value->m_type == Value::F32) {
-                value->m_value.f = -f;
+            if (value->GetType() == Value::F32) {
+                value->SetF32(-f);
             } else {
-                value->m_value.d = -f;
+                value->SetF64(-f);
             }
         } else {
             state->ThrowException(
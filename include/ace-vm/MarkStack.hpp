@@ -0,0 +1,128 @@
+#ifndef MARK_STACK_HPP
+#define MARK_STACK_HPP
+
+#include <ace-vm/Value.hpp>
+#include <ace-vm/HeapValue.hpp>
+#include <ace-vm/Object.hpp>
+#include <ace-vm/Array.hpp>
+
+#include <common/my_assert.hpp>
+
+#include <vector>
+#include <cstddef>
+
+// most values the mark stack holds before it overflows
+#define MARK_STACK_MAX_SIZE (1 << 20)
+
+namespace ace {
+namespace vm {
+
+/** Calls visit(value) for each value that the heap value refers to:
+    the members and type of an object, or the elements of an array. */
+template <typename Visit>
+inline void ForEachReference(HeapValue *ptr, Visit &&visit)
+{
+    switch (ptr->GetType()) {
+        case HEAP_OBJECT: {
+            Object *object = ptr->GetRawPointer<Object>();
+            const TypeInfo *type_ptr = object->GetTypePtr();
+            ASSERT(type_ptr != nullptr);
+
+            const size_t size = type_ptr->GetSize();
+            for (size_t i = 0; i < size; i++) {
+                visit(object->GetMember(i));
+            }
+
+            visit(object->GetTypePtrValue());
+            break;
+        }
+        case HEAP_ARRAY: {
+            Array *array = ptr->GetRawPointer<Array>();
+            const size_t size = array->GetSize();
+            for (size_t i = 0; i < size; i++) {
+                visit(array->AtIndex(i));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/** Heap values that have been marked, but not yet scanned for the
+    values they refer to (the grey values, in tri-color terms). Marking
+    can be stopped after any number of values have been scanned and
+    picked up again later, which is what incremental collection uses.
+
+    The stack has a fixed maximum size. Once it is full, values are
+    still marked but not pushed, and the stack is flagged as having
+    overflowed; the owner then has to find them again by scanning the
+    references of every marked value on the heap (see ScanReferences).
+    Deep structures like long linked lists take one entry per value
+    that is waiting to be scanned, not one native stack frame. */
+class MarkStack {
+public:
+    MarkStack(size_t max_size = MARK_STACK_MAX_SIZE);
+    MarkStack(const MarkStack &other) = delete;
+    ~MarkStack() = default;
+
+    inline bool IsEmpty() const { return m_values.empty(); }
+    inline void Clear() { m_values.clear(); m_overflowed = false; }
+
+    /** Values with any of these flags set are not marked or gone into.
+        GC_MARKED for a full collection, GC_MARKED | GC_OLD for a
+        minor one. */
+    inline void SetSkipFlags(int skip_flags) { m_skip_flags = skip_flags; }
+
+    /** True if a value was left off the stack since the last ClearOverflow() */
+    inline bool HasOverflowed() const { return m_overflowed; }
+    inline void ClearOverflow() { m_overflowed = false; }
+
+    /** Marks the heap value that the value refers to, if it is not
+        marked already, and pushes it to be scanned. */
+    inline void Shade(const Value &value)
+    {
+        if (value.GetType() == Value::HEAP_POINTER) {
+            Shade(value.GetHeapPointer());
+        } else if (value.GetType() == Value::VALUE_REF) {
+            Shade(*value.GetValueRef());
+        }
+    }
+
+    inline void Shade(HeapValue *ptr)
+    {
+        if (ptr != nullptr && !(ptr->GetFlags() & m_skip_flags)) {
+            ptr->GetFlags() |= GC_MARKED;
+
+            if (m_values.size() < m_max_size) {
+                m_values.push_back(ptr);
+            } else {
+                m_overflowed = true;
+            }
+        }
+    }
+
+    /** Shades every value that the heap value refers to, without
+        marking the heap value itself. */
+    inline void ScanReferences(HeapValue *ptr)
+        { ForEachReference(ptr, [this](const Value &value) { Shade(value); }); }
+
+    /** Pushes values that are already marked, to be scanned */
+    inline void PushMarked(const std::vector<HeapValue*> &values)
+        { m_values.insert(m_values.end(), values.begin(), values.end()); }
+
+    /** Scans values until there are none left or `budget` of them
+        have been scanned. Returns the number that were scanned. */
+    size_t Drain(size_t budget);
+
+private:
+    std::vector<HeapValue*> m_values;
+    size_t m_max_size;
+    int m_skip_flags;
+    bool m_overflowed;
+};
+
+} // namespace vm
+} // namespace ace
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef NUMBER_FORMAT_HPP
+#define NUMBER_FORMAT_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ace {
+namespace vm {
+
+/** Formats numbers straight into a caller's buffer, without going
+    through printf. Each function writes at most NUMBER_FORMAT_MAX
+    characters, without a terminator, and returns how many it wrote.
+
+    Doubles come out the same as printf's "%g" (6 significant digits,
+    exponent form outside of 1e-4 <= |x| < 1e6), so the output of a
+    script does not depend on which path printed a number. */
+static const size_t NUMBER_FORMAT_MAX = 32;
+
+size_t FormatI32(int32_t value, char *buf);
+size_t FormatI64(int64_t value, char *buf);
+size_t FormatF64(double value, char *buf);
+
+/** Floats are promoted to double, as they are when passed to printf */
+inline size_t FormatF32(float value, char *buf)
+    { return FormatF64(value, buf); }
+
+} // namespace vm
+} // namespace ace
+
+#endif
@@ -3,71 +3,44 @@
 
 #include <ace-vm/Value.hpp>
 #include <ace-vm/TypeInfo.hpp>
+#include <ace-vm/StringBuilder.hpp>
 
-#include <sstream>
-#include <cstdint>
-#include <cmath>
+#include <common/hasher.hpp>
 
-#define DEFAULT_BUCKET_CAPACITY 4
-#define COMPUTE_CAPACITY(size) 1 << (unsigned)std::ceil(std::log(size) / std::log(2.0))
+#include <cstdint>
 
 namespace ace {
 namespace vm {
 
-struct Member {
-    uint32_t hash;
-    Value value;
-};
-
-class ObjectMap {
-public:
-    ObjectMap(size_t size);
-    ObjectMap(const ObjectMap &other);
-    ~ObjectMap();
-
-    ObjectMap &operator=(const ObjectMap &other);
-
-    void Push(uint32_t hash, Member *member);
-    Member *Get(uint32_t hash);
-
-private:
-    struct ObjectBucket {
-        Member **m_data;
-        size_t m_capacity;
-        size_t m_size;
-
-        ObjectBucket();
-        ObjectBucket(const ObjectBucket &other);
-        ~ObjectBucket();
-
-        ObjectBucket &operator=(const ObjectBucket &other);
-
-        void Resize(size_t capacity);
-        void Push(Member *member);
-        bool Lookup(uint32_t hash, Member **out);
-    };
-
-    ObjectBucket *m_buckets;
-    size_t m_size;
-};
-
+/** An instance of a type. Members are stored in slots, in the order the
+    type declares them; finding a member by name goes through the shape
+    that all objects of the type share. */
 class Object {
 public:
+    /** The member that makes an object callable */
+    static constexpr uint32_t INVOKE_HASH = hash_fnv_1("$invoke");
+
     Object(TypeInfo *type_ptr, const Value &type_ptr_value);
     Object(const Object &other);
     ~Object();
 
+    Object &operator=(const Object &other) = delete;
+
     // compare by memory address
     inline bool operator==(const Object &other) const { return this == &other; }
 
-    inline Member *LookupMemberFromHash(uint32_t hash) const
-        { return m_object_map->Get(hash); }
-    inline Member *GetMembers() const
-        { return m_members; }
-    inline Member &GetMember(int index)
-        { return m_members[index]; }
-    inline const Member &GetMember(int index) const
-        { return m_members[index]; }
+    /** Returns nullptr if the type has no member with the hash */
+    inline Value *LookupMemberFromHash(uint32_t hash) const
+    {
+        const int index = m_type_ptr->GetShape().Lookup(hash);
+        return index != -1 ? &m_slots[index] : nullptr;
+    }
+    inline Value *GetMembers() const
+        { return m_slots; }
+    inline Value &GetMember(int index)
+        { return m_slots[index]; }
+    inline const Value &GetMember(int index) const
+        { return m_slots[index]; }
     inline TypeInfo *GetTypePtr() const
         { return m_type_ptr; }
     inline Value &GetTypePtrValue()
@@ -75,13 +48,12 @@ public:
     inline const Value &GetTypePtrValue() const
         { return m_type_ptr_value; }
     
-    void GetRepresentation(std::stringstream &ss, bool add_type_name = true) const;
+    void GetRepresentation(StringBuilder &out, bool add_type_name = true) const;
 
 private:
     TypeInfo *m_type_ptr;
     Value m_type_ptr_value;
-    ObjectMap *m_object_map;
-    Member *m_members;
+    Value *m_slots;
 };
 
 } // namespace vm
@@ -0,0 +1,59 @@
+#ifndef PARALLEL_MARKER_HPP
+#define PARALLEL_MARKER_HPP
+
+#include <ace-vm/Value.hpp>
+#include <ace-vm/HeapValue.hpp>
+#include <ace-vm/GCWorkerPool.hpp>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ace {
+namespace vm {
+
+/** Marks everything reachable from a set of roots on all the workers of
+    a GCWorkerPool. Each worker scans from a private stack, and moves part
+    of it to its deque when that has run dry, for idle workers to steal.
+    Values are claimed with HeapValue::TryMark, so each one is only
+    scanned once. */
+class ParallelMarker {
+public:
+    explicit ParallelMarker(GCWorkerPool *pool);
+    ParallelMarker(const ParallelMarker &other) = delete;
+    ~ParallelMarker() = default;
+
+    /** Marks the heap value that the root refers to, and hands it to
+        one of the workers. Must be called before Run(). */
+    void Shade(const Value &value);
+    /** Scans everything reachable from what has been shaded */
+    void Run();
+
+private:
+    struct Worker {
+        std::mutex mtx;
+        std::deque<HeapValue*> shared;
+        // size of shared, to check for work without locking
+        std::atomic<size_t> num_shared { 0 };
+    };
+
+    void Work(size_t index);
+    /** Moves the older half of the stack to the worker's deque */
+    void Share(size_t index, std::vector<HeapValue*> &stack);
+    bool PopShared(size_t index, HeapValue *&out);
+    bool Steal(size_t thief, HeapValue *&out);
+    bool AnyShared() const;
+
+    GCWorkerPool *m_pool;
+    size_t m_num_workers;
+    std::unique_ptr<Worker[]> m_workers;
+    size_t m_next_seed;
+    std::atomic<size_t> m_num_idle;
+};
+
+} // namespace vm
+} // namespace ace
+
+#endif
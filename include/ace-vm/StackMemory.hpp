@@ -22,8 +22,6 @@ public:
 
     /** Purge all items on the stack */
     void Purge();
-    /** Mark all items on the stack to not be garbage collected */
-    void MarkAll();
 
     inline Value *GetData() { return m_data; }
     inline const Value *GetData() const { return m_data; }
@@ -76,10 +74,81 @@ public:
         m_sp -= n;
     }
 
+    // versions without bounds checks, for verified bytecode only
+    inline Value &GetUnchecked(size_t index) { return m_data[index]; }
+    inline void PushUnchecked(const Value &value) { m_data[m_sp++] = value; }
+    inline void PopUnchecked(size_t n = 1) { m_sp -= n; }
+
     Value *m_data;
     size_t m_sp;
 };
 
+/** What is needed to return from a function call */
+struct CallFrame {
+    // index of the instruction to return to
+    uint32_t return_pc;
+    // stack index of the first argument, which
+    // the locals of the function are addressed from
+    uint32_t base;
+    // number of arguments the caller pushed (and pops after the call),
+    // so the stack is put back to base + nargs on return
+    uint32_t nargs;
+    // the function that was called
+    bc_address_t function_address;
+};
+
+/** The calls a thread is in the middle of, innermost on top. Frames are
+    kept apart from the values on the Stack, so a call or a return does
+    not push or pop a value, and the chain of calls can be walked (by an
+    exception or a profiler) without looking through the values. */
+class CallStack {
+public:
+    /** How deep calls can be nested before a StackOverflowException */
+    static const size_t MAX_DEPTH;
+
+public:
+    CallStack();
+    CallStack(const CallStack &other) = delete;
+    ~CallStack();
+
+    /** Drop all frames, as if no function had been called */
+    inline void Purge() { m_depth = 0; }
+
+    /** The number of calls that have not returned yet */
+    inline size_t GetDepth() const { return m_depth; }
+    inline bool IsFull() const { return m_depth == MAX_DEPTH; }
+
+    /** The innermost call. Outside of any function, this is a frame
+        with a base of 0, the start of the stack. */
+    inline CallFrame &Top() { return m_frames[m_depth]; }
+    inline const CallFrame &Top() const { return m_frames[m_depth]; }
+
+    /** The frame of the call at the given depth, from 1 for the outermost
+        call to GetDepth() for the innermost */
+    inline const CallFrame &operator[](size_t depth) const
+    {
+        ASSERT_MSG(depth > 0 && depth <= m_depth, "out of bounds");
+        return m_frames[depth];
+    }
+
+    inline CallFrame &Push()
+    {
+        ASSERT_MSG(m_depth < MAX_DEPTH, "call stack overflow");
+        return m_frames[++m_depth];
+    }
+
+    inline void Pop()
+    {
+        ASSERT_MSG(m_depth > 0, "call stack underflow");
+        m_depth--;
+    }
+
+private:
+    // MAX_DEPTH + 1 frames, the first being the frame outside of any call
+    CallFrame *m_frames;
+    size_t m_depth;
+};
+
 } // namespace vm
 } // namespace ace
 
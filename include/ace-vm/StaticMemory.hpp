@@ -33,6 +33,9 @@ public:
         return m_data[index];
     }
 
+    // version without bounds checks, for verified bytecode only
+    inline Value &GetUnchecked(size_t index) { return m_data[index]; }
+
     // move a value to static memory
     inline void Store(Value &&value)
     {
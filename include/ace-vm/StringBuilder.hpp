@@ -0,0 +1,81 @@
+#ifndef STRING_BUILDER_HPP
+#define STRING_BUILDER_HPP
+
+#include <ace-vm/ImmutableString.hpp>
+
+#include <cstring>
+#include <cstddef>
+
+namespace ace {
+namespace vm {
+
+/** Builds a string piece by piece. The characters are kept in one
+    buffer that at least doubles in size when it is full, so appending
+    n characters in total takes O(n) time, where concatenating strings
+    would copy everything appended so far each time. Finish() hands the
+    buffer over to the resulting string without copying it. */
+class StringBuilder {
+public:
+    StringBuilder();
+    explicit StringBuilder(size_t capacity);
+    StringBuilder(const StringBuilder &other);
+    ~StringBuilder();
+
+    StringBuilder &operator=(const StringBuilder &other) = delete;
+
+    bool operator==(const StringBuilder &other) const;
+
+    inline size_t GetLength() const
+        { return m_length; }
+    inline size_t GetCapacity() const
+        { return m_capacity; }
+
+    /** Make room for a string of at least the given length */
+    void Reserve(size_t capacity);
+
+    inline void Append(const char *str, size_t len)
+    {
+        std::memcpy(Prepare(len), str, len);
+        m_length += len;
+    }
+
+    inline void Append(const char *str)
+        { Append(str, std::strlen(str)); }
+    inline void Append(const ImmutableString &str)
+        { Append(str.GetData(), str.GetLength()); }
+
+    inline void Append(char ch)
+    {
+        *Prepare(1) = ch;
+        m_length++;
+    }
+
+    /** Room for len more characters at the end, to be written directly
+        (e.g by snprintf) and then added with Commit(). */
+    inline char *Prepare(size_t len)
+    {
+        if (m_length + len > m_capacity) {
+            Grow(m_length + len);
+        }
+
+        return m_chars + m_length;
+    }
+
+    inline void Commit(size_t len)
+        { m_length += len; }
+
+    /** The string built so far. The builder is empty afterwards. */
+    ImmutableString Finish();
+
+private:
+    void Grow(size_t min_capacity);
+
+    char *m_chars;
+    size_t m_length;
+    size_t m_capacity;
+};
+
+} // namespace vm
+} // namespace ace
+
+#endif
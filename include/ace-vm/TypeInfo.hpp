@@ -3,9 +3,51 @@
 
 #include <common/my_assert.hpp>
 
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
 namespace ace {
 namespace vm {
 
+/** Layout shared by every object of a type: the slot index of each member,
+    looked up by the hash of its name. Built once, when the type is. */
+class ObjectShape {
+public:
+    ObjectShape(size_t size, char **names);
+    ObjectShape(const ObjectShape &other) = default;
+    ObjectShape &operator=(const ObjectShape &other) = default;
+    ~ObjectShape() = default;
+
+    inline size_t GetSize() const
+        { return m_hashes.size(); }
+    inline uint32_t GetHash(size_t index) const
+        { ASSERT(index < m_hashes.size()); return m_hashes[index]; }
+
+    /** Slot index of the member with the hash, or -1 if there is none.
+        If two members have the same hash, the first one is found. */
+    inline int Lookup(uint32_t hash) const
+    {
+        const size_t mask = m_table.size() - 1;
+
+        for (size_t i = hash & mask; m_table[i] != 0; i = (i + 1) & mask) {
+            const uint32_t index = m_table[i] - 1;
+            if (m_hashes[index] == hash) {
+                return (int)index;
+            }
+        }
+
+        return -1;
+    }
+
+private:
+    // hash of the member name in each slot
+    std::vector<uint32_t> m_hashes;
+    // open addressing table of slot index + 1 (0 for an empty entry),
+    // with a power of two size that is at least twice the member count
+    std::vector<uint32_t> m_table;
+};
+
 class TypeInfo {
 public:
     TypeInfo(const char *name, size_t size, char **names);
@@ -20,11 +62,13 @@ public:
     inline char **const GetNames() const { return m_names; }
     inline const char *GetMemberName(size_t index) const
         { ASSERT(index < m_size); return m_names[index]; }
+    inline const ObjectShape &GetShape() const { return m_shape; }
 
 private:
     char *m_name;
     size_t m_size;
     char **m_names;
+    ObjectShape m_shape;
 };
 
 } // namespace vm
@@ -2,6 +2,7 @@
 #define VM_HPP
 
 #include <ace-vm/BytecodeStream.hpp>
+#include <ace-vm/DecodedProgram.hpp>
 #include <ace-vm/VMState.hpp>
 
 #include <array>
@@ -12,16 +13,23 @@
 #define MAIN_THREAD m_threads[0]
 
 #define IS_VALUE_STRING(value, out) \
-    ((value).m_type == Value::HEAP_POINTER && \
-    (out = (value).m_value.ptr->GetPointer<ImmutableString>()))
+    ((value).GetType() == Value::HEAP_POINTER && \
+    (out = (value).GetHeapPointer()->GetPointer<ImmutableString>()))
 
 #define IS_VALUE_ARRAY(value, out) \
-    ((value).m_type == Value::HEAP_POINTER && \
-    (out = (value).m_value.ptr->GetPointer<Array>()))
+    ((value).GetType() == Value::HEAP_POINTER && \
+    (out = (value).GetHeapPointer()->GetPointer<Array>()))
 
 #define MATCH_TYPES(left_type, right_type) \
     ((left_type) < (right_type)) ? (right_type) : (left_type)
 
+// labels as values, used for the threaded dispatch loop
+#if defined(__GNUC__) || defined(__clang__)
+    #define ACE_VM_COMPUTED_GOTO 1
+#else
+    #define ACE_VM_COMPUTED_GOTO 0
+#endif
+
 namespace ace {
 namespace vm {
 
@@ -35,6 +43,14 @@ enum CompareFlags : int {
     // use only the GREATER or EQUAL flags.
 };
 
+enum DispatchMode {
+    // one switch over the opcode for every instruction
+    DISPATCH_SWITCH,
+    // each handler jumps directly to the next handler (computed goto).
+    // falls back to DISPATCH_SWITCH where unsupported.
+    DISPATCH_THREADED,
+};
+
 class VM {
 public:
     VM();
@@ -45,13 +61,24 @@ public:
 
     inline VMState &GetState() { return m_state; }
     inline const VMState &GetState() const { return m_state; }
+    inline DecodedProgram &GetProgram() { return m_program; }
 
     static void Print(const Value &value);
     static void Invoke(InstructionHandler *handler,
         const Value &value,
         uint8_t nargs);
+    /** Calls a function in place of the current one, reusing its frame */
+    static void TailInvoke(InstructionHandler *handler,
+        const Value &value,
+        uint8_t nargs);
+
+    inline DispatchMode GetDispatchMode() const { return m_dispatch_mode; }
+    inline void SetDispatchMode(DispatchMode mode) { m_dispatch_mode = mode; }
 
-    void HandleInstruction(InstructionHandler *handler, uint8_t code);
+    /** Run instructions on the handler's thread until the end of the
+        bytecode is reached, the state is no longer good, or the thread's
+        function depth is back at stop_depth (-1 to never stop on depth). */
+    void Run(InstructionHandler *handler, int stop_depth = -1);
     void Execute(BytecodeStream *bs);
 
     /** Returns -1 on error */
@@ -59,8 +86,8 @@ public:
         Value *lhs,
         Value *rhs)
     {
-        HeapValue *a = lhs->m_value.ptr;
-        HeapValue *b = rhs->m_value.ptr;
+        HeapValue *a = lhs->GetHeapPointer();
+        HeapValue *b = rhs->GetHeapPointer();
 
         if (a == b) {
             // pointers equal, drop out early.
@@ -81,7 +108,7 @@ public:
         Value *lhs,
         Value *rhs)
     {
-        return (lhs->m_value.func.m_addr == rhs->m_value.func.m_addr)
+        return (lhs->GetFunctionAddress() == rhs->GetFunctionAddress())
             ? EQUAL
             : NONE;
     }
@@ -90,13 +117,33 @@ public:
         Value *lhs,
         Value *rhs)
     {
-        return (lhs->m_value.native_func == rhs->m_value.native_func)
+        return (lhs->GetNativeFunction() == rhs->GetNativeFunction())
             ? EQUAL
             : NONE;
     }
 
 private:
+    /** Inserts 'self' before the top nargs values of the stack,
+        for calling the '$invoke' member of an object */
+    static void InsertSelf(ExecutionThread *thread,
+        const Value &self,
+        uint8_t nargs);
+    /** Throws and returns false if a function can't take nargs arguments */
+    static bool CheckArgs(InstructionHandler *handler,
+        const Value &value,
+        uint8_t nargs);
+    /** Gathers the arguments past the function's last parameter into an array */
+    static void PackVariadicArgs(InstructionHandler *handler,
+        const Value &value,
+        uint8_t nargs);
+
+    template <bool Threaded, bool Checked>
+    void DispatchLoop(InstructionHandler *handler, int stop_depth);
+
     VMState m_state;
+    DispatchMode m_dispatch_mode;
+    // the program most recently given to Execute()
+    DecodedProgram m_program;
 };
 
 } // namespace vm
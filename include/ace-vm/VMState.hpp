@@ -4,13 +4,32 @@
 #include <ace-vm/StackMemory.hpp>
 #include <ace-vm/StaticMemory.hpp>
 #include <ace-vm/HeapMemory.hpp>
+#include <ace-vm/MarkStack.hpp>
+#include <ace-vm/GCWorkerPool.hpp>
 #include <ace-vm/Exception.hpp>
 #include <ace-vm/BytecodeStream.hpp>
 
 #include <common/non_owning_ptr.hpp>
 
-#define GC_THRESHOLD_MIN 20
-#define GC_THRESHOLD_MAX 1000
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+// size the young generation may grow to before a minor collection
+#define GC_NURSERY_BYTES (1024 * 1024)
+// the heap may grow to this many bytes before it is first fully collected
+#define GC_MIN_HEAP_BYTES (4 * 1024 * 1024)
+// how far the heap may grow past what was live after a collection
+// before the next one, in percent. 100 lets it double.
+#define GC_DEFAULT_GROWTH 100
+// values scanned or heap cells swept by each step of an incremental
+// collection, if no other budget is given
+#define GC_DEFAULT_STEP_BUDGET 256
 
 #define VM_MAX_THREADS 8
 #define VM_NUM_REGISTERS 8
@@ -42,22 +61,68 @@ struct ExceptionState {
     inline void Reset() { m_try_counter = 0; m_exception_occured = false; }
 };
 
+/** How often member lookups by hash were answered by the
+    instruction's inline cache, for tuning the cache. */
+struct InlineCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+/** Time spent collecting garbage, in seconds */
+struct GCStats {
+    // minor and full collections together
+    uint64_t num_collections = 0;
+    uint64_t num_minor_collections = 0;
+    // steps taken by incremental collections
+    uint64_t num_steps = 0;
+    double mark_time = 0.0;
+    double sweep_time = 0.0;
+    // the longest single collection
+    double max_pause = 0.0;
+};
+
+/** Where an incremental collection is up to */
+enum GCPhase {
+    GC_IDLE,
+    // marking a step at a time. the write barrier
+    // shades values stored into marked ones.
+    GC_MARKING,
+    // sweeping a few pages at a time
+    GC_SWEEPING
+};
+
 struct ExecutionThread {
     friend struct VMState;
 
     Stack m_stack;
+    CallStack m_frames;
     ExceptionState m_exception_state;
     Registers m_regs;
-
-    int m_func_depth = 0;
+    // only written by the thread itself
+    InlineCacheStats m_ic_stats;
 
     inline Stack &GetStack() { return m_stack; }
+    inline CallStack &GetCallStack() { return m_frames; }
+    /** The number of function calls that have not returned yet */
+    inline int GetFuncDepth() const { return (int)m_frames.GetDepth(); }
     inline ExceptionState &GetExceptionState() { return m_exception_state; }
     inline Registers &GetRegisters() { return m_regs; }
     inline int GetId() const { return m_id; }
 
 private:
     int m_id;
+    // the last value allocated by this thread, which has not been
+    // counted towards the size of the heap yet (see HeapAlloc)
+    HeapValue *m_last_alloc = nullptr;
+    // old values this thread has stored young values into
+    std::vector<HeapValue*> m_remembered;
+    // values this thread's write barrier has shaded during incremental
+    // marking, to be handed to the mark stack at the next step
+    std::vector<HeapValue*> m_grey;
+    // values rooted by the handle scopes of native functions
+    std::vector<Value> m_handles;
+
+    friend class sdk::HandleScope;
 };
 
 struct VMState {
@@ -71,8 +136,10 @@ struct VMState {
     non_owning_ptr<VM> m_vm;
 
     bool good = true;
-    bool enable_auto_gc = true;
-    int m_max_heap_objects = GC_THRESHOLD_MIN;
+
+    /** Guards values on the main thread's stack that are accessed by index
+        (LOAD_INDEX / MOV_INDEX) while more than one thread is running. */
+    std::mutex m_globals_mtx;
 
     /** Reset the state of the VM, destroying all heap objects,
         stack objects and exception flags, etc.
@@ -81,20 +148,194 @@ struct VMState {
 
     void ThrowException(ExecutionThread *thread, const Exception &exception);
     HeapValue *HeapAlloc(ExecutionThread *thread);
+    /** Must be called when the storage owned by a value on the heap
+        grows in place (e.g an array being pushed to), so that the size
+        of the heap stays close to what it really is. */
+    void NoteGrowth(ExecutionThread *thread, HeapValue *value, size_t num_bytes);
+    /** Must be called after a value is stored into the object or array
+        `container`, so that a minor collection can find young values that
+        are only referred to by old ones. */
+    inline void WriteBarrier(ExecutionThread *thread, HeapValue *container, const Value &value)
+    {
+        const int flags = container->GetFlags();
+
+        if ((flags & (GC_OLD | GC_REMEMBERED)) == GC_OLD && IsYoungReference(value)) {
+            container->GetFlags() |= GC_REMEMBERED;
+            thread->m_remembered.push_back(container);
+        }
+
+        // the container may have been scanned already, in which case
+        // the marker would not come across the value otherwise
+        if (m_gc_phase == GC_MARKING && (flags & GC_MARKED)) {
+            Shade(thread, value);
+        }
+    }
+    /** The one TypeInfo for a type name and member list, created the first
+        time it is asked for. Interned types are not on the heap, and live
+        until the state is reset. */
+    HeapValue *InternType(const char *name, size_t size, char **names);
+    /** The one string value for a string literal, holding the interned
+        ImmutableString. Like interned types, these are not on the heap,
+        and are freed when the state is reset. */
+    HeapValue *InternString(const char *str, size_t len);
+    /** Runs a full collection */
     void GC();
 
+    /** Must be called by a native thread before it starts dispatching
+        instructions, and after it has finished. Between the two calls,
+        the thread must regularly reach a safepoint by calling Safepoint(). */
+    void BeginExecution();
+    void EndExecution();
+
+    /** Parks the calling thread if a stop-the-world pause (e.g the GC)
+        has been requested by another thread. Only an atomic load when
+        there is nothing to do. */
+    inline void Safepoint()
+    {
+        if (m_stw_requested.load(std::memory_order_acquire)) {
+            ParkAtSafepoint();
+        }
+    }
+
     /** Add a thread */
     ExecutionThread *CreateThread();
     /** Destroy thread with ID */
     void DestroyThread(int id);
     /** Get the number of threads currently in use */
-    inline int GetNumThreads() const { return m_num_threads; }
+    inline int GetNumThreads() const { return m_num_threads.load(std::memory_order_relaxed); }
+
+    /** Inline cache counters of every thread, including finished ones.
+        Should only be called while no thread is running. */
+    InlineCacheStats GetInlineCacheStats() const;
+
+    /** Should only be called while no thread is running. */
+    inline const GCStats &GetGCStats() const { return m_gc_stats; }
+
+    /** Percentage the heap may grow by, over the bytes that were still
+        live after the last collection, before another is started.
+        Should only be called while no thread is running. */
+    void SetGCGrowth(unsigned percent);
+    /** Allocations fail with a heap overflow exception once the heap
+        takes up this many bytes, even after collecting. 0 for no limit.
+        Should only be called while no thread is running. */
+    void SetHeapLimit(size_t num_bytes);
+    /** Full collections are done incrementally, a step on each
+        allocation, with each step scanning or sweeping at most
+        `step_budget` values. 0 collects all at once. Minor collections
+        are unaffected. Should only be called while no thread is running. */
+    void SetIncrementalGC(size_t step_budget);
+    /** Number of threads that full stop-the-world collections mark and
+        sweep with, including the one that started the collection.
+        1 does it all on that thread. Should only be called while no
+        thread is running. */
+    void SetGCWorkers(size_t num_workers);
 
     inline Heap &GetHeap() { return m_heap; }
     inline StaticMemory &GetStaticMemory() { return m_static_memory; }
 
 private:
-    int m_num_threads = 0;
+    std::atomic<int> m_num_threads;
+
+    // inline cache counters of destroyed threads
+    InlineCacheStats m_ic_stats;
+    // updated by Collect()
+    GCStats m_gc_stats;
+
+    unsigned m_gc_growth;
+    size_t m_heap_limit;
+    // heap size in bytes at which the next collection is started
+    size_t m_next_gc_bytes;
+    // remembered values of destroyed threads
+    std::vector<HeapValue*> m_remembered;
+
+    // set when there is more than one gc worker
+    std::unique_ptr<GCWorkerPool> m_gc_workers;
+
+    // incremental collection
+    size_t m_gc_step_budget;
+    GCPhase m_gc_phase;
+    MarkStack m_mark_stack;
+
+    // interned types, keyed by the type name followed by
+    // each member name, all separated by null characters
+    std::unordered_map<std::string, std::unique_ptr<HeapValue>> m_types;
+    std::mutex m_types_mtx;
+
+    // string values for literals, keyed by the literal
+    std::unordered_map<std::string, std::unique_ptr<HeapValue>> m_strings;
+    std::mutex m_strings_mtx;
+
+    // guards the heap and the thread table
+    std::mutex m_heap_mtx;
+
+    // stop-the-world bookkeeping
+    std::mutex m_safepoint_mtx;
+    std::condition_variable m_safepoint_cv;
+    std::atomic<bool> m_stw_requested;
+    // number of threads dispatching instructions that are not parked
+    int m_num_running;
+
+    void ParkAtSafepoint();
+    /** Threads that block while holding no raw heap references
+        (e.g waiting on the heap lock) do so inside a safe region,
+        so they do not hold up a stop-the-world pause. */
+    void EnterSafeRegion();
+    void LeaveSafeRegion();
+    /** Acquires m_heap_mtx without deadlocking against a pending pause. */
+    void LockHeap();
+    /** Waits until every other running thread is parked.
+        Must be called with m_heap_mtx held. */
+    void StopTheWorld();
+    void ResumeTheWorld();
+    /** True if a value could refer to a young heap value. References
+        to other values are counted, as they might be to a member. */
+    static inline bool IsYoungReference(const Value &value)
+    {
+        return (value.GetType() == Value::HEAP_POINTER && value.GetHeapPointer() != nullptr
+            && !(value.GetHeapPointer()->GetFlags() & GC_OLD))
+            || value.GetType() == Value::VALUE_REF;
+    }
+
+    static inline void Shade(ExecutionThread *thread, const Value &value)
+    {
+        if (value.GetType() == Value::VALUE_REF) {
+            Shade(thread, *value.GetValueRef());
+        } else if (value.GetType() == Value::HEAP_POINTER && value.GetHeapPointer() != nullptr
+            && !(value.GetHeapPointer()->GetFlags() & GC_MARKED)) {
+            value.GetHeapPointer()->GetFlags() |= GC_MARKED;
+            thread->m_grey.push_back(value.GetHeapPointer());
+        }
+    }
+
+    /** Mark and sweep, either everything or only the young generation.
+        Must be called with the world stopped. */
+    void Collect(bool full);
+    /** Collect, or start an incremental collection if it is a full one
+        and they are enabled. Must be called with the world stopped. */
+    void StartCollection(bool full);
+    /** Returns false, after throwing an exception on the thread, if
+        the heap is over the limit */
+    bool CheckHeapLimit(ExecutionThread *thread);
+
+    // the steps of an incremental collection,
+    // all called with the world stopped.
+    void BeginIncrementalCollection();
+    void IncrementalStep(size_t budget);
+    /** Rescans the roots, which have no barrier, and finishes marking */
+    void FinishMarking();
+    /** Runs the rest of the collection in one go */
+    void FinishIncrementalCollection();
+    void ShadeRoots();
+    /** Marks everything reachable from the mark stack, including
+        values that were left off it when it overflowed */
+    void DrainMarkStack();
+    /** Moves the values shaded by write barriers onto the mark stack */
+    void TakeGreyValues();
+    void CountPause(double mark_time, double sweep_time);
+    /** Clear the remembered sets, after a collection */
+    void ForgetRemembered();
+    /** Work out m_next_gc_bytes from the current size of the heap */
+    void UpdateGCTrigger();
 };
 
 } // namespace vm
@@ -24,6 +24,8 @@ public:
     virtual void Visit(Jump *);
     virtual void Visit(Comparison *);
     virtual void Visit(FunctionCall *);
+    virtual void Visit(StaticFunctionMarker *);
+    virtual void Visit(StaticFunctionCall *);
     virtual void Visit(Return *);
     virtual void Visit(StoreLocal *);
     virtual void Visit(PopLocal *);
@@ -2,8 +2,11 @@
 #define HASHER_HPP
 
 #include <cstdint>
+#include <cstddef>
 
-inline uint32_t hash_fnv_1(const char *str)
+/** constexpr, so the hashes of names known ahead of time
+    (such as "$invoke") can be computed by the compiler */
+constexpr uint32_t hash_fnv_1(const char *str)
 {
     const uint32_t PRIME = 16777619u;
     const uint32_t OFFSET_BASIS = 2166136261u;
@@ -19,4 +22,21 @@ inline uint32_t hash_fnv_1(const char *str)
     return hash;
 }
 
+/** The same hash, for a string of the given length
+    that is not necessarily null-terminated */
+inline uint32_t hash_fnv_1(const char *str, size_t len)
+{
+    const uint32_t PRIME = 16777619u;
+    const uint32_t OFFSET_BASIS = 2166136261u;
+
+    uint32_t hash = OFFSET_BASIS;
+
+    for (size_t i = 0; i < len; i++) {
+        hash *= PRIME;
+        hash ^= str[i];
+    }
+
+    return hash;
+}
+
 #endif
\ No newline at end of file
@@ -104,6 +104,8 @@ enum FunctionFlags : uint8_t {
 
 // NOTE: instructions that load data from stack index load from the main/global thread.
 // instructions that load from stack offset load from their own thread.
+// instructions that load from a local index load from the current function's
+// frame on their own thread, the index counting from its first argument.
 
 enum Instructions : char {
     /* No operation */
@@ -206,6 +208,20 @@ enum Instructions : char {
 
     /* Signifies the end of the stream */
     EXIT,
+
+    /* Instructions added since. They go after the ones above, so that
+       the opcodes in already compiled bytecode keep their meaning */
+
+    /* Load a local of the current function into a register */
+    LOAD_LOCAL,  // load_local  [% reg, u16 idx]
+    /* Copy register value to a local of the current function */
+    MOV_LOCAL,   // mov_local   [u16 dst, % src]
+    /* Call the function in the register in place of the current one */
+    TAIL_CALL,   // tail_call   [% reg, u8 nargs]
+    /* Call the function at the address, known when compiling */
+    CALL_STATIC, // call_static [@ addr, u8 nargs]
+    /* Call the member with the hash of the first argument ('self') */
+    CALL_METHOD, // call_method [u32 hash, u8 nargs]
 };
 
 #endif
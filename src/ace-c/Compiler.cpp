@@ -67,7 +67,8 @@ std::unique_ptr<Buildable> Compiler::BuildCall(
     AstVisitor *visitor,
     Module *mod,
     const std::shared_ptr<AstExpression> &target,
-    uint8_t nargs)
+    uint8_t nargs,
+    bool is_tail_call)
 {
     std::unique_ptr<BytecodeChunk> chunk = BytecodeUtil::Make<BytecodeChunk>();
 
@@ -77,7 +78,7 @@ std::unique_ptr<Buildable> Compiler::BuildCall(
     uint8_t rp = visitor->GetCompilationUnit()->GetInstructionStream().GetCurrentRegister();
     
     auto instr_call = BytecodeUtil::Make<RawOperation<>>();
-    instr_call->opcode = CALL;
+    instr_call->opcode = is_tail_call ? TAIL_CALL : CALL;
     instr_call->Accept<uint8_t>(rp);
     instr_call->Accept<uint8_t>(nargs);
     chunk->Append(std::move(instr_call));
@@ -166,7 +167,8 @@ std::unique_ptr<Buildable> Compiler::CreateConditional(
             label_id = end_label;
         }
 
-        chunk->Append(BytecodeUtil::Make<Jump>(Jump::JMP, label_id));
+        // skip the block if the condition was false
+        chunk->Append(BytecodeUtil::Make<Jump>(Jump::JE, label_id));
     }
 
     // enter the block
@@ -2,15 +2,19 @@
 #include <ace-c/Compiler.hpp>
 #include <ace-c/AstVisitor.hpp>
 #include <ace-c/ast/AstMember.hpp>
+#include <ace-c/ast/AstVariable.hpp>
+#include <ace-c/ast/AstFunctionExpression.hpp>
 #include <ace-c/SemanticAnalyzer.hpp>
 
 #include <ace-c/type-system/BuiltinTypes.hpp>
 
 #include <ace-c/emit/BytecodeChunk.hpp>
 #include <ace-c/emit/BytecodeUtil.hpp>
+#include <ace-c/emit/StorageOperation.hpp>
 
 #include <common/instructions.hpp>
 #include <common/my_assert.hpp>
+#include <common/hasher.hpp>
 #include <common/utf8.hpp>
 
 #include <limits>
@@ -126,6 +130,25 @@ void AstCallExpression::Visit(AstVisitor *visitor, Module *mod)
         m_return_type = substituted.first;
         // change args to be newly ordered vector
         m_args = substituted.second;
+
+        // a constant that holds a function (such as a function declared
+        // in a module) always calls the same code, so it can be called
+        // without loading it, as long as it takes exactly these arguments
+        if (const AstVariable *target_var = dynamic_cast<AstVariable*>(m_target.get())) {
+            const Identifier *ident = target_var->GetProperties().GetIdentifier();
+
+            if (ident != nullptr &&
+                target_var->GetProperties().GetIdentifierType() == IDENTIFIER_TYPE_VARIABLE &&
+                (ident->GetFlags() & FLAG_CONST) &&
+                !(ident->GetFlags() & (FLAG_ALIAS | FLAG_MIXIN)))
+            {
+                auto func = std::dynamic_pointer_cast<AstFunctionExpression>(ident->GetCurrentValue());
+
+                if (func != nullptr && !func->IsClosure() && func->GetParameters().size() == m_args.size()) {
+                    m_static_target = func;
+                }
+            }
+        }
     }
 }
 
@@ -142,22 +165,107 @@ std::unique_ptr<Buildable> AstCallExpression::Build(AstVisitor *visitor, Module
         m_args//args_sorted
     ));
 
-    chunk->Append(Compiler::BuildCall(
+    const AstMember *target_mem = GetMethodTarget();
+
+    if (m_static_target != nullptr && m_static_target->GetStaticId() != -1) {
+        // jump straight to the function
+        chunk->Append(BytecodeUtil::Make<StaticFunctionCall>(
+            m_static_target->GetStaticId(),
+            (uint8_t)m_args.size()
+        ));
+    } else if (target_mem != nullptr) {
+        // the object is already on the stack as 'self', so the VM
+        // looks up the method on it, instead of building it again
+        auto instr_call_method = BytecodeUtil::Make<RawOperation<>>();
+        instr_call_method->opcode = CALL_METHOD;
+        instr_call_method->Accept<uint32_t>(hash_fnv_1(target_mem->GetFieldName().c_str()));
+        instr_call_method->Accept<uint8_t>((uint8_t)m_args.size());
+        chunk->Append(std::move(instr_call_method));
+    } else {
+        chunk->Append(Compiler::BuildCall(
+            visitor,
+            mod,
+            m_target,
+            (uint8_t)m_args.size()
+        ));
+    }
+
+    chunk->Append(Compiler::BuildArgumentsEnd(
         visitor,
         mod,
-        m_target,
-        (uint8_t)m_args.size()
+        m_args.size()
     ));
 
-    chunk->Append(Compiler::BuildArgumentsEnd(
+    return std::move(chunk);
+}
+
+std::unique_ptr<Buildable> AstCallExpression::BuildTailCall(AstVisitor *visitor, Module *mod)
+{
+    ASSERT(m_target != nullptr);
+
+    std::unique_ptr<BytecodeChunk> chunk = BytecodeUtil::Make<BytecodeChunk>();
+
+    // build arguments
+    chunk->Append(Compiler::BuildArgumentsStart(
         visitor,
         mod,
-        m_args.size()
+        m_args
     ));
 
+    if (const AstMember *target_mem = GetMethodTarget()) {
+        // load the method from 'self', which is already on the
+        // stack, rather than building the object again
+        uint8_t rp = visitor->GetCompilationUnit()->GetInstructionStream().GetCurrentRegister();
+
+        auto instr_load_offset = BytecodeUtil::Make<StorageOperation>();
+        instr_load_offset->GetBuilder().Load(rp).Local().ByOffset(m_args.size());
+        chunk->Append(std::move(instr_load_offset));
+
+        chunk->Append(Compiler::LoadMemberFromHash(
+            visitor,
+            mod,
+            hash_fnv_1(target_mem->GetFieldName().c_str())
+        ));
+
+        auto instr_tail_call = BytecodeUtil::Make<RawOperation<>>();
+        instr_tail_call->opcode = TAIL_CALL;
+        instr_tail_call->Accept<uint8_t>(rp);
+        instr_tail_call->Accept<uint8_t>((uint8_t)m_args.size());
+        chunk->Append(std::move(instr_tail_call));
+    } else {
+        chunk->Append(Compiler::BuildCall(
+            visitor,
+            mod,
+            m_target,
+            (uint8_t)m_args.size(),
+            true
+        ));
+    }
+
+    // the arguments are moved into the reused frame by the VM,
+    // along with the rest of this function's stack, so there is nothing to pop
+    for (size_t i = 0; i < m_args.size(); i++) {
+        visitor->GetCompilationUnit()->GetInstructionStream().DecStackSize();
+    }
+
     return std::move(chunk);
 }
 
+const AstMember *AstCallExpression::GetMethodTarget() const
+{
+    if (!m_is_method_call || m_args.empty()) {
+        return nullptr;
+    }
+
+    const AstMember *target_mem = dynamic_cast<AstMember*>(m_target.get());
+
+    if (target_mem == nullptr || m_args.front()->GetExpr() != target_mem->GetTarget()) {
+        return nullptr;
+    }
+
+    return target_mem;
+}
+
 void AstCallExpression::Optimize(AstVisitor *visitor, Module *mod)
 {
     ASSERT(m_target != nullptr);
@@ -37,7 +37,7 @@ AstFunctionExpression::AstFunctionExpression(
       m_is_closure(false),
       m_is_generator_closure(false),
       m_return_type(BuiltinTypes::ANY),
-      m_static_id(0)
+      m_static_id(-1)
 {
 }
 
@@ -45,6 +45,12 @@ std::unique_ptr<Buildable> AstFunctionExpression::BuildFunctionBody(AstVisitor *
 {
     std::unique_ptr<BytecodeChunk> chunk = BytecodeUtil::Make<BytecodeChunk>();
 
+    InstructionStream &instruction_stream = visitor->GetCompilationUnit()->GetInstructionStream();
+
+    // the frame of the function starts at its first parameter
+    const int frame_base_before = instruction_stream.GetFrameBase();
+    instruction_stream.SetFrameBase(instruction_stream.GetStackSize());
+
     // increase stack size by the number of parameters
     int param_stack_size = 0;
 
@@ -59,9 +65,6 @@ std::unique_ptr<Buildable> AstFunctionExpression::BuildFunctionBody(AstVisitor *
         param_stack_size++;
     }
 
-    // increase stack size for call stack info
-    visitor->GetCompilationUnit()->GetInstructionStream().IncStackSize();
-
     if (m_is_generator) {
         ASSERT(m_generator_closure != nullptr);
         chunk->Append(m_generator_closure->Build(visitor, mod));
@@ -79,11 +82,10 @@ std::unique_ptr<Buildable> AstFunctionExpression::BuildFunctionBody(AstVisitor *
     }
 
     for (int i = 0; i < param_stack_size; i++) {
-        visitor->GetCompilationUnit()->GetInstructionStream().DecStackSize();
+        instruction_stream.DecStackSize();
     }
 
-    // decrease stack size for call stack info
-    visitor->GetCompilationUnit()->GetInstructionStream().DecStackSize();
+    instruction_stream.SetFrameBase(frame_base_before);
 
     return std::move(chunk);
 }
@@ -387,6 +389,12 @@ std::unique_ptr<Buildable> AstFunctionExpression::Build(AstVisitor *visitor, Mod
 
     // store the function address before the function body
     chunk->Append(BytecodeUtil::Make<LabelMarker>(func_addr));
+
+    if (!m_is_closure && !(flags & FunctionFlags::VARIADIC)) {
+        // the function can be called directly, without loading it
+        m_static_id = visitor->GetCompilationUnit()->GetInstructionStream().NewStaticFunctionId();
+        chunk->Append(BytecodeUtil::Make<StaticFunctionMarker>(m_static_id));
+    }
     
     // TODO add optimization to avoid duplicating the function body
     // Build the function 
@@ -1,4 +1,5 @@
 #include <ace-c/ast/AstReturnStatement.hpp>
+#include <ace-c/ast/AstCallExpression.hpp>
 #include <ace-c/Optimizer.hpp>
 #include <ace-c/AstVisitor.hpp>
 #include <ace-c/Compiler.hpp>
@@ -15,7 +16,8 @@ AstReturnStatement::AstReturnStatement(const std::shared_ptr<AstExpression> &exp
     const SourceLocation &location)
     : AstStatement(location),
       m_expr(expr),
-      m_num_pops(0)
+      m_num_pops(0),
+      m_is_tail_call(false)
 {
 }
 
@@ -26,6 +28,7 @@ void AstReturnStatement::Visit(AstVisitor *visitor, Module *mod)
 
     // transverse the scope tree to make sure we are in a function
     bool in_function = false;
+    bool in_try = false;
 
     TreeNode<Scope> *top = mod->m_scopes.TopNode();
     while (top != nullptr) {
@@ -34,12 +37,22 @@ void AstReturnStatement::Visit(AstVisitor *visitor, Module *mod)
             break;
         }
 
+        if (top->m_value.GetScopeType() == SCOPE_TYPE_TRY) {
+            in_try = true;
+        }
+
         m_num_pops += top->m_value.GetIdentifierTable().CountUsedVariables();
         top = top->m_parent;
     }
 
     if (in_function) {
         ASSERT(top != nullptr);
+
+        // returning the result of a call can reuse this function's frame,
+        // unless an exception from the call could be caught in this function
+        m_is_tail_call = !in_try &&
+            dynamic_cast<AstCallExpression*>(m_expr.get()) != nullptr;
+
         // add return type
         top->m_value.AddReturnType(m_expr->GetSymbolType(), m_location);
     } else {
@@ -57,6 +70,13 @@ std::unique_ptr<Buildable> AstReturnStatement::Build(AstVisitor *visitor, Module
     std::unique_ptr<BytecodeChunk> chunk = BytecodeUtil::Make<BytecodeChunk>();
 
     ASSERT(m_expr != nullptr);
+
+    if (m_is_tail_call) {
+        // the callee returns to our caller by itself
+        chunk->Append(static_cast<AstCallExpression*>(m_expr.get())->BuildTailCall(visitor, mod));
+        return std::move(chunk);
+    }
+
     chunk->Append(m_expr->Build(visitor, mod));
 
     chunk->Append(Compiler::PopStack(visitor, m_num_pops));
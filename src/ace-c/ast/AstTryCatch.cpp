@@ -3,6 +3,7 @@
 #include <ace-c/Compiler.hpp>
 #include <ace-c/Keywords.hpp>
 #include <ace-c/Configuration.hpp>
+#include <ace-c/Module.hpp>
 
 #include <ace-c/emit/BytecodeChunk.hpp>
 #include <ace-c/emit/BytecodeUtil.hpp>
@@ -21,8 +22,11 @@ AstTryCatch::AstTryCatch(const std::shared_ptr<AstBlock> &try_block,
 
 void AstTryCatch::Visit(AstVisitor *visitor, Module *mod)
 {
-    // accept the try block
+    // accept the try block. its scope lets statements
+    // inside know that an exception may be caught here.
+    mod->m_scopes.Open(Scope(SCOPE_TYPE_TRY, 0));
     m_try_block->Visit(visitor, mod);
+    mod->m_scopes.Close();
     // accept the catch block
     m_catch_block->Visit(visitor, mod);
 }
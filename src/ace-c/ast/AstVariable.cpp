@@ -176,24 +176,28 @@ std::unique_ptr<Buildable> AstVariable::Build(AstVisitor *visitor, Module *mod)
             // reset access mode
             m_inline_value->SetAccessMode(current_access_mode);
         } else {
-            int stack_size = visitor->GetCompilationUnit()->GetInstructionStream().GetStackSize();
             int stack_location = m_properties.GetIdentifier()->GetStackLocation();
-            int offset = stack_size - stack_location;
 
             // get active register
             uint8_t rp = visitor->GetCompilationUnit()->GetInstructionStream().GetCurrentRegister();
 
             if (m_properties.GetIdentifier()->GetFlags() & FLAG_DECLARED_IN_FUNCTION) {
+                // locals are addressed from the start of the function's
+                // frame, so the index does not depend on what has been
+                // pushed since the variable was declared
+                int frame_index = stack_location
+                    - visitor->GetCompilationUnit()->GetInstructionStream().GetFrameBase();
+
                 if (m_access_mode == ACCESS_MODE_LOAD) {
-                    // load stack value at offset value into register
-                    auto instr_load_offset = BytecodeUtil::Make<StorageOperation>();
-                    instr_load_offset->GetBuilder().Load(rp).Local().ByOffset(offset);
-                    chunk->Append(std::move(instr_load_offset));
+                    // load stack value at the frame index into register
+                    auto instr_load_local = BytecodeUtil::Make<StorageOperation>();
+                    instr_load_local->GetBuilder().Load(rp).Local().ByFrameIndex(frame_index);
+                    chunk->Append(std::move(instr_load_local));
                 } else if (m_access_mode == ACCESS_MODE_STORE) {
                     // store the value at (rp - 1) into this local variable
-                    auto instr_mov_index = BytecodeUtil::Make<StorageOperation>();
-                    instr_mov_index->GetBuilder().Store(rp - 1).Local().ByOffset(offset);
-                    chunk->Append(std::move(instr_mov_index));
+                    auto instr_mov_local = BytecodeUtil::Make<StorageOperation>();
+                    instr_mov_local->GetBuilder().Store(rp - 1).Local().ByFrameIndex(frame_index);
+                    chunk->Append(std::move(instr_mov_local));
                 }
             } else {
                 // load globally, rather than from offset.
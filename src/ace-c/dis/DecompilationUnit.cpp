@@ -240,6 +240,25 @@ void DecompilationUnit::DecodeNext(
 
         break;
     }
+    case LOAD_LOCAL:
+    {
+        uint8_t reg;
+        bs.Read(&reg);
+
+        uint16_t idx;
+        bs.Read(&idx);
+
+        if (os != nullptr) {
+            (*os)
+                << "load_local ["
+                    << "%" << (int)reg << ", "
+                    "$(bp+" << idx << ")"
+                << "]"
+                << std::endl;
+        }
+
+        break;
+    }
     case LOAD_STATIC:
     {
         uint8_t reg;
@@ -565,6 +584,25 @@ void DecompilationUnit::DecodeNext(
 
         break;
     }
+    case MOV_LOCAL:
+    {
+        uint16_t dst;
+        bs.Read(&dst);
+
+        uint8_t src;
+        bs.Read(&src);
+
+        if (os != nullptr) {
+            (*os)
+                << "mov_local ["
+                    << "$(bp+" << dst << "), "
+                    << "%" << (int)src
+                << "]"
+                << std::endl;
+        }
+
+        break;
+    }
     case MOV_MEM:
     {
         uint8_t reg;
@@ -854,6 +892,63 @@ void DecompilationUnit::DecodeNext(
 
         break;
     }
+    case CALL_STATIC:
+    {
+        uint32_t addr;
+        bs.Read(&addr);
+
+        uint8_t argc;
+        bs.Read(&argc);
+
+        if (os != nullptr) {
+            (*os)
+                << "call_static ["
+                    << "@(" << std::hex << addr << std::dec << "), "
+                    << "u8(" << (int)argc << ")"
+                << "]"
+                << std::endl;
+        }
+
+        break;
+    }
+    case CALL_METHOD:
+    {
+        uint32_t hash;
+        bs.Read(&hash);
+
+        uint8_t argc;
+        bs.Read(&argc);
+
+        if (os != nullptr) {
+            (*os)
+                << "call_method ["
+                    << "u32(" << hash << "), "
+                    << "u8(" << (int)argc << ")"
+                << "]"
+                << std::endl;
+        }
+
+        break;
+    }
+    case TAIL_CALL:
+    {
+        uint8_t func;
+        bs.Read(&func);
+
+        uint8_t argc;
+        bs.Read(&argc);
+
+        if (os != nullptr) {
+            (*os)
+                << "tail_call ["
+                    << "%" << (int)func << ", "
+                    << "u8(" << (int)argc << ")"
+                << "]"
+                << std::endl;
+        }
+
+        break;
+    }
     case RET:
     {
         if (os != nullptr) {
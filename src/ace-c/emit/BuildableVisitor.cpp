@@ -12,6 +12,10 @@ void BuildableVisitor::Visit(Buildable *buildable)
         Visit(node);
     } else if (auto *node = dynamic_cast<FunctionCall*>(buildable)) {
         Visit(node);
+    } else if (auto *node = dynamic_cast<StaticFunctionMarker*>(buildable)) {
+        Visit(node);
+    } else if (auto *node = dynamic_cast<StaticFunctionCall*>(buildable)) {
+        Visit(node);
     } else if (auto *node = dynamic_cast<Return*>(buildable)) {
         Visit(node);
     } else if (auto *node = dynamic_cast<StoreLocal*>(buildable)) {
@@ -13,7 +13,9 @@ InstructionStream::InstructionStream()
     : //m_position(0),
       m_register_counter(0),
       m_stack_size(0),
-      m_static_id(0)
+      m_frame_base(0),
+      m_static_id(0),
+      m_static_function_id(0)
 {
 }
 
@@ -22,7 +24,9 @@ InstructionStream::InstructionStream(const InstructionStream &other)
       //m_data(other.m_data),
       m_register_counter(other.m_register_counter),
       m_stack_size(other.m_stack_size),
+      m_frame_base(other.m_frame_base),
       m_static_id(other.m_static_id),
+      m_static_function_id(other.m_static_function_id),
       m_static_objects(other.m_static_objects)
 {
 }
@@ -30,6 +30,21 @@ void StorageOperation::StrategyBuilder::ByOffset(int offset)
     }
 }
 
+void StorageOperation::StrategyBuilder::ByFrameIndex(int index)
+{
+    op->strategy = strategy = Strategies::BY_FRAME_INDEX;
+
+    switch (parent->method) {
+        case Methods::ARRAY:
+        case Methods::MEMBER:
+            ASSERT_MSG(false, "Not implemented");
+            break;
+        default:
+            op->op.b.index = index;
+            break;
+    }
+}
+
 void StorageOperation::StrategyBuilder::ByHash(int hash)
 {
     op->strategy = strategy = Strategies::BY_HASH;
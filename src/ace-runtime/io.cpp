@@ -117,8 +117,8 @@ ACE_FUNCTION(io_open) {
     vm::ExecutionThread *thread = params.handler->thread;
     vm::VMState *state = params.handler->state;
 
-    vm::Value *arg0 = params.args[0];
-    vm::Value *arg1 = params.args[1];
+    vm::Value *arg0 = &params.args[0];
+    vm::Value *arg1 = &params.args[1];
     ASSERT(arg0 != nullptr);
     ASSERT(arg1 != nullptr);
 
@@ -131,11 +131,11 @@ ACE_FUNCTION(io_open) {
         state->ThrowException(thread, e);
         return;
     }
-    if (arg0->GetValue().ptr == nullptr) {
+    if (arg0->GetHeapPointer() == nullptr) {
         state->ThrowException(thread, vm::Exception::NullReferenceException());
         return;
     }
-    if ((path_ptr = arg0->GetValue().ptr->GetPointer<vm::ImmutableString>()) == nullptr) {
+    if ((path_ptr = arg0->GetHeapPointer()->GetPointer<vm::ImmutableString>()) == nullptr) {
         state->ThrowException(thread, e);
         return;
     }
@@ -144,11 +144,11 @@ ACE_FUNCTION(io_open) {
         state->ThrowException(thread, e);
         return;
     }
-    if (arg1->GetValue().ptr == nullptr) {
+    if (arg1->GetHeapPointer() == nullptr) {
         state->ThrowException(thread, vm::Exception::NullReferenceException());
         return;
     }
-    if ((mode_ptr = arg1->GetValue().ptr->GetPointer<vm::ImmutableString>()) == nullptr) {
+    if ((mode_ptr = arg1->GetHeapPointer()->GetPointer<vm::ImmutableString>()) == nullptr) {
         state->ThrowException(thread, e);
         return;
     }
@@ -175,8 +175,7 @@ ACE_FUNCTION(io_open) {
         ptr->Assign(file);
 
         vm::Value res;
-        res.m_type = vm::Value::HEAP_POINTER;
-        res.m_value.ptr = ptr;
+        res.SetHeapPointer(ptr);
 
         ACE_RETURN(res);
     }
@@ -190,7 +189,7 @@ ACE_FUNCTION(io_write) {
     vm::VMState *state = params.handler->state;
 
     // first, read the file object (first argument)
-    vm::Value *arg0 = params.args[0];
+    vm::Value *arg0 = &params.args[0];
     ASSERT(arg0 != nullptr);
 
     vm::Exception e("write() expects arguments of type File and Any...");
@@ -201,11 +200,11 @@ ACE_FUNCTION(io_write) {
         state->ThrowException(thread, e);
         return;
     }
-    if (arg0->GetValue().ptr == nullptr) {
+    if (arg0->GetHeapPointer() == nullptr) {
         state->ThrowException(thread, vm::Exception::NullReferenceException());
         return;
     }
-    if ((file_ptr = arg0->GetValue().ptr->GetPointer<io::File>()) == nullptr) {
+    if ((file_ptr = arg0->GetHeapPointer()->GetPointer<io::File>()) == nullptr) {
         state->ThrowException(thread, e);
         return;
     }
@@ -216,9 +215,8 @@ ACE_FUNCTION(io_write) {
     } else {
         // convert each arg to string
         for (int i = 1; i < params.nargs; i++) {
-            ASSERT(params.args[i] != nullptr);
             // write to file
-            file_ptr->Write(params.args[i]->ToString());
+            file_ptr->Write(params.args[i].ToString());
         }
 
         // after writing, flush file buffer
@@ -234,7 +232,7 @@ ACE_FUNCTION(io_close) {
     vm::VMState *state = params.handler->state;
 
     // first, read the file object (first argument)
-    vm::Value *arg0 = params.args[0];
+    vm::Value *arg0 = &params.args[0];
     ASSERT(arg0 != nullptr);
 
     vm::Exception e("close() expects argument of type File");
@@ -245,11 +243,11 @@ ACE_FUNCTION(io_close) {
         state->ThrowException(thread, e);
         return;
     }
-    if (arg0->GetValue().ptr == nullptr) {
+    if (arg0->GetHeapPointer() == nullptr) {
         state->ThrowException(thread,vm::Exception::NullReferenceException());
         return;
     }
-    if ((file_ptr = arg0->GetValue().ptr->GetPointer<io::File>()) == nullptr) {
+    if ((file_ptr = arg0->GetHeapPointer()->GetPointer<io::File>()) == nullptr) {
         state->ThrowException(thread, e);
         return;
     }
@@ -281,8 +279,7 @@ ACE_FUNCTION(io_get_stdout) {
     ptr->Assign(file);
 
     vm::Value res;
-    res.m_type = vm::Value::HEAP_POINTER;
-    res.m_value.ptr = ptr;
+    res.SetHeapPointer(ptr);
 
     ACE_RETURN(res);
 }
\ No newline at end of file
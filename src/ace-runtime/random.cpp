@@ -14,7 +14,7 @@ ACE_FUNCTION(random_new_random)
 {
     ACE_CHECK_ARGS(==, 1);
 
-    const vm::Value *target_ptr = params.args[0];
+    const vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
     ace::aint64 seed;
@@ -29,8 +29,7 @@ ACE_FUNCTION(random_new_random)
 
         // assign register value to the allocated object
         vm::Value res;
-        res.m_type = vm::Value::HEAP_POINTER;
-        res.m_value.ptr = ptr;
+        res.SetHeapPointer(ptr);
 
         ACE_RETURN(res);
     } else {
@@ -45,16 +44,19 @@ ACE_FUNCTION(random_get_next)
 {
     ACE_CHECK_ARGS(==, 1);
 
-    const vm::Value *target_ptr = params.args[0];
+    const vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
-    if (std::mt19937_64 *gen_ptr = target_ptr->GetValue().ptr->GetPointer<std::mt19937_64>()) {
+    if (std::mt19937_64 *gen_ptr = target_ptr->GetHeapPointer()->GetPointer<std::mt19937_64>()) {
         ace::aint64 value = (*gen_ptr)();
+#ifdef ACE_NAN_BOXING
+        // keep as many bits as a value can hold
+        value = (ace::aint64)((uint64_t)value << 16) >> 16;
+#endif
 
         // assign register value to the generated value
         vm::Value res;
-        res.m_type = vm::Value::ValueType::I64;
-        res.m_value.i64 = value;
+        res.SetI64(value);
 
         ACE_RETURN(res);
     } else {
@@ -73,8 +75,7 @@ ACE_FUNCTION(random_crand)
 
     // assign register value to the generated value
     vm::Value res;
-    res.m_type = vm::Value::ValueType::I32;
-    res.m_value.i32 = value;
+    res.SetI32(value);
 
     ACE_RETURN(res);
 }
\ No newline at end of file
@@ -22,8 +22,12 @@ ACE_FUNCTION(stopwatch_start)
     if (std::int64_t now = stopwatch.Start()) {
         // return the timestamp
         vm::Value res;
-        res.m_type = vm::Value::ValueType::I64;
-        res.m_value.i64 = now;
+        if (vm::Value::FitsI64(now)) {
+            res.SetI64(now);
+        } else {
+            // too big for a NaN-boxed Int64
+            res.SetF64((double)now);
+        }
         ACE_RETURN(res);
     } else {
         params.handler->state->ThrowException(
@@ -41,7 +45,6 @@ ACE_FUNCTION(stopwatch_stop)
 
     // return the elapsed time
     vm::Value res;
-    res.m_type = vm::Value::ValueType::F64;
-    res.m_value.d = elapsed;
+    res.SetF64(elapsed);
     ACE_RETURN(res);
 }
\ No newline at end of file
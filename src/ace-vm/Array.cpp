@@ -4,7 +4,6 @@
 
 #include <cmath>
 #include <cstring>
-#include <sstream>
 
 namespace ace {
 namespace vm {
@@ -71,7 +70,7 @@ void Array::Push(const Value &value)
 {
     size_t index = m_size;
     if (index >= m_capacity) {
-        Resize((unsigned int)std::ceil(std::log(m_size + 1) / std::log(2.0)));
+        Resize(1 << (unsigned int)std::ceil(std::log(m_size + 1) / std::log(2.0)));
     }
     // set item at index
     m_buffer[index] = value;
@@ -94,45 +93,28 @@ void Array::PushMany(size_t n, Value *values)
     m_size += n;
 }
 
-void Array::PushMany(size_t n, Value **values)
-{
-    size_t index = m_size;
-    if (index + n - 1 >= m_capacity) {
-        // delete and copy all over again
-        Resize(1 << (unsigned int)std::ceil(std::log(m_size + n) / std::log(2.0)));
-    }
-
-    for (size_t i = 0; i < n; i++) {
-        ASSERT(values[i] != nullptr);
-        // set item at index
-        m_buffer[index + i] = *values[i];
-    }
-
-    m_size += n;
-}
-
 void Array::Pop()
 {
     m_size--;
 }
 
-void Array::GetRepresentation(std::stringstream &ss, bool add_type_name) const
+void Array::GetRepresentation(StringBuilder &out, bool add_type_name) const
 {
     // convert array list to string
     const char sep_str[3] = ", ";
 
-    ss << '[';
+    out.Append('[');
 
     // convert all array elements to string
     for (size_t i = 0; i < m_size; i++) {
-        m_buffer[i].ToRepresentation(ss, add_type_name);
+        m_buffer[i].ToRepresentation(out, add_type_name);
 
         if (i != m_size - 1) {
-            ss << sep_str;
+            out.Append(sep_str, sizeof(sep_str) - 1);
         }
     }
 
-    ss << ']';
+    out.Append(']');
 }
 
 } // namespace vm
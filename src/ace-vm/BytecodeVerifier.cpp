@@ -0,0 +1,365 @@
+#include <ace-vm/BytecodeVerifier.hpp>
+#include <ace-vm/VMState.hpp>
+#include <ace-vm/StackMemory.hpp>
+#include <ace-vm/StaticMemory.hpp>
+
+#include <common/instructions.hpp>
+#include <common/my_assert.hpp>
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+namespace ace {
+namespace vm {
+
+BytecodeVerifier::BytecodeVerifier(const DecodedProgram *program)
+    : m_program(program),
+      m_max_stack_height(0)
+{
+    ASSERT(m_program != nullptr);
+}
+
+bool BytecodeVerifier::Error(uint32_t index, const char *fmt, ...)
+{
+    char buffer[256];
+
+    int len = std::snprintf(buffer, sizeof(buffer), "0x%x: ",
+        (unsigned)m_program->OffsetOf(index));
+
+    va_list args;
+    va_start(args, fmt);
+    std::vsnprintf(buffer + len, sizeof(buffer) - len, fmt, args);
+    va_end(args);
+
+    m_error_message = buffer;
+
+    return false;
+}
+
+bool BytecodeVerifier::CheckRegister(uint32_t index, uint8_t reg)
+{
+    if (reg >= VM_NUM_REGISTERS) {
+        return Error(index, "register %%%d out of range", (int)reg);
+    }
+
+    return true;
+}
+
+bool BytecodeVerifier::CheckFunctionAddress(uint32_t index, bc_address_t addr)
+{
+    const uint32_t target = m_program->IndexOf(addr);
+
+    if (!m_program->IsInstructionStart(addr) || target == m_program->Size() - 1) {
+        return Error(index, "function address 0x%x is not the start of an instruction", (unsigned)addr);
+    }
+
+    return true;
+}
+
+bool BytecodeVerifier::CheckOperands(uint32_t index)
+{
+    const DecodedInstruction &ins = m_program->GetInstructions()[index];
+
+    switch (ins.opcode) {
+        case STORE_STATIC_STRING:
+        case STORE_STATIC_TYPE:
+        case POP:
+        case POP_N:
+        case ECHO_NEWLINE:
+        case RET:
+        case END_TRY:
+        case EXIT:
+            return true;
+
+        case STORE_STATIC_ADDRESS:
+            if (!m_program->IsInstructionStart(ins.u32)) {
+                return Error(index, "address 0x%x is not the start of an instruction", (unsigned)ins.u32);
+            }
+            return true;
+        case STORE_STATIC_FUNCTION:
+            return CheckFunctionAddress(index, ins.u32);
+        case CALL_STATIC:
+            return CheckFunctionAddress(index, ins.imm.addr);
+        case CALL_METHOD:
+            if (ins.a == 0) {
+                return Error(index, "method call without a receiver");
+            }
+            return true;
+
+        case LOAD_STATIC:
+            if (ins.u32 >= StaticMemory::static_size) {
+                return Error(index, "static index %u out of range", (unsigned)ins.u32);
+            }
+            return CheckRegister(index, ins.a);
+        case LOAD_INDEX:
+        case MOV_INDEX:
+            if (ins.u32 >= Stack::STACK_SIZE) {
+                return Error(index, "stack index %u out of range", (unsigned)ins.u32);
+            }
+            return CheckRegister(index, ins.a);
+        case LOAD_ADDR:
+            if (!m_program->IsInstructionStart(ins.u32)) {
+                return Error(index, "address 0x%x is not the start of an instruction", (unsigned)ins.u32);
+            }
+            return CheckRegister(index, ins.a);
+        case LOAD_FUNC:
+            return CheckFunctionAddress(index, ins.u32)
+                && CheckRegister(index, ins.a);
+
+        case LOAD_I32:
+        case LOAD_I64:
+        case LOAD_F32:
+        case LOAD_F64:
+        case LOAD_OFFSET:
+        case LOAD_LOCAL:
+        case LOAD_STRING:
+        case LOAD_TYPE:
+        case LOAD_NULL:
+        case LOAD_TRUE:
+        case LOAD_FALSE:
+        case MOV_OFFSET:
+        case MOV_LOCAL:
+        case PUSH:
+        case ECHO:
+        case CALL:
+        case TAIL_CALL:
+        case NEW_ARRAY:
+        case CMPZ:
+        case NEG:
+            return CheckRegister(index, ins.a);
+
+        case LOAD_MEM:
+        case LOAD_MEM_HASH:
+        case LOAD_REF:
+        case LOAD_DEREF:
+        case MOV_MEM_HASH:
+        case MOV_ARRAYIDX:
+        case MOV_REG:
+        case HAS_MEM_HASH:
+        case PUSH_ARRAY:
+        case NEW:
+        case CMP:
+            return CheckRegister(index, ins.a)
+                && CheckRegister(index, ins.b);
+
+        case MOV_MEM:
+            return CheckRegister(index, ins.a)
+                && CheckRegister(index, ins.c);
+
+        case LOAD_ARRAYIDX:
+        case ADD:
+        case SUB:
+        case MUL:
+        case DIV:
+        case MOD:
+        case AND:
+        case OR:
+        case XOR:
+        case SHL:
+        case SHR:
+            return CheckRegister(index, ins.a)
+                && CheckRegister(index, ins.b)
+                && CheckRegister(index, ins.c);
+
+        case JMP:
+        case JE:
+        case JNE:
+        case JG:
+        case JGE:
+        case BEGIN_TRY:
+            if (!m_program->IsInstructionStart(ins.imm.addr)) {
+                return Error(index, "jump address 0x%x is not the start of an instruction", (unsigned)ins.imm.addr);
+            }
+            return true;
+
+        default:
+            return Error(index, "unknown instruction %d", (int)ins.opcode);
+    }
+}
+
+bool BytecodeVerifier::Enter(uint32_t index, const BlockState &state, uint32_t from)
+{
+    BlockState &existing = m_states[index];
+
+    if (existing.height < 0) {
+        existing = state;
+        m_worklist.push_back(index);
+
+        m_max_stack_height = std::max(m_max_stack_height, (size_t)state.height);
+    } else if (existing.height != state.height || existing.frame_size != state.frame_size) {
+        return Error(from, "stack height %d does not match height %d at jump target",
+            state.height, existing.height);
+    }
+
+    return true;
+}
+
+bool BytecodeVerifier::CheckStack()
+{
+    const DecodedInstruction *instructions = m_program->GetInstructions();
+    const uint32_t size = (uint32_t)m_program->Size();
+
+    m_states.assign(size, BlockState { -1, 0 });
+    m_worklist.clear();
+
+    // the start of the program, and the start of each function
+    if (!Enter(0, BlockState { 0, 0 }, 0)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < size; i++) {
+        const DecodedInstruction &ins = instructions[i];
+
+        uint8_t nargs;
+        uint32_t target;
+        if (ins.opcode == LOAD_FUNC) {
+            nargs = ins.b;
+            target = m_program->IndexOf(ins.u32);
+        } else if (ins.opcode == STORE_STATIC_FUNCTION) {
+            nargs = ins.a;
+            target = m_program->IndexOf(ins.u32);
+        } else if (ins.opcode == CALL_STATIC) {
+            // the call is not checked at runtime, so it has to
+            // pass the same number of arguments the function takes
+            nargs = ins.a;
+            target = ins.u32;
+        } else {
+            continue;
+        }
+
+        // the frame starts with the arguments, followed by the locals.
+        // variadic functions get their extra arguments as one array,
+        // so there are always nargs of them.
+        if (!Enter(target, BlockState { 0, nargs }, i)) {
+            return false;
+        }
+    }
+
+    while (!m_worklist.empty()) {
+        const uint32_t index = m_worklist.back();
+        m_worklist.pop_back();
+
+        const DecodedInstruction &ins = instructions[index];
+        BlockState state = m_states[index];
+
+        switch (ins.opcode) {
+            case LOAD_OFFSET:
+            case MOV_OFFSET:
+                if (ins.u32 == 0 || (int)ins.u32 > state.height + state.frame_size) {
+                    return Error(index, "stack offset %u out of range", (unsigned)ins.u32);
+                }
+                break;
+            case LOAD_LOCAL:
+            case MOV_LOCAL:
+                if ((int)ins.u32 >= state.height + state.frame_size) {
+                    return Error(index, "local index %u out of range", (unsigned)ins.u32);
+                }
+                break;
+            case PUSH:
+                state.height++;
+                break;
+            case POP:
+            case END_TRY:
+                state.height--;
+                break;
+            case POP_N:
+                state.height -= ins.a;
+                break;
+            case BEGIN_TRY:
+                // the catch block starts after the try info has been popped
+                if (!Enter(ins.u32, state, index)) {
+                    return false;
+                }
+                state.height++;
+                break;
+            case RET:
+                if (state.height != 0) {
+                    return Error(index, "stack height is %d at return", state.height);
+                }
+                continue;
+            case CALL_METHOD:
+                // the receiver is read from the stack, as the first argument
+                if (state.height < ins.a) {
+                    return Error(index, "stack underflow");
+                }
+                break;
+            case TAIL_CALL:
+                // the callee takes over the frame, and whatever
+                // is left on the stack of this one is discarded
+                if (state.height < ins.b) {
+                    return Error(index, "stack underflow");
+                }
+                continue;
+            case EXIT:
+                continue;
+            default:
+                break;
+        }
+
+        if (state.height < 0) {
+            return Error(index, "stack underflow");
+        }
+
+        switch (ins.opcode) {
+            case JMP:
+                if (!Enter(ins.u32, state, index)) {
+                    return false;
+                }
+                continue;
+            case JE:
+            case JNE:
+            case JG:
+            case JGE:
+                if (!Enter(ins.u32, state, index)) {
+                    return false;
+                }
+                break;
+            default:
+                break;
+        }
+
+        // the final instruction is always EXIT, so
+        // falling through never goes out of the program
+        if (!Enter(index + 1, state, index)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool BytecodeVerifier::Verify()
+{
+    m_error_message.clear();
+    m_max_stack_height = 0;
+
+    const uint32_t size = (uint32_t)m_program->Size();
+    ASSERT(size > 0);
+
+    size_t num_statics = 0;
+
+    for (uint32_t i = 0; i < size; i++) {
+        if (!CheckOperands(i)) {
+            return false;
+        }
+
+        switch (m_program->GetInstructions()[i].opcode) {
+            case STORE_STATIC_STRING:
+            case STORE_STATIC_ADDRESS:
+            case STORE_STATIC_FUNCTION:
+            case STORE_STATIC_TYPE:
+                if (++num_statics > StaticMemory::static_size) {
+                    return Error(i, "not enough static memory");
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    return CheckStack();
+}
+
+} // namespace vm
+} // namespace ace
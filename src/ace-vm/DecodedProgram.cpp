@@ -0,0 +1,327 @@
+#include <ace-vm/DecodedProgram.hpp>
+
+#include <common/instructions.hpp>
+
+#include <cstring>
+#include <limits>
+
+namespace ace {
+namespace vm {
+
+DecodedProgram::DecodedProgram()
+    : m_exit_index(0),
+      m_verified(false),
+      m_max_stack_height(0)
+{
+}
+
+const char *DecodedProgram::ReadString(BytecodeStream &bs, size_t len)
+{
+    char *data = new char[len + 1];
+    bs.Read(data, len);
+    data[len] = '\0';
+
+    m_strings.emplace_back(data);
+
+    return data;
+}
+
+void DecodedProgram::DecodeType(BytecodeStream &bs, DecodedInstruction &ins)
+{
+    std::unique_ptr<DecodedType> type(new DecodedType);
+
+    bs.Read(&type->name_len);
+    type->name = ReadString(bs, type->name_len);
+
+    // number of members
+    bs.Read(&type->size);
+    type->names.reserve(type->size);
+
+    // load each name
+    for (size_t i = 0; i < type->size; i++) {
+        uint16_t length; bs.Read(&length);
+
+        type->names.push_back(const_cast<char*>(
+            ReadString(bs, length)
+        ));
+    }
+
+    ins.imm.type = type.get();
+    m_types.push_back(std::move(type));
+}
+
+void DecodedProgram::DecodeString(BytecodeStream &bs, DecodedInstruction &ins)
+{
+    bs.Read(&ins.u32);
+
+    std::unique_ptr<DecodedString> string(new DecodedString);
+    string->data = ReadString(bs, ins.u32);
+    string->len = ins.u32;
+
+    ins.imm.string = string.get();
+    m_decoded_strings.push_back(std::move(string));
+}
+
+void DecodedProgram::ForgetInterned()
+{
+    for (auto &type : m_types) {
+        type->interned.store(nullptr, std::memory_order_relaxed);
+    }
+    for (auto &string : m_decoded_strings) {
+        string->interned.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+void DecodedProgram::Decode(const BytecodeStream &bs_in)
+{
+    m_instructions.clear();
+    m_offsets.clear();
+    m_strings.clear();
+    m_decoded_strings.clear();
+    m_types.clear();
+    m_functions.clear();
+    m_verified = false;
+    m_max_stack_height = 0;
+
+    // start reading from the beginning of the buffer, no matter
+    // where the stream given to us is positioned
+    BytecodeStream bs(bs_in.GetBuffer(), bs_in.Size());
+
+    m_indices.assign(bs.Size() + 1, std::numeric_limits<uint32_t>::max());
+
+    bool unknown = false;
+
+    while (!bs.Eof() && !unknown) {
+        const bc_address_t offset = (bc_address_t)bs.Position();
+
+        uint8_t code; bs.Read(&code);
+
+        DecodedInstruction ins;
+        std::memset(&ins, 0, sizeof(ins));
+        ins.opcode = code;
+
+        switch (code) {
+            case STORE_STATIC_STRING:
+                bs.Read(&ins.u32);
+                ins.imm.str = ReadString(bs, ins.u32);
+                break;
+            case STORE_STATIC_ADDRESS:
+                bs.Read(&ins.u32);
+                break;
+            case STORE_STATIC_FUNCTION:
+                bs.Read(&ins.u32);
+                bs.Read(&ins.a);
+                bs.Read(&ins.b);
+                break;
+            case STORE_STATIC_TYPE:
+                DecodeType(bs, ins);
+                ASSERT(ins.imm.type->size > 0);
+                break;
+            case LOAD_I32:
+                bs.Read(&ins.a);
+                bs.Read(&ins.imm.i32);
+                break;
+            case LOAD_I64:
+                bs.Read(&ins.a);
+                bs.Read(&ins.imm.i64);
+                break;
+            case LOAD_F32:
+                bs.Read(&ins.a);
+                bs.Read(&ins.imm.f32);
+                break;
+            case LOAD_F64:
+                bs.Read(&ins.a);
+                bs.Read(&ins.imm.f64);
+                break;
+            case LOAD_OFFSET:
+            case LOAD_INDEX:
+            case LOAD_LOCAL:
+            case LOAD_STATIC: {
+                uint16_t u16;
+                bs.Read(&ins.a);
+                bs.Read(&u16);
+                ins.u32 = u16;
+                break;
+            }
+            case LOAD_STRING:
+                bs.Read(&ins.a);
+                DecodeString(bs, ins);
+                break;
+            case LOAD_ADDR:
+                bs.Read(&ins.a);
+                bs.Read(&ins.u32);
+                break;
+            case LOAD_FUNC:
+                bs.Read(&ins.a);
+                bs.Read(&ins.u32);
+                bs.Read(&ins.b);
+                bs.Read(&ins.c);
+                break;
+            case LOAD_TYPE:
+                bs.Read(&ins.a);
+                DecodeType(bs, ins);
+                break;
+            case LOAD_MEM:
+            case LOAD_ARRAYIDX:
+            case MOV_MEM:
+            case ADD:
+            case SUB:
+            case MUL:
+            case DIV:
+            case MOD:
+            case AND:
+            case OR:
+            case XOR:
+            case SHL:
+            case SHR:
+                bs.Read(&ins.a);
+                bs.Read(&ins.b);
+                bs.Read(&ins.c);
+                break;
+            case LOAD_MEM_HASH:
+            case HAS_MEM_HASH:
+                bs.Read(&ins.a);
+                bs.Read(&ins.b);
+                bs.Read(&ins.u32);
+                break;
+            case LOAD_REF:
+            case LOAD_DEREF:
+            case MOV_REG:
+            case PUSH_ARRAY:
+            case CALL:
+            case TAIL_CALL:
+            case NEW:
+            case CMP:
+                bs.Read(&ins.a);
+                bs.Read(&ins.b);
+                break;
+            case LOAD_NULL:
+            case LOAD_TRUE:
+            case LOAD_FALSE:
+            case PUSH:
+            case POP_N:
+            case ECHO:
+            case CMPZ:
+            case NEG:
+                bs.Read(&ins.a);
+                break;
+            case MOV_OFFSET:
+            case MOV_INDEX:
+            case MOV_LOCAL: {
+                uint16_t u16;
+                bs.Read(&u16);
+                bs.Read(&ins.a);
+                ins.u32 = u16;
+                break;
+            }
+            case MOV_MEM_HASH:
+            case MOV_ARRAYIDX:
+                bs.Read(&ins.a);
+                bs.Read(&ins.u32);
+                bs.Read(&ins.b);
+                break;
+            case JMP:
+            case JE:
+            case JNE:
+            case JG:
+            case JGE:
+            case BEGIN_TRY:
+                // resolved to an instruction index below
+                bs.Read(&ins.u32);
+                break;
+            case CALL_STATIC:
+                // resolved to an instruction index below
+                bs.Read(&ins.u32);
+                bs.Read(&ins.a);
+                break;
+            case CALL_METHOD:
+                bs.Read(&ins.u32);
+                bs.Read(&ins.a);
+                break;
+            case NEW_ARRAY:
+                bs.Read(&ins.a);
+                bs.Read(&ins.u32);
+                break;
+            case POP:
+            case ECHO_NEWLINE:
+            case RET:
+            case END_TRY:
+                break;
+            default:
+                // the length of an unknown instruction cannot be known,
+                // so nothing after it can be decoded. keep the offset so
+                // the error can be reported if it is ever reached.
+                ins.u32 = offset;
+                unknown = true;
+                break;
+        }
+
+        m_indices[offset] = (uint32_t)m_instructions.size();
+        m_offsets.push_back(offset);
+        m_instructions.push_back(ins);
+    }
+
+    // mark the end of the program, so the interpreter
+    // does not have to check for it after each instruction
+    DecodedInstruction exit_ins;
+    std::memset(&exit_ins, 0, sizeof(exit_ins));
+    exit_ins.opcode = EXIT;
+
+    m_exit_index = (uint32_t)m_instructions.size();
+    m_indices[bs.Size()] = m_exit_index;
+    m_offsets.push_back((bc_address_t)bs.Size());
+    m_instructions.push_back(exit_ins);
+
+    for (uint32_t &index : m_indices) {
+        if (index == std::numeric_limits<uint32_t>::max()) {
+            index = m_exit_index;
+        }
+    }
+
+    size_t num_inline_caches = 0;
+
+    for (const DecodedInstruction &ins : m_instructions) {
+        if (ins.opcode == LOAD_MEM_HASH || ins.opcode == MOV_MEM_HASH ||
+            ins.opcode == HAS_MEM_HASH || ins.opcode == CALL_METHOD) {
+            num_inline_caches++;
+        }
+    }
+
+    // value-initialized, so every cache starts out empty
+    m_inline_caches.reset(new InlineCache[num_inline_caches]());
+    num_inline_caches = 0;
+
+    // resolve jump targets, give out inline caches and
+    // remember the functions that are declared
+    for (DecodedInstruction &ins : m_instructions) {
+        switch (ins.opcode) {
+            case LOAD_FUNC:
+                m_functions[IndexOf(ins.u32)] = DecodedFunction { ins.b, ins.c };
+                break;
+            case STORE_STATIC_FUNCTION:
+                m_functions[IndexOf(ins.u32)] = DecodedFunction { ins.a, ins.b };
+                break;
+            case JMP:
+            case JE:
+            case JNE:
+            case JG:
+            case JGE:
+            case BEGIN_TRY:
+            case CALL_STATIC:
+                ins.imm.addr = ins.u32;
+                ins.u32 = IndexOf(ins.u32);
+                break;
+            case LOAD_MEM_HASH:
+            case MOV_MEM_HASH:
+            case HAS_MEM_HASH:
+            case CALL_METHOD:
+                ins.imm.cache = &m_inline_caches[num_inline_caches++];
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+} // namespace vm
+} // namespace ace
@@ -93,11 +93,21 @@ Exception Exception::DivisionByZeroException()
     return Exception("Division by zero");
 }
 
+Exception Exception::IntegerOverflowException()
+{
+    return Exception("Integer overflow");
+}
+
 Exception Exception::OutOfBoundsException()
 {
     return Exception("Index out of bounds of Array");
 }
 
+Exception Exception::StackOverflowException()
+{
+    return Exception("Stack overflow");
+}
+
 Exception Exception::MemberNotFoundException()
 {
     return Exception("Member not found");
@@ -0,0 +1,81 @@
+#include <ace-vm/GCWorkerPool.hpp>
+
+#include <common/my_assert.hpp>
+
+namespace ace {
+namespace vm {
+
+GCWorkerPool::GCWorkerPool(size_t num_workers)
+    : m_task(nullptr),
+      m_generation(0),
+      m_num_running(0),
+      m_stop(false)
+{
+    ASSERT(num_workers > 0);
+
+    for (size_t i = 1; i < num_workers; i++) {
+        m_threads.emplace_back(&GCWorkerPool::WorkerMain, this, i);
+    }
+}
+
+GCWorkerPool::~GCWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_stop = true;
+    }
+    m_start_cv.notify_all();
+
+    for (std::thread &thread : m_threads) {
+        thread.join();
+    }
+}
+
+void GCWorkerPool::Run(const std::function<void(size_t)> &task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_task = &task;
+        m_num_running = m_threads.size();
+        m_generation++;
+    }
+    m_start_cv.notify_all();
+
+    task(0);
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_done_cv.wait(lock, [this] { return m_num_running == 0; });
+    m_task = nullptr;
+}
+
+void GCWorkerPool::WorkerMain(size_t index)
+{
+    uint64_t generation = 0;
+
+    for (;;) {
+        const std::function<void(size_t)> *task;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_start_cv.wait(lock, [this, generation] { return m_stop || m_generation != generation; });
+
+            if (m_stop) {
+                return;
+            }
+
+            generation = m_generation;
+            task = m_task;
+        }
+
+        (*task)(index);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_num_running--;
+        }
+        m_done_cv.notify_one();
+    }
+}
+
+} // namespace vm
+} // namespace ace
@@ -0,0 +1,38 @@
+#include <ace-sdk/ace-sdk.hpp>
+#include <ace-vm/InstructionHandler.hpp>
+#include <ace-vm/VMState.hpp>
+
+namespace ace {
+namespace sdk {
+
+HandleScope::HandleScope(const Params &params)
+    : HandleScope(params.handler->thread)
+{
+}
+
+HandleScope::HandleScope(vm::ExecutionThread *thread)
+    : m_thread(thread),
+      m_base(thread->m_handles.size())
+{
+}
+
+HandleScope::~HandleScope()
+{
+    m_thread->m_handles.resize(m_base);
+}
+
+void HandleScope::Add(const vm::Value &value)
+{
+    m_thread->m_handles.push_back(value);
+}
+
+void HandleScope::Add(vm::HeapValue *ptr)
+{
+    vm::Value value;
+    value.SetHeapPointer(ptr);
+
+    m_thread->m_handles.push_back(value);
+}
+
+} // namespace sdk
+} // namespace ace
@@ -10,6 +10,10 @@
 #include <iomanip>
 #include <bitset>
 #include <sstream>
+#include <atomic>
+#include <vector>
+#include <cstring>
+#include <new>
 
 namespace ace {
 namespace vm {
@@ -24,69 +28,96 @@ std::ostream &operator<<(std::ostream &os, const Heap &heap)
     os << std::setw(16) << "Value";
     os << std::endl;
 
-    HeapNode *tmp_head = heap.m_head;
-    while (tmp_head != nullptr) {
-        os << std::setw(16) << (void*)tmp_head->value.GetId() << "| ";
-        os << std::setw(8) << std::bitset<sizeof(tmp_head->value.GetFlags())>(tmp_head->value.GetFlags()) << "| ";
-        os << std::setw(10);
-
-        {
-            union {
-                ImmutableString *str_ptr;
-                Array *array_ptr;
-                Object *obj_ptr;
-                TypeInfo *type_info_ptr;
-            } data;
+    for (HeapPage *page = heap.m_pages; page != nullptr; page = page->next) {
+        for (size_t i = 0; i < page->bump; i++) {
+            if (!page->live[i]) {
+                continue;
+            }
+
+            HeapValue &value = page->cells[i].value;
+
+            os << std::setw(16) << (void*)value.GetId() << "| ";
+            os << std::setw(8) << std::bitset<sizeof(value.GetFlags())>(value.GetFlags()) << "| ";
+            os << std::setw(10);
+
+            {
+                union {
+                    ImmutableString *str_ptr;
+                    Array *array_ptr;
+                    Object *obj_ptr;
+                    TypeInfo *type_info_ptr;
+                } data;
             
-            if (!tmp_head->value.GetId()) {
-                os << "NullType" << "| ";
+                if (!value.GetId()) {
+                    os << "NullType" << "| ";
 
-                os << std::setw(16);
-                os << "null";
-            } else if ((data.str_ptr = tmp_head->value.GetPointer<ImmutableString>()) != nullptr) {
-                os << "String" << "| ";
+                    os << std::setw(16);
+                    os << "null";
+                } else if ((data.str_ptr = value.GetPointer<ImmutableString>()) != nullptr) {
+                    os << "String" << "| ";
 
-                os << "\"" << data.str_ptr->GetData() << "\"" << std::setw(16);
-            } else if ((data.array_ptr = tmp_head->value.GetPointer<Array>()) != nullptr) {
-                os << "Array" << "| ";
+                    os << "\"" << data.str_ptr->GetData() << "\"" << std::setw(16);
+                } else if ((data.array_ptr = value.GetPointer<Array>()) != nullptr) {
+                    os << "Array" << "| ";
 
-                os << std::setw(16);
+                    os << std::setw(16);
                 
-                std::stringstream ss;
-                data.array_ptr->GetRepresentation(ss, false);
-                os << ss.rdbuf();
-            } else if ((data.obj_ptr = tmp_head->value.GetPointer<Object>()) != nullptr) {
-                ASSERT(data.obj_ptr->GetTypePtr() != nullptr);
-                os << data.obj_ptr->GetTypePtr()->GetName() << "| ";
-
-                os << std::setw(16);
-                std::stringstream ss;
-                data.obj_ptr->GetRepresentation(ss, false);
-                os << ss.rdbuf();
-            } else if ((data.type_info_ptr = tmp_head->value.GetPointer<TypeInfo>()) != nullptr) {
-                os << "TypeInfo" << "| ";
-
-                os << std::setw(16);
-                os << " ";
-            } else {
-                os << "Pointer" << "| ";
-
-                os << std::setw(16);
-                os << " ";
-            }
-        }
+                    StringBuilder sb;
+                    data.array_ptr->GetRepresentation(sb, false);
+                    os << sb.Finish().GetData();
+                } else if ((data.obj_ptr = value.GetPointer<Object>()) != nullptr) {
+                    ASSERT(data.obj_ptr->GetTypePtr() != nullptr);
+                    os << data.obj_ptr->GetTypePtr()->GetName() << "| ";
+
+                    os << std::setw(16);
+                    StringBuilder sb;
+                    data.obj_ptr->GetRepresentation(sb, false);
+                    os << sb.Finish().GetData();
+                } else if ((data.type_info_ptr = value.GetPointer<TypeInfo>()) != nullptr) {
+                    os << "TypeInfo" << "| ";
 
-        os << std::endl;
+                    os << std::setw(16);
+                    os << " ";
+                } else {
+                    os << "Pointer" << "| ";
 
-        tmp_head = tmp_head->before;
+                    os << std::setw(16);
+                    os << " ";
+                }
+            }
+
+            os << std::endl;
+        }
     }
 
     return os;
 }
 
+HeapPage::HeapPage()
+    : free_list(nullptr),
+      bump(0),
+      num_live(0),
+      next(nullptr),
+      next_available(nullptr),
+      next_nursery(nullptr),
+      in_nursery(false),
+      sweep_pending(false)
+{
+    std::memset(live, 0, sizeof(live));
+}
+
 Heap::Heap()
-    : m_head(nullptr),
-      m_num_objects(0)
+    : m_pages(nullptr),
+      m_available(nullptr),
+      m_nursery(nullptr),
+      m_num_objects(0),
+      m_num_pages(0),
+      m_old_bytes(0),
+      m_young_bytes(0),
+      m_sweeping(false),
+      m_sweep_link(nullptr),
+      m_sweep_bytes(0),
+      m_kept_empty_page(false)
 {
 }
 
@@ -99,73 +130,311 @@ Heap::~Heap()
 void Heap::Purge()
 {
     // clean up all allocated objects
-    while (m_head) {
-        HeapNode *tmp = m_head;
-        m_head = tmp->before;
-        delete tmp;
+    while (m_pages) {
+        HeapPage *page = m_pages;
+        m_pages = page->next;
 
-        m_num_objects--;
+        for (size_t i = 0; i < page->bump; i++) {
+            if (page->live[i]) {
+                page->cells[i].value.~HeapValue();
+                m_num_objects--;
+            }
+        }
+
+        delete page;
     }
+
+    m_available = nullptr;
+    m_nursery = nullptr;
+    m_num_pages = 0;
+    m_old_bytes = 0;
+    m_young_bytes = 0;
+    m_sweeping = false;
+    m_sweep_link = nullptr;
+}
+
+HeapPage *Heap::AddPage()
+{
+    HeapPage *page = new HeapPage();
+
+    page->next = m_pages;
+    m_pages = page;
+    m_num_pages++;
+
+    return page;
 }
 
 HeapValue *Heap::Alloc()
 {
-    HeapNode *node = new HeapNode;
+    HeapPage *page = m_available;
+
+    for (;;) {
+        // skip over pages that have filled up
+        while (page != nullptr && page->free_list == nullptr && page->bump == HEAP_PAGE_NUM_CELLS) {
+            page = page->next_available;
+        }
 
-    node->after = nullptr;
-    
-    if (m_head != nullptr) {
-        m_head->after = node;
+        if (page != nullptr || !m_sweeping) {
+            break;
+        }
+
+        // sweep until a page with room turns up
+        m_available = nullptr;
+        SweepStep(1);
+        page = m_available;
     }
-    
-    node->before = m_head;
-    m_head = node;
 
+    if (page == nullptr) {
+        page = AddPage();
+    }
+
+    m_available = page;
+
+    if (!page->in_nursery) {
+        page->in_nursery = true;
+        page->next_nursery = m_nursery;
+        m_nursery = page;
+    }
+
+    HeapCell *cell;
+
+    if (page->free_list != nullptr) {
+        // reuse a cell freed by the last sweep
+        cell = page->free_list;
+        page->free_list = cell->next_free;
+    } else {
+        // take the next never-used cell
+        cell = &page->cells[page->bump++];
+    }
+
+    page->live[cell - page->cells] = 1;
+    page->num_live++;
     m_num_objects++;
+    m_young_bytes += sizeof(HeapCell);
 
-    return &m_head->value;
+    return new (&cell->value) HeapValue();
 }
 
-void Heap::Sweep()
+size_t Heap::SweepPage(HeapPage *page, bool young_only)
 {
-    HeapNode *last = m_head;
-    while (last) {
-        if (!(last->value.GetFlags() & GC_MARKED)) {
+    size_t num_bytes = 0;
+
+    page->free_list = nullptr;
+
+    // go backwards, so the free list ends up in address order
+    for (size_t i = page->bump; i-- > 0;) {
+        HeapCell &cell = page->cells[i];
+
+        if (page->live[i]) {
+            int &flags = cell.value.GetFlags();
+
+            if (flags & GC_MARKED) {
+                // the object survived, so it is old now.
+                // unmark it for the next time.
+                flags = (flags & ~(GC_MARKED | GC_REMEMBERED)) | GC_OLD;
+                num_bytes += sizeof(HeapCell) + cell.value.GetSize();
+                continue;
+            }
+
+            if (young_only && (flags & GC_OLD)) {
+                // not looked at by a minor collection
+                continue;
+            }
+
             // unmarked object, so delete it
+            cell.value.~HeapValue();
+            page->live[i] = 0;
+            page->num_live--;
+        }
+
+        cell.next_free = page->free_list;
+        page->free_list = &cell;
+    }
+
+    if (page->num_live == 0) {
+        // start over from the beginning of the page
+        page->free_list = nullptr;
+        page->bump = 0;
+    }
+
+    return num_bytes;
+}
+
+void Heap::UpdateAvailable()
+{
+    HeapPage **available_tail = &m_available;
+
+    for (HeapPage *page = m_pages; page != nullptr; page = page->next) {
+        page->next_available = nullptr;
+
+        if (page->free_list != nullptr || page->bump < HEAP_PAGE_NUM_CELLS) {
+            *available_tail = page;
+            available_tail = &page->next_available;
+        }
+    }
+
+    *available_tail = nullptr;
+}
+
+void Heap::Sweep(GCWorkerPool *workers)
+{
+    HeapPage **link = &m_pages;
+    bool kept_empty_page = false;
+
+    m_old_bytes = 0;
+    m_young_bytes = 0;
+    m_num_objects = 0;
 
-            HeapNode *after = last->after;
-            HeapNode *before = last->before;
+    const bool parallel = workers != nullptr && workers->GetNumWorkers() > 1;
 
-            if (before) {
-                before->after = after;
+    if (parallel) {
+        // pages are independent of each other, so they are
+        // handed out to the workers one at a time
+        std::vector<HeapPage*> pages;
+        pages.reserve(m_num_pages);
+        for (HeapPage *page = m_pages; page != nullptr; page = page->next) {
+            pages.push_back(page);
+        }
+
+        std::atomic<size_t> next_page(0);
+        std::vector<size_t> num_bytes(workers->GetNumWorkers(), 0);
+
+        workers->Run([&](size_t index) {
+            size_t i;
+            while ((i = next_page.fetch_add(1, std::memory_order_relaxed)) < pages.size()) {
+                num_bytes[index] += SweepPage(pages[i], false);
             }
+        });
 
-            if (after) {
-                // removing an item from the middle, so
-                // make the nodes to the other sides now
-                // point to each other
-                after->before = before;
-            } else {
-                // since there are no nodes after this,
-                // set the head to be this node here
-                m_head = before;
+        for (size_t n : num_bytes) {
+            m_old_bytes += n;
+        }
+    }
+
+    while (HeapPage *page = *link) {
+        if (!parallel) {
+            m_old_bytes += SweepPage(page, false);
+        }
+
+        page->in_nursery = false;
+        page->next_nursery = nullptr;
+
+        if (page->num_live == 0) {
+            // hold on to one empty page, so a heap that
+            // is emptied and refilled does not churn pages
+            if (kept_empty_page) {
+                *link = page->next;
+                delete page;
+                m_num_pages--;
+                continue;
             }
 
-            // delete the middle node
-            delete last;
-            last = before;
+            kept_empty_page = true;
+        }
+
+        m_num_objects += page->num_live;
+        link = &page->next;
+    }
+
+    m_nursery = nullptr;
+
+    UpdateAvailable();
+}
+
+void Heap::SweepYoung()
+{
+    while (HeapPage *page = m_nursery) {
+        m_nursery = page->next_nursery;
+
+        // everything left over on the page is old now
+        const size_t num_live = page->num_live;
+        m_old_bytes += SweepPage(page, true);
+        m_num_objects -= num_live - page->num_live;
+
+        page->in_nursery = false;
+        page->next_nursery = nullptr;
+    }
 
-            // decrement number of currently allocated
-            // objects
-            m_num_objects--;
+    m_young_bytes = 0;
 
-        } else {
-            // the object is currently marked, so
-            // we unmark it for the next time
-            last->value.GetFlags() &= ~GC_MARKED;
-            last = last->before;
+    // pages are only given back by a full sweep
+    UpdateAvailable();
+}
+
+void Heap::BeginSweep()
+{
+    ASSERT(!m_sweeping);
+
+    for (HeapPage *page = m_pages; page != nullptr; page = page->next) {
+        page->sweep_pending = true;
+        page->in_nursery = false;
+        page->next_nursery = nullptr;
+    }
+
+    // everything that survives is promoted. until the sweep is done,
+    // count all of it as old.
+    m_nursery = nullptr;
+    m_old_bytes += m_young_bytes;
+    m_young_bytes = 0;
+
+    // pages become available again as they are swept
+    m_available = nullptr;
+
+    m_sweeping = true;
+    m_sweep_link = &m_pages;
+    m_sweep_bytes = 0;
+    m_kept_empty_page = false;
+}
+
+bool Heap::SweepStep(size_t budget)
+{
+    ASSERT(m_sweeping);
+
+    size_t num_cells = 0;
+
+    while (num_cells < budget) {
+        HeapPage *page = *m_sweep_link;
+
+        if (page == nullptr) {
+            m_sweeping = false;
+            m_sweep_link = nullptr;
+            m_old_bytes = m_sweep_bytes;
+            return true;
+        }
+
+        if (!page->sweep_pending) {
+            // added since the sweep started
+            m_sweep_link = &page->next;
+            continue;
         }
+
+        page->sweep_pending = false;
+        num_cells += HEAP_PAGE_NUM_CELLS;
+
+        const size_t num_live = page->num_live;
+        m_sweep_bytes += SweepPage(page, false);
+        m_num_objects -= num_live - page->num_live;
+
+        if (page->num_live == 0) {
+            if (m_kept_empty_page) {
+                *m_sweep_link = page->next;
+                delete page;
+                m_num_pages--;
+                continue;
+            }
+
+            m_kept_empty_page = true;
+        }
+
+        if (page->free_list != nullptr || page->bump < HEAP_PAGE_NUM_CELLS) {
+            page->next_available = m_available;
+            m_available = page;
+        }
+
+        m_sweep_link = &page->next;
     }
+
+    return false;
 }
 
 } // namespace vm
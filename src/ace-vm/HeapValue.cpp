@@ -1,21 +1,105 @@
 #include <ace-vm/HeapValue.hpp>
 
+#include <atomic>
+
 namespace ace {
 namespace vm {
 
 HeapValue::HeapValue()
-    : m_holder(nullptr),
-      m_ptr(nullptr),
+    : m_type(HEAP_NULL),
       m_flags(0)
 {
 }
 
 HeapValue::~HeapValue()
 {
-    if (m_holder) {
-        delete m_holder;
+    Destroy();
+}
+
+void HeapValue::Destroy()
+{
+    switch (m_type) {
+        case HEAP_NULL:
+            return;
+        case HEAP_STRING:
+            GetRawPointer<ImmutableString>()->~ImmutableString();
+            break;
+        case HEAP_ARRAY:
+            GetRawPointer<Array>()->~Array();
+            break;
+        case HEAP_OBJECT:
+            GetRawPointer<Object>()->~Object();
+            break;
+        case HEAP_TYPE_INFO:
+            delete GetRawPointer<TypeInfo>();
+            break;
+        case HEAP_NATIVE:
+            delete GetBoxed().holder;
+            break;
+    }
+
+    m_type = HEAP_NULL;
+}
+
+bool HeapValue::operator==(const HeapValue &other) const
+{
+    if (this == &other) {
+        return true;
     }
+
+    if (m_type != other.m_type) {
+        return false;
+    }
+
+    HeapValue &a = const_cast<HeapValue&>(*this);
+    HeapValue &b = const_cast<HeapValue&>(other);
+
+    switch (m_type) {
+        case HEAP_NULL:
+            return true;
+        case HEAP_STRING:
+            return *a.GetRawPointer<ImmutableString>() == *b.GetRawPointer<ImmutableString>();
+        case HEAP_ARRAY:
+            return *a.GetRawPointer<Array>() == *b.GetRawPointer<Array>();
+        case HEAP_OBJECT:
+            return *a.GetRawPointer<Object>() == *b.GetRawPointer<Object>();
+        case HEAP_TYPE_INFO:
+            return *a.GetRawPointer<TypeInfo>() == *b.GetRawPointer<TypeInfo>();
+        case HEAP_NATIVE:
+            return *GetBoxed().holder == *other.GetBoxed().holder;
+    }
+
+    return false;
+}
+
+size_t HeapValue::GetSize() const
+{
+    HeapValue &self = const_cast<HeapValue&>(*this);
+
+    switch (m_type) {
+        case HEAP_STRING: {
+            // interned strings are not owned by any one value
+            const ImmutableString *str = self.GetRawPointer<ImmutableString>();
+            return str->IsInterned() ? 0 : str->GetLength() + 1;
+        }
+        case HEAP_ARRAY:
+            return self.GetRawPointer<Array>()->GetCapacity() * sizeof(Value);
+        case HEAP_OBJECT:
+            return self.GetRawPointer<Object>()->GetTypePtr()->GetSize() * sizeof(Value);
+        case HEAP_TYPE_INFO:
+            return sizeof(TypeInfo);
+        case HEAP_NATIVE:
+            return GetBoxed().holder->GetSize();
+        default:
+            return 0;
+    }
+}
+
+uint32_t HeapValue::RegisterNativeType()
+{
+    static std::atomic<uint32_t> next_id { 0 };
+    return next_id++;
 }
 
 } // namespace vm
-} // namespace ace
\ No newline at end of file
+} // namespace ace
@@ -1,34 +1,158 @@
 #include <ace-vm/ImmutableString.hpp>
 
+#include <common/hasher.hpp>
+
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
 namespace ace {
 namespace vm {
-  
-ImmutableString::ImmutableString(const char *str)
+
+namespace {
+
+// interned strings by hash. created on first use, as strings
+// may be interned while static objects are being constructed.
+struct InternTable {
+    std::unordered_multimap<uint32_t, void*> strings;
+    std::mutex mtx;
+};
+
+InternTable &GetInternTable()
+{
+    static InternTable *table = new InternTable();
+    return *table;
+}
+
+} // namespace
+
+ImmutableString::Data *ImmutableString::AllocData(size_t len)
+{
+    void *mem = std::malloc(sizeof(Data) + len);
+    if (mem == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    Data *data = new (mem) Data;
+
+    data->refs.store(1, std::memory_order_relaxed);
+    data->hash = 0;
+    data->length = len;
+    data->interned = false;
+    data->chars[len] = '\0';
+
+    return data;
+}
+
+ImmutableString::Data *ImmutableString::CreateData(const char *str, size_t len)
+{
+    Data *data = AllocData(len);
+
+    std::memcpy(data->chars, str, len);
+    data->hash = hash_fnv_1(data->chars, len);
+
+    return data;
+}
+
+char *ImmutableString::ResizeBuffer(char *chars, size_t capacity)
+{
+    char *block = chars != nullptr ? chars - offsetof(Data, chars) : nullptr;
+
+    block = static_cast<char*>(std::realloc(block, sizeof(Data) + capacity));
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    return block + offsetof(Data, chars);
+}
+
+void ImmutableString::FreeBuffer(char *chars)
+{
+    if (chars != nullptr) {
+        std::free(chars - offsetof(Data, chars));
+    }
+}
+
+ImmutableString ImmutableString::FromBuffer(char *chars, size_t len)
+{
+    // give back the room that was not used
+    chars = ResizeBuffer(chars, len);
+
+    Data *data = new (chars - offsetof(Data, chars)) Data;
+    data->refs.store(1, std::memory_order_relaxed);
+    data->length = len;
+    data->interned = false;
+    data->chars[len] = '\0';
+    data->hash = hash_fnv_1(data->chars, len);
+
+    return ImmutableString(data);
+}
+
+ImmutableString ImmutableString::Intern(const char *str, size_t len)
 {
-    size_t len = std::strlen(str);
-    m_length = len;
+    const uint32_t hash = hash_fnv_1(str, len);
 
-    m_data = new char[len + 1];
-    std::strcpy(m_data, str);
+    InternTable &table = GetInternTable();
+    std::lock_guard<std::mutex> lock(table.mtx);
+
+    auto range = table.strings.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        Data *data = static_cast<Data*>(it->second);
+        if (data->length == len && !std::memcmp(data->chars, str, len)) {
+            return ImmutableString(data);
+        }
+    }
+
+    Data *data = CreateData(str, len);
+    data->interned = true;
+    table.strings.emplace(hash, data);
+
+    return ImmutableString(data);
 }
-  
+
+ImmutableString::ImmutableString(Data *data)
+    : m_data(data)
+{
+}
+
+ImmutableString::ImmutableString(const char *str)
+    : ImmutableString(str, std::strlen(str))
+{
+}
+
 ImmutableString::ImmutableString(const char *str, size_t len)
+    : m_data(CreateData(str, len))
 {
-    m_length = len;
-    m_data = new char[len + 1];
-    std::strcpy(m_data, str);
 }
 
 ImmutableString::ImmutableString(const ImmutableString &other)
+    : m_data(other.m_data)
 {
-    m_length = other.m_length;
-    m_data = new char[m_length + 1];
-    std::strcpy(m_data, other.m_data);
+    Retain();
 }
 
 ImmutableString::~ImmutableString()
 {
-    delete[] m_data;
+    Release();
+}
+
+ImmutableString &ImmutableString::operator=(const ImmutableString &other)
+{
+    other.Retain();
+    Release();
+    m_data = other.m_data;
+
+    return *this;
+}
+
+void ImmutableString::Release()
+{
+    if (!m_data->interned && m_data->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_data->~Data();
+        std::free(m_data);
+    }
 }
 
 ImmutableString ImmutableString::Concat(const ImmutableString &a, const ImmutableString &b)
@@ -36,18 +160,15 @@ ImmutableString ImmutableString::Concat(const ImmutableString &a, const Immutabl
     const size_t a_len = a.GetLength();
     const size_t b_len = b.GetLength();
 
-    const size_t len = a_len + b_len;
-    char *str = new char[len + 1];
-
-    std::memcpy(str, a.GetData(), a_len);
-    std::memcpy(&str[a_len], b.GetData(), b_len);
-
-    ImmutableString res(str, len);
+    // build the result in place, rather than copying it twice
+    Data *data = AllocData(a_len + b_len);
 
-    delete[] str;
+    std::memcpy(data->chars, a.GetData(), a_len);
+    std::memcpy(&data->chars[a_len], b.GetData(), b_len);
+    data->hash = hash_fnv_1(data->chars, data->length);
 
-    return res;
+    return ImmutableString(data);
 }
 
 } // namespace vm
-} // namespace ace
\ No newline at end of file
+} // namespace ace
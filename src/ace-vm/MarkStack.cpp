@@ -0,0 +1,38 @@
+#include <ace-vm/MarkStack.hpp>
+
+namespace ace {
+namespace vm {
+
+MarkStack::MarkStack(size_t max_size)
+    : m_max_size(max_size),
+      m_skip_flags(GC_MARKED),
+      m_overflowed(false)
+{
+}
+
+size_t MarkStack::Drain(size_t budget)
+{
+    size_t num_scanned = 0;
+
+    while (num_scanned < budget && !m_values.empty()) {
+        HeapValue *ptr = m_values.back();
+        m_values.pop_back();
+
+#ifdef __GNUC__
+        // the value below is most likely the next one scanned,
+        // so start loading it while this one is looked at
+        if (!m_values.empty()) {
+            __builtin_prefetch(m_values.back());
+        }
+#endif
+
+        ScanReferences(ptr);
+
+        num_scanned++;
+    }
+
+    return num_scanned;
+}
+
+} // namespace vm
+} // namespace ace
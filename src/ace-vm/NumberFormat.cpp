@@ -0,0 +1,162 @@
+#include <ace-vm/NumberFormat.hpp>
+
+#include <cereal/external/rapidjson/internal/itoa.h>
+#include <cereal/external/rapidjson/internal/dtoa.h>
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace ace {
+namespace vm {
+
+// significant digits written for a double, as with "%g"
+static const int PRECISION = 6;
+
+size_t FormatI32(int32_t value, char *buf)
+{
+    return rapidjson::internal::i32toa(value, buf) - buf;
+}
+
+size_t FormatI64(int64_t value, char *buf)
+{
+    return rapidjson::internal::i64toa(value, buf) - buf;
+}
+
+static size_t FormatF64Slow(double value, char *buf)
+{
+    char tmp[NUMBER_FORMAT_MAX + 1];
+    const int n = std::snprintf(tmp, sizeof(tmp), "%g", value);
+    if (n <= 0) {
+        return 0;
+    }
+
+    std::memcpy(buf, tmp, n);
+
+    return n;
+}
+
+size_t FormatF64(double value, char *buf)
+{
+    if (!std::isfinite(value)) {
+        // spelled however the C library spells them
+        return FormatF64Slow(value, buf);
+    }
+
+    if (value != 0.0 && std::fabs(value) < DBL_MIN) {
+        // subnormals have too few bits for the shortest
+        // digits to be the first six digits of the value
+        return FormatF64Slow(value, buf);
+    }
+
+    char *p = buf;
+
+    if (std::signbit(value)) {
+        *p++ = '-';
+    }
+
+    if (value == 0.0) {
+        *p++ = '0';
+        return p - buf;
+    }
+
+    // the shortest digits that read back as the same double,
+    // where the value is digits * 10^k
+    char digits[32];
+    int length, k;
+    rapidjson::internal::Grisu2(std::fabs(value), digits, &length, &k);
+
+    if (length > PRECISION) {
+        const char next = digits[PRECISION];
+
+        if (next == '5' && length == PRECISION + 1) {
+            // exactly halfway between two roundings of the shortest
+            // digits, which says nothing about which way the double
+            // itself is rounded, so leave it to printf.
+            return FormatF64Slow(value, buf);
+        }
+
+        k += length - PRECISION;
+        length = PRECISION;
+
+        if (next >= '5') {
+            int i = length - 1;
+            while (i >= 0 && digits[i] == '9') {
+                digits[i--] = '0';
+            }
+
+            if (i >= 0) {
+                digits[i]++;
+            } else {
+                // all nines, carried into a new leading digit
+                digits[0] = '1';
+                k++;
+            }
+        }
+    }
+
+    while (length > 1 && digits[length - 1] == '0') {
+        length--;
+        k++;
+    }
+
+    // decimal exponent of the first digit
+    const int exponent = length + k - 1;
+
+    if (exponent < -4 || exponent >= PRECISION) {
+        *p++ = digits[0];
+
+        if (length > 1) {
+            *p++ = '.';
+            std::memcpy(p, digits + 1, length - 1);
+            p += length - 1;
+        }
+
+        int e = exponent;
+
+        *p++ = 'e';
+        if (e < 0) {
+            *p++ = '-';
+            e = -e;
+        } else {
+            *p++ = '+';
+        }
+
+        if (e >= 100) {
+            *p++ = char('0' + e / 100);
+            e %= 100;
+        }
+
+        *p++ = char('0' + e / 10);
+        *p++ = char('0' + e % 10);
+    } else if (exponent < 0) {
+        *p++ = '0';
+        *p++ = '.';
+
+        for (int i = -1; i > exponent; i--) {
+            *p++ = '0';
+        }
+
+        std::memcpy(p, digits, length);
+        p += length;
+    } else if (length <= exponent + 1) {
+        std::memcpy(p, digits, length);
+        p += length;
+
+        for (int i = length; i <= exponent; i++) {
+            *p++ = '0';
+        }
+    } else {
+        std::memcpy(p, digits, exponent + 1);
+        p += exponent + 1;
+        *p++ = '.';
+        std::memcpy(p, digits + exponent + 1, length - exponent - 1);
+        p += length - exponent - 1;
+    }
+
+    return p - buf;
+}
+
+} // namespace vm
+} // namespace ace
@@ -0,0 +1,167 @@
+#include <ace-vm/ParallelMarker.hpp>
+#include <ace-vm/MarkStack.hpp>
+
+#include <thread>
+
+namespace ace {
+namespace vm {
+
+// values a worker keeps to itself before it shares with idle workers
+static const size_t SHARE_THRESHOLD = 64;
+
+// the heap value that a value refers to, following value references
+static inline HeapValue *GetHeapPointer(const Value *value)
+{
+    while (value->GetType() == Value::VALUE_REF) {
+        value = value->GetValueRef();
+    }
+
+    return value->GetType() == Value::HEAP_POINTER ? value->GetHeapPointer() : nullptr;
+}
+
+ParallelMarker::ParallelMarker(GCWorkerPool *pool)
+    : m_pool(pool),
+      m_num_workers(pool->GetNumWorkers()),
+      m_workers(new Worker[pool->GetNumWorkers()]),
+      m_next_seed(0),
+      m_num_idle(0)
+{
+}
+
+void ParallelMarker::Shade(const Value &value)
+{
+    HeapValue *ptr = GetHeapPointer(&value);
+
+    if (ptr != nullptr && ptr->TryMark()) {
+        // spread the roots over the workers
+        Worker &worker = m_workers[m_next_seed++ % m_num_workers];
+        worker.shared.push_back(ptr);
+        worker.num_shared.store(worker.shared.size(), std::memory_order_relaxed);
+    }
+}
+
+void ParallelMarker::Run()
+{
+    m_num_idle.store(0);
+    m_pool->Run([this](size_t index) { Work(index); });
+}
+
+void ParallelMarker::Work(size_t index)
+{
+    std::vector<HeapValue*> stack;
+    HeapValue *ptr;
+
+    const auto visit = [&stack](const Value &value) {
+        HeapValue *ref = GetHeapPointer(&value);
+        if (ref != nullptr && ref->TryMark()) {
+            stack.push_back(ref);
+        }
+    };
+
+    for (;;) {
+        while (!stack.empty()) {
+            ptr = stack.back();
+            stack.pop_back();
+
+            ForEachReference(ptr, visit);
+
+            if (stack.size() > SHARE_THRESHOLD
+                && m_workers[index].num_shared.load(std::memory_order_relaxed) == 0) {
+                Share(index, stack);
+            }
+        }
+
+        if (PopShared(index, ptr) || Steal(index, ptr)) {
+            stack.push_back(ptr);
+            continue;
+        }
+
+        // out of work. wait until someone shares more,
+        // or everyone else is out of work too.
+        m_num_idle.fetch_add(1);
+
+        for (;;) {
+            if (m_num_idle.load() == m_num_workers) {
+                return;
+            }
+
+            if (AnyShared()) {
+                m_num_idle.fetch_sub(1);
+                break;
+            }
+
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ParallelMarker::Share(size_t index, std::vector<HeapValue*> &stack)
+{
+    Worker &worker = m_workers[index];
+    const size_t half = stack.size() / 2;
+
+    std::lock_guard<std::mutex> lock(worker.mtx);
+    worker.shared.insert(worker.shared.end(), stack.begin(), stack.begin() + half);
+    worker.num_shared.store(worker.shared.size(), std::memory_order_relaxed);
+
+    stack.erase(stack.begin(), stack.begin() + half);
+}
+
+bool ParallelMarker::PopShared(size_t index, HeapValue *&out)
+{
+    Worker &worker = m_workers[index];
+
+    if (worker.num_shared.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(worker.mtx);
+
+    if (worker.shared.empty()) {
+        return false;
+    }
+
+    out = worker.shared.back();
+    worker.shared.pop_back();
+    worker.num_shared.store(worker.shared.size(), std::memory_order_relaxed);
+
+    return true;
+}
+
+bool ParallelMarker::Steal(size_t thief, HeapValue *&out)
+{
+    for (size_t i = 1; i < m_num_workers; i++) {
+        Worker &victim = m_workers[(thief + i) % m_num_workers];
+
+        if (victim.num_shared.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(victim.mtx);
+
+        if (!victim.shared.empty()) {
+            // take the oldest, which tends to have the most below it
+            out = victim.shared.front();
+            victim.shared.pop_front();
+            victim.num_shared.store(victim.shared.size(), std::memory_order_relaxed);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ParallelMarker::AnyShared() const
+{
+    for (size_t i = 0; i < m_num_workers; i++) {
+        if (m_workers[i].num_shared.load(std::memory_order_relaxed) != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // namespace vm
+} // namespace ace
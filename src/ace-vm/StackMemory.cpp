@@ -1,4 +1,5 @@
 #include <ace-vm/StackMemory.hpp>
+#include <ace-vm/StringBuilder.hpp>
 
 #include <common/utf8.hpp>
 
@@ -9,6 +10,7 @@ namespace ace {
 namespace vm {
 
 const size_t Stack::STACK_SIZE = 20000;
+const size_t CallStack::MAX_DEPTH = 10000;
 
 std::ostream &operator<<(std::ostream &os, const Stack &stack)
 {
@@ -34,9 +36,9 @@ std::ostream &operator<<(std::ostream &os, const Stack &stack)
 
         os << std::setw(16);
 
-        std::stringstream ss;
-        value.ToRepresentation(ss, false);
-        os << ss.rdbuf();
+        StringBuilder sb;
+        value.ToRepresentation(sb, false);
+        os << sb.Finish().GetData();
 
         os << std::endl;
     }
@@ -64,12 +66,17 @@ void Stack::Purge()
     m_sp = 0;
 }
 
-void Stack::MarkAll()
+CallStack::CallStack()
+    : m_frames(new CallFrame[MAX_DEPTH + 1]),
+      m_depth(0)
 {
-    for (int i = m_sp - 1; i >= 0; i--) {
-        m_data[i].Mark();
-    }
+    m_frames[0] = CallFrame { 0, 0, 0, 0 };
+}
+
+CallStack::~CallStack()
+{
+    delete[] m_frames;
 }
 
 } // namespace vm
-} // namespace ace
\ No newline at end of file
+} // namespace ace
@@ -24,8 +24,8 @@ void StaticMemory::Purge()
     // delete all objects that are heap allocated
     for (; m_sp; m_sp--) {
         Value &sv = m_data[m_sp - 1];
-        if (sv.m_type == Value::HEAP_POINTER && sv.m_value.ptr != nullptr) {
-            delete sv.m_value.ptr;
+        if (sv.GetType() == Value::HEAP_POINTER && sv.GetHeapPointer() != nullptr) {
+            delete sv.GetHeapPointer();
         }
     }
 }
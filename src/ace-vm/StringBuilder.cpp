@@ -0,0 +1,71 @@
+#include <ace-vm/StringBuilder.hpp>
+
+#include <algorithm>
+
+namespace ace {
+namespace vm {
+
+static const size_t MIN_CAPACITY = 32;
+
+StringBuilder::StringBuilder()
+    : m_chars(nullptr),
+      m_length(0),
+      m_capacity(0)
+{
+}
+
+StringBuilder::StringBuilder(size_t capacity)
+    : StringBuilder()
+{
+    Reserve(capacity);
+}
+
+StringBuilder::StringBuilder(const StringBuilder &other)
+    : StringBuilder(other.m_length)
+{
+    if (other.m_length != 0) {
+        Append(other.m_chars, other.m_length);
+    }
+}
+
+StringBuilder::~StringBuilder()
+{
+    ImmutableString::FreeBuffer(m_chars);
+}
+
+bool StringBuilder::operator==(const StringBuilder &other) const
+{
+    return m_length == other.m_length
+        && (m_length == 0 || !std::memcmp(m_chars, other.m_chars, m_length));
+}
+
+void StringBuilder::Reserve(size_t capacity)
+{
+    if (capacity > m_capacity) {
+        m_chars = ImmutableString::ResizeBuffer(m_chars, capacity);
+        m_capacity = capacity;
+    }
+}
+
+void StringBuilder::Grow(size_t min_capacity)
+{
+    Reserve(std::max(min_capacity, std::max(m_capacity * 2, MIN_CAPACITY)));
+}
+
+ImmutableString StringBuilder::Finish()
+{
+    if (m_chars == nullptr) {
+        return ImmutableString::Intern("", 0);
+    }
+
+    ImmutableString result = ImmutableString::FromBuffer(m_chars, m_length);
+
+    m_chars = nullptr;
+    m_length = 0;
+    m_capacity = 0;
+
+    return result;
+}
+
+} // namespace vm
+} // namespace ace
@@ -1,14 +1,45 @@
 #include <ace-vm/TypeInfo.hpp>
+
+#include <common/hasher.hpp>
+
 #include <cstring>
 
 namespace ace {
 namespace vm {
 
+ObjectShape::ObjectShape(size_t size, char **names)
+{
+    m_hashes.reserve(size);
+
+    size_t table_size = 1;
+    while (table_size < size * 2) {
+        table_size <<= 1;
+    }
+
+    m_table.assign(table_size, 0);
+
+    for (size_t i = 0; i < size; i++) {
+        const uint32_t hash = hash_fnv_1(names[i]);
+        const bool duplicate = Lookup(hash) != -1;
+
+        m_hashes.push_back(hash);
+
+        if (!duplicate) {
+            size_t index = hash & (table_size - 1);
+            while (m_table[index] != 0) {
+                index = (index + 1) & (table_size - 1);
+            }
+            m_table[index] = (uint32_t)i + 1;
+        }
+    }
+}
+
 TypeInfo::TypeInfo(const char *name,
     size_t size,
     char **names)
     : m_size(size),
-      m_names(new char*[size])
+      m_names(new char*[size]),
+      m_shape(size, names)
 {
     size_t name_len = std::strlen(name);
     m_name = new char[name_len + 1];
@@ -26,7 +57,8 @@ TypeInfo::TypeInfo(const char *name,
 
 TypeInfo::TypeInfo(const TypeInfo &other)
     : m_size(other.m_size),
-      m_names(new char*[other.m_size])
+      m_names(new char*[other.m_size]),
+      m_shape(other.m_shape)
 {
     size_t name_len = std::strlen(other.m_name);
     m_name = new char[name_len + 1];
@@ -56,6 +88,7 @@ TypeInfo &TypeInfo::operator=(const TypeInfo &other)
     }
 
     m_size = other.m_size;
+    m_shape = other.m_shape;
 
     size_t name_len = std::strlen(other.m_name);
     m_name = new char[name_len + 1];
@@ -1,4 +1,5 @@
 #include <ace-vm/VM.hpp>
+#include <ace-vm/BytecodeVerifier.hpp>
 #include <ace-vm/Value.hpp>
 #include <ace-vm/HeapValue.hpp>
 #include <ace-vm/Array.hpp>
@@ -6,6 +7,7 @@
 #include <ace-vm/ImmutableString.hpp>
 #include <ace-vm/TypeInfo.hpp>
 #include <ace-vm/InstructionHandler.hpp>
+#include <ace-vm/NumberFormat.hpp>
 
 #include <common/typedefs.hpp>
 #include <common/instructions.hpp>
@@ -13,6 +15,7 @@
 #include <common/my_assert.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <cinttypes>
 #include <mutex>
@@ -21,9 +24,8 @@
 namespace ace {
 namespace vm {
 
-static std::mutex mtx;
-
 VM::VM()
+    : m_dispatch_mode(ACE_VM_COMPUTED_GOTO ? DISPATCH_THREADED : DISPATCH_SWITCH)
 {
     m_state.m_vm = non_owning_ptr<VM>(this);
     // create main thread
@@ -39,50 +41,60 @@ void VM::PushNativeFunctionPtr(NativeFunctionPtr_t ptr)
     ASSERT(m_state.GetNumThreads() > 0);
 
     Value sv;
-    sv.m_type = Value::NATIVE_FUNCTION;
-    sv.m_value.native_func = ptr;
+    sv.SetNativeFunction(ptr);
     m_state.MAIN_THREAD->m_stack.Push(sv);
 }
 
 void VM::Print(const Value &value)
 {
-    switch (value.m_type) {
+    char buf[NUMBER_FORMAT_MAX + 1];
+    size_t len = 0;
+
+    switch (value.GetType()) {
         case Value::I32:
-            utf::printf(UTF8_CSTR("%d"), value.m_value.i32);
+            len = FormatI32(value.GetI32(), buf);
+            buf[len] = '\0';
+            utf::cout << buf;
             break;
 
         case Value::I64:
-            utf::printf(UTF8_CSTR("%" PRId64), value.m_value.i64);
+            len = FormatI64(value.GetI64(), buf);
+            buf[len] = '\0';
+            utf::cout << buf;
             break;
 
         case Value::F32:
-            utf::printf(UTF8_CSTR("%g"), value.m_value.f);
+            len = FormatF32(value.GetF32(), buf);
+            buf[len] = '\0';
+            utf::cout << buf;
             break;
 
         case Value::F64:
-            utf::printf(UTF8_CSTR("%g"), value.m_value.d);
+            len = FormatF64(value.GetF64(), buf);
+            buf[len] = '\0';
+            utf::cout << buf;
             break;
 
         case Value::BOOLEAN:
-            utf::fputs(value.m_value.b ? UTF8_CSTR("true") : UTF8_CSTR("false"), stdout);
+            utf::fputs(value.GetBoolean() ? UTF8_CSTR("true") : UTF8_CSTR("false"), stdout);
             break;
 
         case Value::VALUE_REF:
-            if (value.m_value.value_ref == nullptr) {
+            if (value.GetValueRef() == nullptr) {
                 utf::fputs(UTF8_CSTR("null"), stdout);
             } else {
-                VM::Print(*value.m_value.value_ref);
+                VM::Print(*value.GetValueRef());
             }
             break;
 
         case Value::HEAP_POINTER: {
-            if (value.m_value.ptr == nullptr) {
+            if (value.GetHeapPointer() == nullptr) {
                 // special case for null pointers
                 utf::fputs(UTF8_CSTR("null"), stdout);
-            } else if (ImmutableString *str = value.m_value.ptr->GetPointer<ImmutableString>()) {
+            } else if (ImmutableString *str = value.GetHeapPointer()->GetPointer<ImmutableString>()) {
                 // print string value
                 utf::cout << str->GetData();
-            } else if (Array *array = value.m_value.ptr->GetPointer<Array>()) {
+            } else if (Array *array = value.GetHeapPointer()->GetPointer<Array>()) {
                 // print array list
                 const char sep_str[3] = ", ";
                 const size_t sep_str_len = sizeof(sep_str) - 1;
@@ -139,78 +151,52 @@ void VM::Invoke(InstructionHandler *handler,
 {
     VMState *state = handler->state;
     ExecutionThread *thread = handler->thread;
-    BytecodeStream *bs = handler->bs;
 
     ASSERT(state != nullptr);
     ASSERT(thread != nullptr);
-    ASSERT(bs != nullptr);
+    ASSERT(handler->program != nullptr);
 
-    if (value.m_type != Value::FUNCTION) {
-        if (value.m_type == Value::NATIVE_FUNCTION) {
-            Value **args = new Value*[nargs > 0 ? nargs : 1];
-
-            int i = (int)thread->m_stack.GetStackPointer() - 1;
-            for (int j = nargs - 1; j >= 0 && i >= 0; i--, j--) {
-                args[j] = &thread->m_stack[i];
-            }
+    if (value.GetType() != Value::FUNCTION) {
+        if (value.GetType() == Value::NATIVE_FUNCTION) {
+            ASSERT(thread->m_stack.GetStackPointer() >= nargs);
 
+            // the arguments are the top nargs values of the stack,
+            // which the native function reads in place
             ace::sdk::Params params;
             params.handler = handler;
-            params.args = args;
+            params.args = thread->m_stack.GetData() + thread->m_stack.GetStackPointer() - nargs;
             params.nargs = nargs;
 
-            // disable auto gc so no collections happen during a native function
-            state->enable_auto_gc = false;
-
-            // call the native function
-            value.m_value.native_func(params);
-
-            // re-enable auto gc
-            state->enable_auto_gc = true;
-
-            delete[] args;
+            // call the native function. it roots the values it
+            // allocates with a HandleScope, so collections can run.
+            value.GetNativeFunction()(params);
 
             return;
-        } else if (value.m_type == Value::HEAP_POINTER) {
-            if (value.m_value.ptr == nullptr) {
+        } else if (value.GetType() == Value::HEAP_POINTER) {
+            if (value.GetHeapPointer() == nullptr) {
                 state->ThrowException(
                     thread,
                     Exception::NullReferenceException()
                 );
                 return;
-            } else if (Object *object = value.m_value.ptr->GetPointer<Object>()) {
-                if (Member *member = object->LookupMemberFromHash(hash_fnv_1("$invoke"))) {
-                    const int sp = (int)thread->m_stack.GetStackPointer();
-                    const int args_start = sp - nargs;
-
-                    if (nargs > 0) {
-                        // shift over by 1 -- and insert 'self' to start of args
-                        // make a copy of last item to not overwrite it
-                        thread->m_stack.Push(thread->m_stack[sp - 1]);
-
-                        for (size_t i = args_start; i < sp - 1; i++) {
-                            thread->m_stack[i + 1] = thread->m_stack[i];
-                        }
-                        
-                        // set 'self' object to start of args
-                        thread->m_stack[args_start] = value;
-                    } else {
-                        thread->m_stack.Push(value);
-                    }
+            } else if (Object *object = value.GetHeapPointer()->GetPointer<Object>()) {
+                if (Value *member = object->LookupMemberFromHash(Object::INVOKE_HASH)) {
+                    InsertSelf(thread, value, nargs);
+
+                    const size_t depth = thread->m_frames.GetDepth();
 
                     VM::Invoke(
                         handler,
-                        member->value,
+                        *member,
                         nargs + 1
                     );
 
-                    Value &top = thread->m_stack.Top();
-                    ASSERT(top.m_type == Value::FUNCTION_CALL);
-
-                    // bookkeeping to remove the closure object
-                    // normally, arguments are popped after the call is returned,
-                    // rather than within the body
-                    top.m_value.call.varargs_push--;
+                    if (thread->m_frames.GetDepth() > depth) {
+                        // bookkeeping to remove the closure object
+                        // normally, arguments are popped after the call is returned,
+                        // rather than within the body
+                        thread->m_frames.Top().nargs--;
+                    }
 
                     return;
                 }
@@ -232,845 +218,1113 @@ void VM::Invoke(InstructionHandler *handler,
         return;
     }
     
-    if ((value.m_value.func.m_flags & FunctionFlags::VARIADIC) && nargs < value.m_value.func.m_nargs - 1) {
-        // if variadic, make sure the arg count is /at least/ what is required
+    if (!CheckArgs(handler, value, nargs)) {
+        return;
+    }
+
+    if (thread->m_frames.IsFull() ||
+        thread->m_stack.GetStackPointer() + handler->program->GetMaxStackHeight() + 1 >= Stack::STACK_SIZE) {
+        // no room for the call frame, or for the variadic
+        // arguments array and the locals of the function
         state->ThrowException(
             thread,
-            Exception::InvalidArgsException(
-                value.m_value.func.m_nargs,
-                nargs,
-                true
-            )
+            Exception::StackOverflowException()
         );
-    } else if (!(value.m_value.func.m_flags & FunctionFlags::VARIADIC) && value.m_value.func.m_nargs != nargs) {
-        state->ThrowException(
-            thread,
-            Exception::InvalidArgsException(
-                value.m_value.func.m_nargs,
-                nargs
-            )
-        );
-    } else {
-        Value previous_addr;
-        previous_addr.m_type = Value::FUNCTION_CALL;
-        previous_addr.m_value.call.varargs_push = 0;
-        // store current address
-        previous_addr.m_value.call.addr = (uint32_t)bs->Position();
-
-        if (value.m_value.func.m_flags & FunctionFlags::VARIADIC) {
-            // for each argument that is over the expected size, we must pop it from
-            // the stack and add it to a new array.
-            int varargs_amt = nargs - value.m_value.func.m_nargs + 1;
-            if (varargs_amt < 0) {
-                varargs_amt = 0;
-            }
-            
-            // set varargs_push value so we know how to get back to the stack size before.
-            previous_addr.m_value.call.varargs_push = varargs_amt - 1;
-            
-            // allocate heap object
-            HeapValue *hv = state->HeapAlloc(thread);
-            ASSERT(hv != nullptr);
-
-            // create Array object to hold variadic args
-            Array arr(varargs_amt);
-
-            for (int i = varargs_amt - 1; i >= 0; i--) {
-                // push to array
-                arr.AtIndex(i, thread->GetStack().Top());
-                thread->GetStack().Pop();
-            }
-
-            // assign heap value to our array
-            hv->Assign(arr);
-
-            Value array_value;
-            array_value.m_type = Value::HEAP_POINTER;
-            array_value.m_value.ptr = hv;
-
-            // push the array to the stack
-            thread->GetStack().Push(array_value);
-        }
 
-        // push the address
-        thread->GetStack().Push(previous_addr);
-        // seek to the new address
-        bs->Seek(value.m_value.func.m_addr);
+        return;
+    }
+
+    CallFrame &frame = thread->m_frames.Push();
+    // store the index of the instruction to return to
+    frame.return_pc = handler->pc;
+    frame.base = (uint32_t)(thread->m_stack.GetStackPointer() - nargs);
+    frame.nargs = nargs;
+    frame.function_address = value.GetFunctionAddress();
 
-        // increase function depth
-        thread->m_func_depth++;
+    if (value.GetFunctionFlags() & FunctionFlags::VARIADIC) {
+        PackVariadicArgs(handler, value, nargs);
     }
+
+    // jump to the first instruction of the function
+    handler->pc = handler->program->IndexOf(value.GetFunctionAddress());
 }
 
-void VM::HandleInstruction(InstructionHandler *handler, uint8_t code)
+void VM::TailInvoke(InstructionHandler *handler,
+    const Value &value,
+    uint8_t nargs)
 {
-    std::lock_guard<std::mutex> lock(mtx);
-
+    VMState *state = handler->state;
     ExecutionThread *thread = handler->thread;
-    BytecodeStream *bs = handler->bs;
-    
-    if (thread->m_exception_state.HasExceptionOccurred()) {
-        if (thread->m_exception_state.m_try_counter > 0) {
-            // handle exception
-            thread->m_exception_state.m_try_counter--;
 
-            Value *top = nullptr;
-            while ((top = &thread->m_stack.Top())->m_type != Value::TRY_CATCH_INFO) {
-                thread->m_stack.Pop();
-            }
+    ASSERT(thread->GetFuncDepth() > 0);
+    ASSERT(thread->m_stack.GetStackPointer() >= nargs);
 
-            // top should be exception data
-            ASSERT(top != nullptr && top->m_type == Value::TRY_CATCH_INFO);
+    if (value.GetType() != Value::FUNCTION) {
+        if (value.GetType() == Value::HEAP_POINTER && value.GetHeapPointer() != nullptr) {
+            if (Object *object = value.GetHeapPointer()->GetPointer<Object>()) {
+                if (Value *member = object->LookupMemberFromHash(Object::INVOKE_HASH)) {
+                    // the frame keeps the caller's argument count, so there
+                    // is nothing to fix up afterwards as in VM::Invoke
+                    InsertSelf(thread, value, nargs);
 
-            // jump to the catch block
-            bs->Seek(top->m_value.try_catch_info.catch_address);
-            // reset the exception flag
-            thread->m_exception_state.m_exception_occured = false;
+                    VM::TailInvoke(handler, *member, nargs + 1);
 
-            // pop exception data from stack
-            thread->m_stack.Pop();
+                    return;
+                }
+            }
+        }
+
+        // native functions (and errors) go through a regular call,
+        // and then we return from the current function ourselves
+        VM::Invoke(handler, value, nargs);
+
+        if (!thread->m_exception_state.HasExceptionOccurred()) {
+            handler->Ret();
         }
 
         return;
     }
 
-    switch (code) {
-        case STORE_STATIC_STRING: {
-            // get string length
-            uint32_t len; bs->Read(&len);
-
-            // read string based on length
-            char *str = new char[len + 1];
-            bs->Read(str, len);
-            str[len] = '\0';
+    if (!CheckArgs(handler, value, nargs)) {
+        return;
+    }
 
-            handler->StoreStaticString(
-                len,
-                str
-            );
+    // reuse the current frame: the new arguments replace the old
+    // arguments and locals. the return address and the caller's argument
+    // count stay as they are, so RET still leaves the stack the way the
+    // caller expects it.
+    CallFrame &frame = thread->m_frames.Top();
+    frame.function_address = value.GetFunctionAddress();
 
-            delete[] str;
+    Value *data = thread->m_stack.GetData();
+    const size_t args_start = thread->m_stack.GetStackPointer() - nargs;
 
-            break;
-        }
-        case STORE_STATIC_ADDRESS: {
-            bc_address_t addr; bs->Read(&addr);
+    if (args_start != frame.base) {
+        std::copy(data + args_start, data + args_start + nargs, data + frame.base);
+        thread->m_stack.m_sp = frame.base + nargs;
+    }
 
-            handler->StoreStaticAddress(
-                addr
-            );
+    if (thread->m_stack.GetStackPointer() + handler->program->GetMaxStackHeight() + 1 >= Stack::STACK_SIZE) {
+        state->ThrowException(
+            thread,
+            Exception::StackOverflowException()
+        );
 
-            break;
-        }
-        case STORE_STATIC_FUNCTION: {
-            bc_address_t addr; bs->Read(&addr);
-            uint8_t nargs; bs->Read(&nargs);
-            uint8_t flags; bs->Read(&flags);
+        return;
+    }
 
-            handler->StoreStaticFunction(
-                addr,
-                nargs,
-                flags
-            );
+    if (value.GetFunctionFlags() & FunctionFlags::VARIADIC) {
+        PackVariadicArgs(handler, value, nargs);
+    }
 
-            break;
-        }
-        case STORE_STATIC_TYPE: {
-            uint16_t type_name_len; bs->Read(&type_name_len);
+    // jump to the first instruction of the function
+    handler->pc = handler->program->IndexOf(value.GetFunctionAddress());
+}
 
-            char *type_name = new char[type_name_len + 1];
-            type_name[type_name_len] = '\0';
-            bs->Read(type_name, type_name_len);
+void VM::InsertSelf(ExecutionThread *thread,
+    const Value &self,
+    uint8_t nargs)
+{
+    ASSERT(thread->m_stack.GetStackPointer() >= nargs);
 
-            uint16_t size; bs->Read(&size);
+    // copied first, as it may be one of the values that are moved
+    const Value self_copy(self);
+    const size_t args_start = thread->m_stack.GetStackPointer() - nargs;
 
-            ASSERT(size > 0);
+    thread->m_stack.Push(self_copy);
 
-            char **names = new char*[size];
-            // load each name
-            for (int i = 0; i < size; i++) {
-                uint16_t length;
-                bs->Read(&length);
+    // move each argument up by one, starting from the last,
+    // so that none is overwritten before it has been moved
+    Value *data = thread->m_stack.GetData();
 
-                names[i] = new char[length + 1];
-                names[i][length] = '\0';
-                bs->Read(names[i], length);
-            }
+    for (size_t i = args_start + nargs; i > args_start; i--) {
+        data[i] = data[i - 1];
+    }
 
-            handler->StoreStaticType(
-                type_name,
-                size,
-                names
-            );
+    data[args_start] = self_copy;
+}
 
-            delete[] type_name;
-            
-            // delete the names
-            for (size_t i = 0; i < size; i++) {
-                delete[] names[i];
-            }
+bool VM::CheckArgs(InstructionHandler *handler,
+    const Value &value,
+    uint8_t nargs)
+{
+    if ((value.GetFunctionFlags() & FunctionFlags::VARIADIC) && nargs < value.GetFunctionNargs() - 1) {
+        // if variadic, make sure the arg count is /at least/ what is required
+        handler->state->ThrowException(
+            handler->thread,
+            Exception::InvalidArgsException(
+                value.GetFunctionNargs(),
+                nargs,
+                true
+            )
+        );
 
-            delete[] names;
+        return false;
+    } else if (!(value.GetFunctionFlags() & FunctionFlags::VARIADIC) && value.GetFunctionNargs() != nargs) {
+        handler->state->ThrowException(
+            handler->thread,
+            Exception::InvalidArgsException(
+                value.GetFunctionNargs(),
+                nargs
+            )
+        );
 
-            break;
-        }
-        case LOAD_I32: {
-            bc_reg_t reg; bs->Read(&reg);
-            int32_t i32; bs->Read(&i32);
+        return false;
+    }
 
-            handler->LoadI32(
-                reg,
-                i32
-            );
+    return true;
+}
 
-            break;
-        }
-        case LOAD_I64: {
-            bc_reg_t reg; bs->Read(&reg);
-            int64_t i64; bs->Read(&i64);
+void VM::PackVariadicArgs(InstructionHandler *handler,
+    const Value &value,
+    uint8_t nargs)
+{
+    ExecutionThread *thread = handler->thread;
 
-            handler->LoadI64(
-                reg,
-                i64
-            );
+    // for each argument that is over the expected size, we must pop it from
+    // the stack and add it to a new array.
+    int varargs_amt = nargs - value.GetFunctionNargs() + 1;
+    if (varargs_amt < 0) {
+        varargs_amt = 0;
+    }
 
-            break;
-        }
-        case LOAD_F32: {
-            bc_reg_t reg; bs->Read(&reg);
-            float f32; bs->Read(&f32);
+    // allocate heap object
+    HeapValue *hv = handler->state->HeapAlloc(thread);
+    ASSERT(hv != nullptr);
 
-            handler->LoadF32(
-                reg,
-                f32
-            );
+    // create Array object to hold variadic args
+    Array arr(varargs_amt);
 
-            break;
-        }
-        case LOAD_F64: {
-            bc_reg_t reg; bs->Read(&reg);
-            double f64; bs->Read(&f64);
+    for (int i = varargs_amt - 1; i >= 0; i--) {
+        // push to array
+        arr.AtIndex(i, thread->GetStack().Top());
+        thread->GetStack().Pop();
+    }
 
-            handler->LoadF64(
-                reg,
-                f64
-            );
+    // assign heap value to our array
+    hv->Assign(arr);
 
-            break;
-        }
-        case LOAD_OFFSET: {
-            bc_reg_t reg; bs->Read(&reg);
-            uint16_t offset; bs->Read(&offset);
+    Value array_value;
+    array_value.SetHeapPointer(hv);
 
-            handler->LoadOffset(
-                reg,
-                offset
-            );
+    // push the array to the stack
+    thread->GetStack().Push(array_value);
+}
 
-            break;
-        }
-        case LOAD_INDEX: {
-            bc_reg_t reg; bs->Read(&reg);
-            uint16_t index; bs->Read(&index);
+// every opcode with a handler in VM::DispatchLoop
+#define ACE_VM_OPCODES(X) \
+    X(STORE_STATIC_STRING) \
+    X(STORE_STATIC_ADDRESS) \
+    X(STORE_STATIC_FUNCTION) \
+    X(STORE_STATIC_TYPE) \
+    X(LOAD_I32) \
+    X(LOAD_I64) \
+    X(LOAD_F32) \
+    X(LOAD_F64) \
+    X(LOAD_OFFSET) \
+    X(LOAD_INDEX) \
+    X(LOAD_LOCAL) \
+    X(LOAD_STATIC) \
+    X(LOAD_STRING) \
+    X(LOAD_ADDR) \
+    X(LOAD_FUNC) \
+    X(LOAD_TYPE) \
+    X(LOAD_MEM) \
+    X(LOAD_MEM_HASH) \
+    X(LOAD_ARRAYIDX) \
+    X(LOAD_REF) \
+    X(LOAD_DEREF) \
+    X(LOAD_NULL) \
+    X(LOAD_TRUE) \
+    X(LOAD_FALSE) \
+    X(MOV_OFFSET) \
+    X(MOV_INDEX) \
+    X(MOV_LOCAL) \
+    X(MOV_MEM) \
+    X(MOV_MEM_HASH) \
+    X(MOV_ARRAYIDX) \
+    X(MOV_REG) \
+    X(HAS_MEM_HASH) \
+    X(PUSH) \
+    X(POP) \
+    X(POP_N) \
+    X(PUSH_ARRAY) \
+    X(ECHO) \
+    X(ECHO_NEWLINE) \
+    X(JMP) \
+    X(JE) \
+    X(JNE) \
+    X(JG) \
+    X(JGE) \
+    X(CALL) \
+    X(TAIL_CALL) \
+    X(CALL_STATIC) \
+    X(CALL_METHOD) \
+    X(RET) \
+    X(BEGIN_TRY) \
+    X(END_TRY) \
+    X(NEW) \
+    X(NEW_ARRAY) \
+    X(CMP) \
+    X(CMPZ) \
+    X(ADD) \
+    X(SUB) \
+    X(MUL) \
+    X(DIV) \
+    X(MOD) \
+    X(AND) \
+    X(OR) \
+    X(XOR) \
+    X(SHL) \
+    X(SHR) \
+    X(NEG) \
+    X(EXIT) \
+    X(ADD_I32) \
+    X(ADD_I64) \
+    X(ADD_F32) \
+    X(ADD_F64) \
+    X(SUB_I32) \
+    X(SUB_I64) \
+    X(SUB_F32) \
+    X(SUB_F64) \
+    X(MUL_I32) \
+    X(MUL_I64) \
+    X(MUL_F32) \
+    X(MUL_F64) \
+    X(DIV_I32) \
+    X(DIV_I64) \
+    X(DIV_F32) \
+    X(DIV_F64) \
+    X(MOD_I32) \
+    X(MOD_I64) \
+    X(MOD_F32) \
+    X(MOD_F64) \
+    X(CMP_I32) \
+    X(CMP_I64) \
+    X(CMP_F32) \
+    X(CMP_F64)
+
+static_assert((int)CALL_METHOD < (int)ADD_I32, "quickened opcodes must not overlap bytecode opcodes");
+
+// a quickened instruction that has gone back to its generic
+// opcode this many times is left generic for good
+static const uint32_t QUICKEN_MAX_DEOPTS = 4;
+
+// Quickening rewrites an instruction in the shared program, so it is only
+// done while there is a single thread (the program is not touched again
+// once other threads could be reading it). For the generic instructions,
+// ins->imm holds the opcode last picked for the operand types and ins->u32
+// counts how many times the instruction has been un-quickened.
+
+static inline void Quicken(InstructionHandler *handler, DecodedInstruction *ins)
+{
+    if (ins->u32 >= QUICKEN_MAX_DEOPTS || handler->state->GetNumThreads() != 1) {
+        return;
+    }
 
-            handler->LoadIndex(
-                reg,
-                index
-            );
+    const Value &lhs = handler->thread->m_regs[ins->a];
+    const Value &rhs = handler->thread->m_regs[ins->b];
+
+    uint8_t variant;
+
+    if (lhs.GetType() != rhs.GetType()) {
+        variant = 0xff;
+    } else if (lhs.GetType() == Value::I32) {
+        variant = 0;
+    } else if (lhs.GetType() == Value::I64) {
+        variant = 1;
+    } else if (lhs.GetType() == Value::F32) {
+        variant = 2;
+    } else if (lhs.GetType() == Value::F64) {
+        variant = 3;
+    } else {
+        variant = 0xff;
+    }
 
-            break;
+    uint8_t quickened = 0;
+
+    if (variant != 0xff) {
+        switch (ins->opcode) {
+            case ADD: quickened = ADD_I32 + variant; break;
+            case SUB: quickened = SUB_I32 + variant; break;
+            case MUL: quickened = MUL_I32 + variant; break;
+            case DIV: quickened = DIV_I32 + variant; break;
+            case MOD: quickened = MOD_I32 + variant; break;
+            case CMP:
+                // comparing a register to itself is always EQUAL,
+                // even for NaN, which the specialized versions do not do
+                if (ins->a != ins->b) {
+                    quickened = CMP_I32 + variant;
+                }
+                break;
+            default:
+                break;
         }
-        case LOAD_STATIC: {
-            bc_reg_t reg; bs->Read(&reg);
-            uint16_t index; bs->Read(&index);
+    }
 
-            handler->LoadStatic(
-                reg,
-                index
-            );
+    // only rewrite once the same types have been seen twice in a row
+    if (quickened != 0 && ins->imm.i32 == quickened) {
+        ins->opcode = quickened;
+    }
 
-            break;
-        }
-        case LOAD_STRING: {
-            bc_reg_t reg; bs->Read(&reg);
-            // get string length
-            uint32_t len; bs->Read(&len);
+    ins->imm.i32 = quickened;
+}
 
-            // read string based on length
-            char *str = new char[len + 1];
-            str[len] = '\0';
-            bs->Read(str, len);
+static inline void Unquicken(InstructionHandler *handler, DecodedInstruction *ins, uint8_t generic)
+{
+    if (handler->state->GetNumThreads() != 1) {
+        return;
+    }
 
-            handler->LoadString(
-                reg,
-                len,
-                str
-            );
+    ins->opcode = generic;
+    ins->imm.i32 = 0;
+    ins->u32++;
+}
 
-            delete[] str;
+#if ACE_VM_COMPUTED_GOTO
+    // labels as values / computed goto are a gcc extension
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wpedantic"
+#endif
 
-            break;
-        }
-        case LOAD_ADDR: {
-            bc_reg_t reg; bs->Read(&reg);
-            bc_address_t addr; bs->Read(&addr);
+template <bool Threaded, bool Checked>
+void VM::DispatchLoop(InstructionHandler *handler, int stop_depth)
+{
+    ExecutionThread *thread = handler->thread;
 
-            handler->LoadAddr(
-                reg,
-                addr
-            );
+    ASSERT(handler->program != nullptr);
+    ASSERT(handler->program->Size() > 0);
 
-            break;
-        }
-        case LOAD_FUNC: {
-            bc_reg_t reg; bs->Read(&reg);
-            bc_address_t addr; bs->Read(&addr);
-            uint8_t nargs; bs->Read(&nargs);
-            uint8_t flags; bs->Read(&flags);
-
-            handler->LoadFunc(
-                reg,
-                addr,
-                nargs,
-                flags
-            );
+    // the instructions stay where they are while the program is
+    // running, but may be quickened in place
+    DecodedInstruction *const instructions = handler->program->GetInstructions();
+    DecodedInstruction *ins;
 
-            break;
-        }
-        case LOAD_TYPE: {
-            bc_reg_t reg; bs->Read(&reg);
-            uint16_t type_name_len; bs->Read(&type_name_len);
+#if ACE_VM_COMPUTED_GOTO
+    // in threaded mode, each handler jumps straight to the handler
+    // of the next instruction through this table, so the switch and the
+    // checks at the top of the loop are only reached when needed.
+    // the handler addresses never change, so the table is filled in
+    // once, by whichever thread gets here first, rather than every
+    // time a thread starts or a generator is resumed.
+    static void *dispatch_table[256];
+    static std::atomic<bool> dispatch_table_ready { false };
+    static std::mutex dispatch_table_mutex;
 
-            char *type_name = new char[type_name_len + 1];
-            type_name[type_name_len] = '\0';
-            bs->Read(type_name, type_name_len);
+    if (Threaded && !dispatch_table_ready.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(dispatch_table_mutex);
 
-            // number of members
-            uint16_t size;
-            bs->Read(&size);
+        if (!dispatch_table_ready.load(std::memory_order_relaxed)) {
+            std::fill(dispatch_table, dispatch_table + 256, &&op_unknown);
 
-            char **names = new char*[size];
-            
-            // load each name
-            for (int i = 0; i < size; i++) {
-                uint16_t length;
-                bs->Read(&length);
+            #define ACE_VM_DISPATCH_ENTRY(op) dispatch_table[op] = &&op_##op;
+            ACE_VM_OPCODES(ACE_VM_DISPATCH_ENTRY)
+            #undef ACE_VM_DISPATCH_ENTRY
 
-                names[i] = new char[length + 1];
-                names[i][length] = '\0';
-                bs->Read(names[i], length);
+            dispatch_table_ready.store(true, std::memory_order_release);
+        }
+    }
+
+    #define VM_TARGET(op) case op: op_##op:
+    // go directly to the next instruction, for handlers that
+    // cannot throw, branch or call. the program always ends with
+    // EXIT, so there is no need to check for the end here.
+    #define VM_NEXT() \
+        if (Threaded) { \
+            ins = &instructions[handler->pc++]; \
+            goto *dispatch_table[ins->opcode]; \
+        } \
+        continue
+#else
+    #define VM_TARGET(op) case op:
+    #define VM_NEXT() continue
+#endif
+    // go back through the checks at the top of the loop
+    #define VM_NEXT_CHECKED() continue
+
+    // the specialized handlers cannot throw, so they go straight to the
+    // next instruction. if the operand types no longer match, the
+    // instruction is put back to its generic opcode and run as that.
+    #define VM_QUICKENED(op, generic_op, specialized, generic, ...) \
+        VM_TARGET(op) { \
+            if (handler->specialized(__VA_ARGS__)) { \
+                VM_NEXT(); \
+            } \
+            Unquicken(handler, ins, generic_op); \
+            handler->generic(__VA_ARGS__); \
+            VM_NEXT_CHECKED(); \
+        }
+
+    for (;;) {
+        // the switch loop comes back here after every instruction.
+        // the threaded loop only comes back after an instruction that
+        // could have thrown an exception, changed the function depth
+        // or jumped (so long-running loops still reach the safepoint).
+        if (!m_state.good || thread->GetFuncDepth() <= stop_depth) {
+            // (an exception may have unwound past the stop depth)
+            break;
+        }
+
+        if (thread->m_exception_state.HasExceptionOccurred()) {
+            if (thread->m_exception_state.m_try_counter <= 0) {
+                // unhandled, nothing more will run on this thread
+                break;
             }
 
-            handler->LoadType(
-                reg,
-                type_name_len,
-                type_name,
-                size,
-                names
-            );
+            // handle exception
+            thread->m_exception_state.m_try_counter--;
 
-            delete[] type_name;
-            
-            // delete the names
-            for (size_t i = 0; i < size; i++) {
-                delete[] names[i];
+            Value *top = nullptr;
+            while ((top = &thread->m_stack.Top())->GetType() != Value::TRY_CATCH_INFO) {
+                thread->m_stack.Pop();
             }
 
-            delete[] names;
-
-            break;
-        }
-        case LOAD_MEM: {
-            bc_reg_t dst; bs->Read(&dst);
-            bc_reg_t src; bs->Read(&src);
-            uint8_t index; bs->Read(&index);
+            // top should be exception data
+            ASSERT(top != nullptr && top->GetType() == Value::TRY_CATCH_INFO);
 
-            handler->LoadMem(
-                dst,
-                src,
-                index
-            );
+            // leave the calls made since the try block was entered,
+            // which are the ones with their frames above it
+            const size_t try_index = thread->m_stack.GetStackPointer() - 1;
+            while (thread->m_frames.GetDepth() > 0 && thread->m_frames.Top().base > try_index) {
+                thread->m_frames.Pop();
+            }
 
-            break;
-        }
-        case LOAD_MEM_HASH: {
-            bc_reg_t dst; bs->Read(&dst);
-            bc_reg_t src; bs->Read(&src);
-            uint32_t hash; bs->Read(&hash);
+            // jump to the catch block
+            handler->pc = top->GetCatchAddress();
+            // reset the exception flag
+            thread->m_exception_state.m_exception_occured = false;
 
-            handler->LoadMemHash(
-                dst,
-                src,
-                hash
-            );
+            // pop exception data from stack
+            thread->m_stack.Pop();
 
-            break;
+            continue;
         }
-        case LOAD_ARRAYIDX: {
-            bc_reg_t dst_reg; bs->Read(&dst_reg);
-            bc_reg_t src_reg; bs->Read(&src_reg);
-            bc_reg_t index_reg; bs->Read(&index_reg);
-
-            handler->LoadArrayIdx(
-                dst_reg,
-                src_reg,
-                index_reg
-            );
 
-            break;
-        }
-        case LOAD_REF: {
-            bc_reg_t dst_reg;
-            bc_reg_t src_reg;
+        m_state.Safepoint();
 
-            bs->Read(&dst_reg);
-            bs->Read(&src_reg);
+        ins = &instructions[handler->pc++];
 
-            handler->LoadRef(
-                dst_reg,
-                src_reg
-            );
+#if ACE_VM_COMPUTED_GOTO
+        if (Threaded) {
+            goto *dispatch_table[ins->opcode];
         }
-        case LOAD_DEREF: {
-            bc_reg_t dst_reg;
-            bc_reg_t src_reg;
+#endif
 
-            bs->Read(&dst_reg);
-            bs->Read(&src_reg);
+        switch (ins->opcode) {
+            VM_TARGET(STORE_STATIC_STRING) {
+                handler->StoreStaticString(
+                    ins->u32,
+                    ins->imm.str
+                );
 
-            handler->LoadDeref(
-                dst_reg,
-                src_reg
-            );
-        }
-        case LOAD_NULL: {
-            bc_reg_t reg; bs->Read(&reg);
+                VM_NEXT();
+            }
+            VM_TARGET(STORE_STATIC_ADDRESS) {
+                handler->StoreStaticAddress(
+                    ins->u32
+                );
 
-            handler->LoadNull(
-                reg
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(STORE_STATIC_FUNCTION) {
+                handler->StoreStaticFunction(
+                    ins->u32,
+                    ins->a,
+                    ins->b
+                );
 
-            break;
-        }
-        case LOAD_TRUE: {
-            bc_reg_t reg; bs->Read(&reg);
+                VM_NEXT();
+            }
+            VM_TARGET(STORE_STATIC_TYPE) {
+                handler->StoreStaticType(
+                    ins->imm.type->name,
+                    ins->imm.type->size,
+                    ins->imm.type->names.data()
+                );
 
-            handler->LoadTrue(
-                reg
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_I32) {
+                handler->LoadI32(
+                    ins->a,
+                    ins->imm.i32
+                );
 
-            break;
-        }
-        case LOAD_FALSE: {
-            bc_reg_t reg; bs->Read(&reg);
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_I64) {
+                handler->LoadI64(
+                    ins->a,
+                    ins->imm.i64
+                );
 
-            handler->LoadFalse(
-                reg
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_F32) {
+                handler->LoadF32(
+                    ins->a,
+                    ins->imm.f32
+                );
 
-            break;
-        }
-        case MOV_OFFSET: {
-            uint16_t offset; bs->Read(&offset);
-            bc_reg_t reg; bs->Read(&reg);
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_F64) {
+                handler->LoadF64(
+                    ins->a,
+                    ins->imm.f64
+                );
 
-            handler->MovOffset(
-                offset,
-                reg
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_OFFSET) {
+                handler->LoadOffset<Checked>(
+                    ins->a,
+                    ins->u32
+                );
 
-            break;
-        }
-        case MOV_INDEX: {
-            uint16_t index; bs->Read(&index);
-            bc_reg_t reg; bs->Read(&reg);
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_LOCAL) {
+                handler->LoadLocal<Checked>(
+                    ins->a,
+                    ins->u32
+                );
 
-            handler->MovIndex(
-                index,
-                reg
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_INDEX) {
+                handler->LoadIndex<Checked>(
+                    ins->a,
+                    ins->u32
+                );
 
-            break;
-        }
-        case MOV_MEM: {
-            bc_reg_t dst; bs->Read(&dst);
-            uint8_t index; bs->Read(&index);
-            bc_reg_t src; bs->Read(&src);
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_STATIC) {
+                handler->LoadStatic<Checked>(
+                    ins->a,
+                    ins->u32
+                );
 
-            handler->MovMem(
-                dst,
-                index,
-                src
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_STRING) {
+                handler->LoadString(
+                    ins->a,
+                    ins->imm.string
+                );
 
-            break;
-        }
-        case MOV_MEM_HASH: {
-            bc_reg_t dst; bs->Read(&dst);
-            uint32_t hash; bs->Read(&hash);
-            bc_reg_t src; bs->Read(&src);
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_ADDR) {
+                handler->LoadAddr(
+                    ins->a,
+                    ins->u32
+                );
 
-            handler->MovMemHash(
-                dst,
-                hash,
-                src
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_FUNC) {
+                handler->LoadFunc(
+                    ins->a,
+                    ins->u32,
+                    ins->b,
+                    ins->c
+                );
 
-            break;
-        }
-        case MOV_ARRAYIDX: {
-            bc_reg_t dst; bs->Read(&dst);
-            uint32_t index; bs->Read(&index);
-            bc_reg_t src; bs->Read(&src);
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_TYPE) {
+                handler->LoadType(
+                    ins->a,
+                    ins->imm.type
+                );
 
-            handler->MovArrayIdx(
-                dst,
-                index,
-                src
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_MEM) {
+                handler->LoadMem(
+                    ins->a,
+                    ins->b,
+                    ins->c
+                );
 
-            break;
-        }
-        case MOV_REG: {
-            bc_reg_t dst; bs->Read(&dst);
-            bc_reg_t src; bs->Read(&src);
-            
-            handler->MovReg(
-                dst,
-                src
-            );
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(LOAD_MEM_HASH) {
+                handler->LoadMemHash(
+                    ins->a,
+                    ins->b,
+                    ins->u32,
+                    ins->imm.cache
+                );
 
-            break;
-        }
-        case HAS_MEM_HASH: {
-            bc_reg_t dst; bs->Read(&dst);
-            bc_reg_t src; bs->Read(&src);
-            uint32_t hash; bs->Read(&hash);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(LOAD_ARRAYIDX) {
+                handler->LoadArrayIdx(
+                    ins->a,
+                    ins->b,
+                    ins->c
+                );
 
-            handler->HasMemHash(
-                dst,
-                src,
-                hash
-            );
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(LOAD_REF) {
+                handler->LoadRef(
+                    ins->a,
+                    ins->b
+                );
 
-            break;
-        }
-        case PUSH: {
-            bc_reg_t reg; bs->Read(&reg);
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_DEREF) {
+                handler->LoadDeref(
+                    ins->a,
+                    ins->b
+                );
 
-            handler->Push(
-                reg
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_NULL) {
+                handler->LoadNull(
+                    ins->a
+                );
 
-            break;
-        }
-        case POP: {
-            handler->Pop();
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_TRUE) {
+                handler->LoadTrue(
+                    ins->a
+                );
 
-            break;
-        }
-        case POP_N: {
-            uint8_t n; bs->Read(&n);
-            
-            handler->PopN(
-                n
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(LOAD_FALSE) {
+                handler->LoadFalse(
+                    ins->a
+                );
 
-            break;
-        }
-        case PUSH_ARRAY: {
-            bc_reg_t dst; bs->Read(&dst);
-            bc_reg_t src; bs->Read(&src);
+                VM_NEXT();
+            }
+            VM_TARGET(MOV_OFFSET) {
+                handler->MovOffset<Checked>(
+                    ins->u32,
+                    ins->a
+                );
 
-            handler->PushArray(
-                dst,
-                src
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(MOV_LOCAL) {
+                handler->MovLocal<Checked>(
+                    ins->u32,
+                    ins->a
+                );
 
-            break;
-        }
-        case ECHO: {
-            bc_reg_t reg; bs->Read(&reg);
-            handler->Echo(
-                reg
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(MOV_INDEX) {
+                handler->MovIndex<Checked>(
+                    ins->u32,
+                    ins->a
+                );
 
-            break;
-        }
-        case ECHO_NEWLINE: {
-            handler->EchoNewline();
+                VM_NEXT();
+            }
+            VM_TARGET(MOV_MEM) {
+                handler->MovMem(
+                    ins->a,
+                    ins->b,
+                    ins->c
+                );
 
-            break;
-        }
-        case JMP: {
-            //bc_reg_t reg; bs->Read(&reg);
-            bc_address_t addr;
-            bs->Read(&addr);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(MOV_MEM_HASH) {
+                handler->MovMemHash(
+                    ins->a,
+                    ins->u32,
+                    ins->b,
+                    ins->imm.cache
+                );
 
-            handler->Jmp(
-                addr
-            );
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(MOV_ARRAYIDX) {
+                handler->MovArrayIdx(
+                    ins->a,
+                    ins->u32,
+                    ins->b
+                );
 
-            break;
-        }
-        case JE: {
-            bc_address_t addr;
-            bs->Read(&addr);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(MOV_REG) {
+                handler->MovReg(
+                    ins->a,
+                    ins->b
+                );
 
-            handler->Je(
-                addr
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(HAS_MEM_HASH) {
+                handler->HasMemHash(
+                    ins->a,
+                    ins->b,
+                    ins->u32,
+                    ins->imm.cache
+                );
 
-            break;
-        }
-        case JNE: {
-            bc_address_t addr;
-            bs->Read(&addr);
+                VM_NEXT();
+            }
+            VM_TARGET(PUSH) {
+                handler->Push<Checked>(
+                    ins->a
+                );
 
-            handler->Jne(
-                addr
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(POP) {
+                handler->Pop<Checked>();
 
-            break;
-        }
-        case JG: {
-            bc_address_t addr;
-            bs->Read(&addr);
+                VM_NEXT();
+            }
+            VM_TARGET(POP_N) {
+                handler->PopN<Checked>(
+                    ins->a
+                );
 
-            handler->Jg(
-                addr
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(PUSH_ARRAY) {
+                handler->PushArray(
+                    ins->a,
+                    ins->b
+                );
 
-            break;
-        }
-        case JGE: {
-            bc_address_t addr;
-            bs->Read(&addr);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(ECHO) {
+                handler->Echo(
+                    ins->a
+                );
 
-            handler->Jge(
-                addr
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(ECHO_NEWLINE) {
+                handler->EchoNewline();
 
-            break;
-        }
-        case CALL: {
-            bc_reg_t reg; bs->Read(&reg);
-            uint8_t nargs; bs->Read(&nargs);
+                VM_NEXT();
+            }
+            VM_TARGET(JMP) {
+                handler->Jmp(
+                    ins->u32
+                );
 
-            handler->Call(
-                reg,
-                nargs
-            );
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(JE) {
+                handler->Je(
+                    ins->u32
+                );
 
-            break;
-        }
-        case RET: {
-            handler->Ret();
-            
-            break;
-        }
-        case BEGIN_TRY: {
-            bc_address_t catch_address;
-            bs->Read(&catch_address);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(JNE) {
+                handler->Jne(
+                    ins->u32
+                );
 
-            handler->BeginTry(
-                catch_address
-            );
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(JG) {
+                handler->Jg(
+                    ins->u32
+                );
 
-            break;
-        }
-        case END_TRY: {
-            handler->EndTry();
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(JGE) {
+                handler->Jge(
+                    ins->u32
+                );
 
-            break;
-        }
-        case NEW: {
-            bc_reg_t dst; bs->Read(&dst);
-            bc_reg_t src; bs->Read(&src);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(CALL) {
+                handler->Call(
+                    ins->a,
+                    ins->b
+                );
 
-            handler->New(
-                dst,
-                src
-            );
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(CALL_STATIC) {
+                handler->CallStatic<Checked>(
+                    ins->u32,
+                    ins->imm.addr,
+                    ins->a
+                );
 
-            break;
-        }
-        case NEW_ARRAY: {
-            bc_reg_t dst; bs->Read(&dst);
-            uint32_t size; bs->Read(&size);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(CALL_METHOD) {
+                handler->CallMethod(
+                    ins->u32,
+                    ins->a,
+                    ins->imm.cache
+                );
 
-            handler->NewArray(
-                dst,
-                size
-            );
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(TAIL_CALL) {
+                handler->TailCall(
+                    ins->a,
+                    ins->b
+                );
 
-            break;
-        }
-        case CMP: {
-            bc_reg_t lhs_reg; bs->Read(&lhs_reg);
-            bc_reg_t rhs_reg; bs->Read(&rhs_reg);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(RET) {
+                handler->Ret();
 
-            handler->Cmp(
-                lhs_reg,
-                rhs_reg
-            );
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(BEGIN_TRY) {
+                handler->BeginTry(
+                    ins->u32
+                );
 
-            break;
-        }
-        case CMPZ: {
-            bc_reg_t reg; bs->Read(&reg);
+                VM_NEXT();
+            }
+            VM_TARGET(END_TRY) {
+                handler->EndTry();
 
-            handler->CmpZ(
-                reg
-            );
+                VM_NEXT();
+            }
+            VM_TARGET(NEW) {
+                handler->New(
+                    ins->a,
+                    ins->b
+                );
 
-            break;
-        }
-        case ADD: {
-            bc_reg_t lhs_reg; bs->Read(&lhs_reg);
-            bc_reg_t rhs_reg; bs->Read(&rhs_reg);
-            bc_reg_t dst_reg; bs->Read(&dst_reg);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(NEW_ARRAY) {
+                handler->NewArray(
+                    ins->a,
+                    ins->u32
+                );
 
-            handler->Add(
-                lhs_reg,
-                rhs_reg,
-                dst_reg
-            );
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(CMP) {
+                Quicken(handler, ins);
 
-            break;
-        }
-        case SUB: {
-            bc_reg_t lhs_reg; bs->Read(&lhs_reg);
-            bc_reg_t rhs_reg; bs->Read(&rhs_reg);
-            bc_reg_t dst_reg; bs->Read(&dst_reg);
+                handler->Cmp(
+                    ins->a,
+                    ins->b
+                );
 
-            handler->Sub(
-                lhs_reg,
-                rhs_reg,
-                dst_reg
-            );
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(CMPZ) {
+                handler->CmpZ(
+                    ins->a
+                );
 
-            break;
-        }
-        case MUL: {
-            bc_reg_t lhs_reg; bs->Read(&lhs_reg);
-            bc_reg_t rhs_reg; bs->Read(&rhs_reg);
-            bc_reg_t dst_reg; bs->Read(&dst_reg);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(ADD) {
+                Quicken(handler, ins);
 
-            handler->Mul(
-                lhs_reg,
-                rhs_reg,
-                dst_reg
-            );
+                handler->Add(
+                    ins->a,
+                    ins->b,
+                    ins->c
+                );
 
-            break;
-        }
-        case DIV: {
-            bc_reg_t lhs_reg; bs->Read(&lhs_reg);
-            bc_reg_t rhs_reg; bs->Read(&rhs_reg);
-            bc_reg_t dst_reg; bs->Read(&dst_reg);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(SUB) {
+                Quicken(handler, ins);
 
-            handler->Div(
-                lhs_reg,
-                rhs_reg,
-                dst_reg
-            );
+                handler->Sub(
+                    ins->a,
+                    ins->b,
+                    ins->c
+                );
 
-            break;
-        }
-        case MOD: {
-            bc_reg_t lhs_reg; bs->Read(&lhs_reg);
-            bc_reg_t rhs_reg; bs->Read(&rhs_reg);
-            bc_reg_t dst_reg; bs->Read(&dst_reg);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(MUL) {
+                Quicken(handler, ins);
 
-            handler->Mod(
-                lhs_reg,
-                rhs_reg,
-                dst_reg
-            );
+                handler->Mul(
+                    ins->a,
+                    ins->b,
+                    ins->c
+                );
 
-            break;
-        }
-        case AND: {
-            bc_reg_t lhs_reg; bs->Read(&lhs_reg);
-            bc_reg_t rhs_reg; bs->Read(&rhs_reg);
-            bc_reg_t dst_reg; bs->Read(&dst_reg);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(DIV) {
+                Quicken(handler, ins);
 
-            handler->And(
-                lhs_reg,
-                rhs_reg,
-                dst_reg
-            );
+                handler->Div(
+                    ins->a,
+                    ins->b,
+                    ins->c
+                );
 
-            break;
-        }
-        case OR: {
-            bc_reg_t lhs_reg; bs->Read(&lhs_reg);
-            bc_reg_t rhs_reg; bs->Read(&rhs_reg);
-            bc_reg_t dst_reg; bs->Read(&dst_reg);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(MOD) {
+                Quicken(handler, ins);
 
-            handler->Or(
-                lhs_reg,
-                rhs_reg,
-                dst_reg
-            );
+                handler->Mod(
+                    ins->a,
+                    ins->b,
+                    ins->c
+                );
 
-            break;
-        }
-        case XOR: {
-            bc_reg_t lhs_reg; bs->Read(&lhs_reg);
-            bc_reg_t rhs_reg; bs->Read(&rhs_reg);
-            bc_reg_t dst_reg; bs->Read(&dst_reg);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(AND) {
+                handler->And(
+                    ins->a,
+                    ins->b,
+                    ins->c
+                );
 
-            handler->Xor(
-                lhs_reg,
-                rhs_reg,
-                dst_reg
-            );
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(OR) {
+                handler->Or(
+                    ins->a,
+                    ins->b,
+                    ins->c
+                );
 
-            break;
-        }
-        case SHL: {
-            bc_reg_t lhs_reg; bs->Read(&lhs_reg);
-            bc_reg_t rhs_reg; bs->Read(&rhs_reg);
-            bc_reg_t dst_reg; bs->Read(&dst_reg);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(XOR) {
+                handler->Xor(
+                    ins->a,
+                    ins->b,
+                    ins->c
+                );
 
-            handler->Shl(
-                lhs_reg,
-                rhs_reg,
-                dst_reg
-            );
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(SHL) {
+                handler->Shl(
+                    ins->a,
+                    ins->b,
+                    ins->c
+                );
 
-            break;
-        }
-        case SHR: {
-            bc_reg_t lhs_reg; bs->Read(&lhs_reg);
-            bc_reg_t rhs_reg; bs->Read(&rhs_reg);
-            bc_reg_t dst_reg; bs->Read(&dst_reg);
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(SHR) {
+                handler->Shr(
+                    ins->a,
+                    ins->b,
+                    ins->c
+                );
+
+                VM_NEXT_CHECKED();
+            }
+            VM_TARGET(NEG) {
+                handler->Neg(
+                    ins->a
+                );
 
-            handler->Shr(
-                lhs_reg,
-                rhs_reg,
-                dst_reg
-            );
+                VM_NEXT_CHECKED();
+            }
+            VM_QUICKENED(ADD_I32, ADD, ArithI32<AddOp>, Add, ins->a, ins->b, ins->c)
+            VM_QUICKENED(ADD_I64, ADD, ArithI64<AddOp>, Add, ins->a, ins->b, ins->c)
+            VM_QUICKENED(ADD_F32, ADD, ArithF32<AddOp>, Add, ins->a, ins->b, ins->c)
+            VM_QUICKENED(ADD_F64, ADD, ArithF64<AddOp>, Add, ins->a, ins->b, ins->c)
+            VM_QUICKENED(SUB_I32, SUB, ArithI32<SubOp>, Sub, ins->a, ins->b, ins->c)
+            VM_QUICKENED(SUB_I64, SUB, ArithI64<SubOp>, Sub, ins->a, ins->b, ins->c)
+            VM_QUICKENED(SUB_F32, SUB, ArithF32<SubOp>, Sub, ins->a, ins->b, ins->c)
+            VM_QUICKENED(SUB_F64, SUB, ArithF64<SubOp>, Sub, ins->a, ins->b, ins->c)
+            VM_QUICKENED(MUL_I32, MUL, ArithI32<MulOp>, Mul, ins->a, ins->b, ins->c)
+            VM_QUICKENED(MUL_I64, MUL, ArithI64<MulOp>, Mul, ins->a, ins->b, ins->c)
+            VM_QUICKENED(MUL_F32, MUL, ArithF32<MulOp>, Mul, ins->a, ins->b, ins->c)
+            VM_QUICKENED(MUL_F64, MUL, ArithF64<MulOp>, Mul, ins->a, ins->b, ins->c)
+            VM_QUICKENED(DIV_I32, DIV, ArithI32<DivOp>, Div, ins->a, ins->b, ins->c)
+            VM_QUICKENED(DIV_I64, DIV, ArithI64<DivOp>, Div, ins->a, ins->b, ins->c)
+            VM_QUICKENED(DIV_F32, DIV, ArithF32<DivOp>, Div, ins->a, ins->b, ins->c)
+            VM_QUICKENED(DIV_F64, DIV, ArithF64<DivOp>, Div, ins->a, ins->b, ins->c)
+            VM_QUICKENED(MOD_I32, MOD, ArithI32<ModOp>, Mod, ins->a, ins->b, ins->c)
+            VM_QUICKENED(MOD_I64, MOD, ArithI64<ModOp>, Mod, ins->a, ins->b, ins->c)
+            VM_QUICKENED(MOD_F32, MOD, ArithF32<ModOp>, Mod, ins->a, ins->b, ins->c)
+            VM_QUICKENED(MOD_F64, MOD, ArithF64<ModOp>, Mod, ins->a, ins->b, ins->c)
+            VM_QUICKENED(CMP_I32, CMP, CmpI32, Cmp, ins->a, ins->b)
+            VM_QUICKENED(CMP_I64, CMP, CmpI64, Cmp, ins->a, ins->b)
+            VM_QUICKENED(CMP_F32, CMP, CmpF32, Cmp, ins->a, ins->b)
+            VM_QUICKENED(CMP_F64, CMP, CmpF64, Cmp, ins->a, ins->b)
+            VM_TARGET(EXIT) {
+                // stay on the EXIT instruction, so that
+                // anything running this thread again stops too
+                handler->pc--;
 
-            break;
+                return;
+            }
+            default:
+#if ACE_VM_COMPUTED_GOTO
+            op_unknown:
+#endif
+            {
+                utf::printf(UTF8_CSTR("unknown instruction '%d' referenced at location: 0x%" PRIx64 "\n"),
+                    ins->opcode, (int64_t)ins->u32);
+                // skip to the end of the program
+                handler->pc = (uint32_t)handler->program->Size() - 1;
+
+                VM_NEXT_CHECKED();
+            }
         }
-        case NEG: {
-            bc_reg_t reg; bs->Read(&reg);
+    }
 
-            handler->Neg(
-                reg
-            );
+    #undef VM_TARGET
+    #undef VM_NEXT
+    #undef VM_NEXT_CHECKED
+    #undef VM_QUICKENED
+}
 
-            break;
-        }
-        default: {
-            int64_t last_pos = (int64_t)bs->Position() - sizeof(uint8_t);
-            utf::printf(UTF8_CSTR("unknown instruction '%d' referenced at location: 0x%" PRIx64 "\n"), code, last_pos);
-            // seek to end of bytecode stream
-            bs->Seek(bs->Size());
+#if ACE_VM_COMPUTED_GOTO
+    #pragma GCC diagnostic pop
+#endif
+
+void VM::Run(InstructionHandler *handler, int stop_depth)
+{
+    ASSERT(handler != nullptr);
+    ASSERT(handler->program != nullptr);
+
+    // verified bytecode does not need bounds checks, as long as the
+    // stack has room for the deepest point of the code it runs
+    // (VM::Invoke makes sure of that for each function call)
+    const bool checked = !handler->program->IsVerified()
+        || handler->thread->m_stack.GetStackPointer()
+            + handler->program->GetMaxStackHeight() >= Stack::STACK_SIZE;
+
+#if ACE_VM_COMPUTED_GOTO
+    if (m_dispatch_mode == DISPATCH_THREADED) {
+        if (checked) {
+            DispatchLoop<true, true>(handler, stop_depth);
+        } else {
+            DispatchLoop<true, false>(handler, stop_depth);
         }
+        return;
+    }
+#endif
+
+    if (checked) {
+        DispatchLoop<false, true>(handler, stop_depth);
+    } else {
+        DispatchLoop<false, false>(handler, stop_depth);
     }
 }
 
@@ -1079,18 +1333,28 @@ void VM::Execute(BytecodeStream *bs)
     ASSERT(bs != nullptr);
     ASSERT(m_state.GetNumThreads() > 0);
 
+    // decode the whole buffer, and start from the instruction
+    // at the stream's current position
+    m_program.Decode(*bs);
+
+    BytecodeVerifier verifier(&m_program);
+    if (verifier.Verify()) {
+        m_program.SetVerified(verifier.GetMaxStackHeight());
+    }
+
     InstructionHandler handler(
         &m_state,
         m_state.MAIN_THREAD,
-        bs
+        bs,
+        &m_program,
+        m_program.IndexOf((bc_address_t)bs->Position())
     );
 
-    uint8_t code;
+    m_state.BeginExecution();
 
-    while (!bs->Eof() && m_state.good) {
-        bs->Read(&code);
-        HandleInstruction(&handler, code);
-    }
+    Run(&handler);
+
+    m_state.EndExecution();
 }
 
 } // namespace vm
@@ -1,19 +1,36 @@
 #include <ace-vm/VMState.hpp>
+#include <ace-vm/VM.hpp>
+#include <ace-vm/HeapValue.hpp>
+#include <ace-vm/TypeInfo.hpp>
+#include <ace-vm/ParallelMarker.hpp>
 
 #include <common/utf8.hpp>
 
 #include <algorithm>
+#include <chrono>
 #include <thread>
 #include <iostream>
-#include <cmath>
 #include <mutex>
 
 namespace ace {
 namespace vm {
 
-static std::mutex mtx;
+// the number of nested BeginExecution() calls made on this native thread.
+// a thread with a depth above zero is counted in VMState::m_num_running.
+static thread_local int t_execution_depth = 0;
+
+// calls listed when an exception is not handled
+static const size_t MAX_TRACE_FRAMES = 16;
 
 VMState::VMState()
+    : m_num_threads(0),
+      m_gc_growth(GC_DEFAULT_GROWTH),
+      m_heap_limit(0),
+      m_next_gc_bytes(GC_MIN_HEAP_BYTES),
+      m_gc_step_budget(0),
+      m_gc_phase(GC_IDLE),
+      m_stw_requested(false),
+      m_num_running(0)
 {
     for (int i = 0; i < VM_MAX_THREADS; i++) {
         m_threads[i] = nullptr;
@@ -22,6 +39,10 @@ VMState::VMState()
 
 VMState::~VMState()
 {
+    // the VM's program is destroyed before its state is,
+    // so there is nothing left to tell about the reset
+    m_vm = non_owning_ptr<VM>();
+
     Reset();
 }
 
@@ -29,14 +50,33 @@ void VMState::Reset()
 {
     // purge the heap
     m_heap.Purge();
-    // reset heap threshold
-    m_max_heap_objects = GC_THRESHOLD_MIN;
+    // drop any collection that was under way
+    m_gc_phase = GC_IDLE;
+    // start pacing from an empty heap
+    UpdateGCTrigger();
     // purge static memory
     m_static_memory.Purge();
 
     for (int i = 0; i < VM_MAX_THREADS; i++) {
         DestroyThread(i);
     }
+    // everything in here has been purged
+    m_remembered.clear();
+    m_mark_stack.Clear();
+
+    // free interned types and strings, and make sure the
+    // program does not keep handing out the freed values
+    {
+        std::lock_guard<std::mutex> lock(m_types_mtx);
+        m_types.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_strings_mtx);
+        m_strings.clear();
+    }
+    if (m_vm != nullptr) {
+        m_vm->GetProgram().ForgetInterned();
+    }
 
     // we're good to go
     good = true;
@@ -56,70 +96,546 @@ void VMState::ThrowException(ExecutionThread *thread, const Exception &exception
                 thread->m_id + 1, UTF8_TOWIDE(exception.ToString()));
         }
 
+        // the calls it was thrown from, innermost first
+        const size_t depth = thread->m_frames.GetDepth();
+        for (size_t i = depth; i > 0 && i + MAX_TRACE_FRAMES > depth; i--) {
+            utf::printf(UTF8_CSTR("    in function @(%x)\n"),
+                (unsigned)thread->m_frames[i].function_address);
+        }
+        if (depth > MAX_TRACE_FRAMES) {
+            utf::printf(UTF8_CSTR("    ... and %u more\n"),
+                (unsigned)(depth - MAX_TRACE_FRAMES));
+        }
+
         good = false;
     }
 }
 
+HeapValue *VMState::InternType(const char *name, size_t size, char **names)
+{
+    std::string key(name);
+    for (size_t i = 0; i < size; i++) {
+        key += '\0';
+        key += names[i];
+    }
+
+    std::lock_guard<std::mutex> lock(m_types_mtx);
+
+    std::unique_ptr<HeapValue> &type = m_types[key];
+    if (type == nullptr) {
+        type.reset(new HeapValue());
+        type->Assign(TypeInfo(name, size, names));
+        // never collected, so there is no need to remember
+        // objects that refer to it
+        type->GetFlags() |= GC_OLD;
+    }
+
+    return type.get();
+}
+
+HeapValue *VMState::InternString(const char *str, size_t len)
+{
+    std::lock_guard<std::mutex> lock(m_strings_mtx);
+
+    std::unique_ptr<HeapValue> &string = m_strings[std::string(str, len)];
+    if (string == nullptr) {
+        string.reset(new HeapValue());
+        string->Assign(ImmutableString::Intern(str, len));
+        string->GetFlags() |= GC_OLD;
+    }
+
+    return string.get();
+}
+
 HeapValue *VMState::HeapAlloc(ExecutionThread *thread)
 {
     ASSERT(thread != nullptr);
 
-    const size_t heap_size = m_heap.Size();
-        
-    if (heap_size >= m_max_heap_objects) {
-        if (heap_size >= GC_THRESHOLD_MAX) {
-            // heap overflow.
-            char buffer[256];
-            std::sprintf(
-                buffer,
-                "heap overflow, heap size is %zu, max is %zu",
-                heap_size,
-                GC_THRESHOLD_MAX
-            );
-            ThrowException(thread, Exception(buffer));
+    LockHeap();
+    std::lock_guard<std::mutex> lock(m_heap_mtx, std::adopt_lock);
+
+    // by the time a thread allocates again, it has filled in the value
+    // it allocated before, so the memory that value owns is known.
+    if (thread->m_last_alloc != nullptr) {
+        m_heap.CountBytes(thread->m_last_alloc->GetSize());
+        thread->m_last_alloc = nullptr;
+    }
+
+    if (m_gc_phase != GC_IDLE) {
+        // an incremental collection is under way
+        StopTheWorld();
+
+        if (m_heap_limit != 0 && m_heap.GetNumBytes() >= m_heap_limit) {
+            // no time to go step by step
+            FinishIncrementalCollection();
+        } else {
+            IncrementalStep(m_gc_step_budget);
+        }
+
+        ResumeTheWorld();
+
+        if (!CheckHeapLimit(thread)) {
             return nullptr;
         }
+    } else {
+        const bool full_gc_due = m_heap.GetNumBytes() >= m_next_gc_bytes;
 
-        if (enable_auto_gc) {
+        if (full_gc_due || m_heap.GetNumYoungBytes() >= GC_NURSERY_BYTES) {
             // run the gc
-            GC();
-
-            // check if size is still over the maximum,
-            // and resize the maximum if necessary.
-            if (m_heap.Size() >= m_max_heap_objects) {
-                // resize max number of objects
-                m_max_heap_objects = std::min(
-                    1 << (unsigned)std::ceil(std::log(m_max_heap_objects) / std::log(2.0)),
-                    GC_THRESHOLD_MAX
-                );
+            StopTheWorld();
+            StartCollection(full_gc_due);
+            ResumeTheWorld();
+
+            // the limit is only enforced after a full collection
+            if (full_gc_due && m_gc_phase == GC_IDLE && !CheckHeapLimit(thread)) {
+                return nullptr;
             }
         }
     }
 
-    return m_heap.Alloc();
+    thread->m_last_alloc = m_heap.Alloc();
+
+    return thread->m_last_alloc;
+}
+
+bool VMState::CheckHeapLimit(ExecutionThread *thread)
+{
+    if (m_heap_limit == 0 || m_heap.GetNumBytes() < m_heap_limit) {
+        return true;
+    }
+
+    // heap overflow.
+    char buffer[256];
+    std::sprintf(
+        buffer,
+        "heap overflow, heap size is %zu bytes, limit is %zu bytes",
+        m_heap.GetNumBytes(),
+        m_heap_limit
+    );
+    ThrowException(thread, Exception(buffer));
+
+    return false;
+}
+
+void VMState::NoteGrowth(ExecutionThread *thread, HeapValue *value, size_t num_bytes)
+{
+    ASSERT(thread != nullptr);
+    ASSERT(value != nullptr);
+
+    // the whole of the last value allocated is counted
+    // when the thread allocates again (see HeapAlloc)
+    if (value == thread->m_last_alloc) {
+        return;
+    }
+
+    LockHeap();
+    std::lock_guard<std::mutex> lock(m_heap_mtx, std::adopt_lock);
+
+    // a minor collection only recounts the values it promotes,
+    // so growth of an old value is counted with the old ones
+    if (value->GetFlags() & GC_OLD) {
+        m_heap.CountOldBytes(num_bytes);
+    } else {
+        m_heap.CountBytes(num_bytes);
+    }
 }
 
 void VMState::GC()
 {
-    std::lock_guard<std::mutex> lock(mtx);
+    LockHeap();
+    std::lock_guard<std::mutex> lock(m_heap_mtx, std::adopt_lock);
+
+    StopTheWorld();
+    // values that died while one was under way are left for this one
+    FinishIncrementalCollection();
+    Collect(true);
+    ResumeTheWorld();
+}
+
+void VMState::StartCollection(bool full)
+{
+    if (full && m_gc_step_budget != 0) {
+        BeginIncrementalCollection();
+    } else {
+        Collect(full);
+    }
+}
+
+void VMState::Collect(bool full)
+{
+    typedef std::chrono::steady_clock clock;
+    typedef std::chrono::duration<double> seconds;
 
-    // mark stack objects on each thread
+    const clock::time_point start = clock::now();
+
+    if (full && m_gc_workers != nullptr) {
+        // seed the workers with the stack and registers of each thread
+        ParallelMarker marker(m_gc_workers.get());
+
+        for (int i = 0; i < VM_MAX_THREADS; i++) {
+            if (ExecutionThread *thread = m_threads[i]) {
+                const Value *data = thread->m_stack.GetData();
+                const size_t sp = thread->m_stack.GetStackPointer();
+
+                for (size_t j = 0; j < sp; j++) {
+                    marker.Shade(data[j]);
+                }
+
+                for (int j = 0; j < VM_NUM_REGISTERS; j++) {
+                    marker.Shade(thread->m_regs[j]);
+                }
+
+                for (const Value &value : thread->m_handles) {
+                    marker.Shade(value);
+                }
+            }
+        }
+
+        marker.Run();
+    } else {
+        m_mark_stack.SetSkipFlags(full ? GC_MARKED : (GC_MARKED | GC_OLD));
+
+        // mark stack objects on each thread
+        ShadeRoots();
+
+        if (!full) {
+            // young values that only old values refer to
+            for (HeapValue *hv : m_remembered) {
+                m_mark_stack.ScanReferences(hv);
+            }
+
+            for (int i = 0; i < VM_MAX_THREADS; i++) {
+                if (m_threads[i] != nullptr) {
+                    for (HeapValue *hv : m_threads[i]->m_remembered) {
+                        m_mark_stack.ScanReferences(hv);
+                    }
+                }
+            }
+        }
+
+        DrainMarkStack();
+    }
+
+    const clock::time_point marked = clock::now();
+
+    // there are no young values left after either kind of
+    // collection, so nothing needs to be remembered any more
+    ForgetRemembered();
+
+    if (full) {
+        m_heap.Sweep(m_gc_workers.get());
+    } else {
+        m_heap.SweepYoung();
+    }
+
+    // the sweep has counted everything that is left exactly
     for (int i = 0; i < VM_MAX_THREADS; i++) {
         if (m_threads[i] != nullptr) {
-            m_threads[i]->m_stack.MarkAll();
+            m_threads[i]->m_last_alloc = nullptr;
+        }
+    }
+
+    if (full) {
+        UpdateGCTrigger();
+    }
+
+    const clock::time_point end = clock::now();
+
+    m_gc_stats.num_collections++;
+    if (!full) {
+        m_gc_stats.num_minor_collections++;
+    }
+    CountPause(seconds(marked - start).count(), seconds(end - marked).count());
+}
+
+void VMState::CountPause(double mark_time, double sweep_time)
+{
+    m_gc_stats.mark_time += mark_time;
+    m_gc_stats.sweep_time += sweep_time;
+    m_gc_stats.max_pause = std::max(m_gc_stats.max_pause, mark_time + sweep_time);
+}
+
+void VMState::ShadeRoots()
+{
+    for (int i = 0; i < VM_MAX_THREADS; i++) {
+        if (ExecutionThread *thread = m_threads[i]) {
+            const Value *data = thread->m_stack.GetData();
+            const size_t sp = thread->m_stack.GetStackPointer();
+
+            for (size_t j = 0; j < sp; j++) {
+                m_mark_stack.Shade(data[j]);
+            }
+
             for (int j = 0; j < VM_NUM_REGISTERS; j++) {
-                m_threads[i]->GetRegisters()[j].Mark();
+                m_mark_stack.Shade(thread->m_regs[j]);
+            }
+
+            for (const Value &value : thread->m_handles) {
+                m_mark_stack.Shade(value);
+
+                // natives store into the values they have rooted without
+                // a write barrier, so those are scanned again even if they
+                // are marked or old already
+                if (value.GetType() == Value::HEAP_POINTER && value.GetHeapPointer() != nullptr) {
+                    m_mark_stack.ScanReferences(value.GetHeapPointer());
+                }
+            }
+        }
+    }
+}
+
+void VMState::DrainMarkStack()
+{
+    m_mark_stack.Drain(SIZE_MAX);
+
+    // values that did not fit on the stack are marked, but their
+    // references have not been looked at. they are found again by
+    // going over the references of everything that is marked.
+    while (m_mark_stack.HasOverflowed()) {
+        m_mark_stack.ClearOverflow();
+
+        m_heap.ForEachValue([this](HeapValue *hv) {
+            if (hv->GetFlags() & GC_MARKED) {
+                m_mark_stack.ScanReferences(hv);
+                m_mark_stack.Drain(SIZE_MAX);
+            }
+        });
+    }
+}
+
+void VMState::TakeGreyValues()
+{
+    for (int i = 0; i < VM_MAX_THREADS; i++) {
+        if (ExecutionThread *thread = m_threads[i]) {
+            m_mark_stack.PushMarked(thread->m_grey);
+            thread->m_grey.clear();
+        }
+    }
+}
+
+void VMState::BeginIncrementalCollection()
+{
+    typedef std::chrono::steady_clock clock;
+    typedef std::chrono::duration<double> seconds;
+
+    const clock::time_point start = clock::now();
+
+    ASSERT(m_gc_phase == GC_IDLE);
+    ASSERT(m_mark_stack.IsEmpty());
+
+    m_gc_phase = GC_MARKING;
+    m_mark_stack.SetSkipFlags(GC_MARKED);
+
+    ShadeRoots();
+
+    m_gc_stats.num_steps++;
+    CountPause(seconds(clock::now() - start).count(), 0.0);
+}
+
+void VMState::IncrementalStep(size_t budget)
+{
+    typedef std::chrono::steady_clock clock;
+    typedef std::chrono::duration<double> seconds;
+
+    const clock::time_point start = clock::now();
+
+    if (m_gc_phase == GC_MARKING) {
+        TakeGreyValues();
+        m_mark_stack.Drain(budget);
+
+        if (m_mark_stack.IsEmpty()) {
+            FinishMarking();
+        }
+
+        CountPause(seconds(clock::now() - start).count(), 0.0);
+    } else {
+        ASSERT(m_gc_phase == GC_SWEEPING);
+
+        // allocation sweeps pages too, and may have finished it
+        if (!m_heap.IsSweeping() || m_heap.SweepStep(budget)) {
+            m_gc_phase = GC_IDLE;
+            UpdateGCTrigger();
+            m_gc_stats.num_collections++;
+        }
+
+        CountPause(0.0, seconds(clock::now() - start).count());
+    }
+
+    m_gc_stats.num_steps++;
+}
+
+void VMState::FinishMarking()
+{
+    // the stacks and registers have changed since they were
+    // first shaded, without going through the write barrier
+    ShadeRoots();
+    TakeGreyValues();
+    DrainMarkStack();
+
+    // everything that is left will be old
+    ForgetRemembered();
+
+    // values that are freed by the sweep must not be counted later
+    for (int i = 0; i < VM_MAX_THREADS; i++) {
+        if (m_threads[i] != nullptr) {
+            m_threads[i]->m_last_alloc = nullptr;
+        }
+    }
+
+    m_heap.BeginSweep();
+    m_gc_phase = GC_SWEEPING;
+}
+
+void VMState::FinishIncrementalCollection()
+{
+    while (m_gc_phase != GC_IDLE) {
+        IncrementalStep(SIZE_MAX);
+    }
+}
+
+void VMState::ForgetRemembered()
+{
+    // values freed by a full sweep may be in here, so
+    // this has to be done before sweeping
+    for (HeapValue *hv : m_remembered) {
+        hv->GetFlags() &= ~GC_REMEMBERED;
+    }
+    m_remembered.clear();
+
+    for (int i = 0; i < VM_MAX_THREADS; i++) {
+        if (m_threads[i] != nullptr) {
+            for (HeapValue *hv : m_threads[i]->m_remembered) {
+                hv->GetFlags() &= ~GC_REMEMBERED;
             }
+            m_threads[i]->m_remembered.clear();
         }
     }
+}
 
-    m_heap.Sweep();
+void VMState::UpdateGCTrigger()
+{
+    const size_t live_bytes = m_heap.GetNumBytes();
 
-    //utf::cout << "gc()\n";
+    m_next_gc_bytes = std::max(
+        live_bytes + live_bytes / 100 * m_gc_growth,
+        (size_t)GC_MIN_HEAP_BYTES
+    );
+
+    if (m_heap_limit != 0) {
+        // collect before giving up on an allocation
+        m_next_gc_bytes = std::min(m_next_gc_bytes, m_heap_limit);
+    }
+}
+
+void VMState::SetGCGrowth(unsigned percent)
+{
+    m_gc_growth = percent;
+    UpdateGCTrigger();
+}
+
+void VMState::SetHeapLimit(size_t num_bytes)
+{
+    m_heap_limit = num_bytes;
+    UpdateGCTrigger();
+}
+
+void VMState::SetIncrementalGC(size_t step_budget)
+{
+    m_gc_step_budget = step_budget;
+}
+
+void VMState::SetGCWorkers(size_t num_workers)
+{
+    if (num_workers > 1) {
+        m_gc_workers.reset(new GCWorkerPool(num_workers));
+    } else {
+        m_gc_workers.reset();
+    }
+}
+
+void VMState::BeginExecution()
+{
+    if (t_execution_depth++ == 0) {
+        std::unique_lock<std::mutex> lock(m_safepoint_mtx);
+        // do not start running in the middle of a pause
+        m_safepoint_cv.wait(lock, [this] { return !m_stw_requested.load(); });
+        m_num_running++;
+    }
+}
+
+void VMState::EndExecution()
+{
+    ASSERT(t_execution_depth > 0);
+
+    if (--t_execution_depth == 0) {
+        std::lock_guard<std::mutex> lock(m_safepoint_mtx);
+        m_num_running--;
+        m_safepoint_cv.notify_all();
+    }
+}
+
+void VMState::ParkAtSafepoint()
+{
+    // parking is just an empty safe region:
+    // leaving it blocks until the world is resumed.
+    EnterSafeRegion();
+    LeaveSafeRegion();
+}
+
+void VMState::EnterSafeRegion()
+{
+    if (t_execution_depth == 0) {
+        // not a running thread, nothing to wait on
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_safepoint_mtx);
+    m_num_running--;
+    m_safepoint_cv.notify_all();
+}
+
+void VMState::LeaveSafeRegion()
+{
+    if (t_execution_depth == 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_safepoint_mtx);
+    m_safepoint_cv.wait(lock, [this] { return !m_stw_requested.load(); });
+    m_num_running++;
+}
+
+void VMState::LockHeap()
+{
+    // the holder of m_heap_mtx may be waiting for us to park,
+    // so block on it from within a safe region.
+    EnterSafeRegion();
+    m_heap_mtx.lock();
+    LeaveSafeRegion();
+}
+
+void VMState::StopTheWorld()
+{
+    std::unique_lock<std::mutex> lock(m_safepoint_mtx);
+    m_stw_requested.store(true, std::memory_order_release);
+
+    // wait for everyone but ourselves to reach a safepoint
+    const int self = t_execution_depth > 0 ? 1 : 0;
+    m_safepoint_cv.wait(lock, [this, self] { return m_num_running == self; });
+}
+
+void VMState::ResumeTheWorld()
+{
+    std::lock_guard<std::mutex> lock(m_safepoint_mtx);
+    m_stw_requested.store(false, std::memory_order_release);
+    m_safepoint_cv.notify_all();
 }
 
 ExecutionThread *VMState::CreateThread()
 {
+    LockHeap();
+    std::lock_guard<std::mutex> lock(m_heap_mtx, std::adopt_lock);
+
     ASSERT(m_num_threads < VM_MAX_THREADS);
 
     // find a free slot
@@ -142,15 +658,27 @@ void VMState::DestroyThread(int id)
 {
     ASSERT(id < VM_MAX_THREADS);
 
+    LockHeap();
+    std::lock_guard<std::mutex> lock(m_heap_mtx, std::adopt_lock);
+
     ExecutionThread *thread = m_threads[id];
 
     if (thread != nullptr) {
         // purge the stack
         thread->m_stack.Purge();
+        thread->m_frames.Purge();
         // reset exception state
         thread->m_exception_state.Reset();
         // reset register flags
         thread->m_regs.ResetFlags();
+        // keep the counters around after the thread is gone
+        m_ic_stats.hits += thread->m_ic_stats.hits;
+        m_ic_stats.misses += thread->m_ic_stats.misses;
+        // values it has stored into old ones may still be referenced
+        m_remembered.insert(m_remembered.end(),
+            thread->m_remembered.begin(), thread->m_remembered.end());
+        // and values it has shaded still need to be scanned
+        m_mark_stack.PushMarked(thread->m_grey);
 
         // delete it
         delete m_threads[id];
@@ -160,5 +688,19 @@ void VMState::DestroyThread(int id)
     }
 }
 
+InlineCacheStats VMState::GetInlineCacheStats() const
+{
+    InlineCacheStats stats = m_ic_stats;
+
+    for (int i = 0; i < VM_MAX_THREADS; i++) {
+        if (m_threads[i] != nullptr) {
+            stats.hits += m_threads[i]->m_ic_stats.hits;
+            stats.misses += m_threads[i]->m_ic_stats.misses;
+        }
+    }
+
+    return stats;
+}
+
 } // namespace vm
 } // namespace ace
@@ -2,6 +2,8 @@
 #include <ace-vm/Object.hpp>
 #include <ace-vm/Array.hpp>
 #include <ace-vm/ImmutableString.hpp>
+#include <ace-vm/StringBuilder.hpp>
+#include <ace-vm/NumberFormat.hpp>
 #include <ace-vm/HeapValue.hpp>
 
 #include <common/my_assert.hpp>
@@ -13,200 +15,192 @@
 namespace ace {
 namespace vm {
 
-static const ImmutableString NULL_STRING = ImmutableString("null");
+// interned, so returning them shares the data rather than copying it
+static const ImmutableString NULL_STRING = ImmutableString::Intern("null");
 static const ImmutableString BOOLEAN_STRINGS[2] = {
-    ImmutableString("false"),
-    ImmutableString("true")
+    ImmutableString::Intern("false"),
+    ImmutableString::Intern("true")
 };
 
+#ifdef ACE_NAN_BOXING
 Value::Value(const Value &other)
-    : m_type(other.m_type),
-      m_value(other.m_value)
+    : m_bits(other.m_bits)
 {
 }
-
-void Value::Mark()
+#else
+Value::Value(const Value &other)
+    : m_type(other.m_type),
+      m_value(other.m_value)
 {
-    switch (m_type) {
-        case Value::VALUE_REF:
-            ASSERT(m_value.value_ref != nullptr);
-            m_value.value_ref->Mark();
-            break;
-        
-        case Value::HEAP_POINTER: {
-            HeapValue *ptr = m_value.ptr;
-            if (ptr != nullptr && !(ptr->GetFlags() & GC_MARKED)) {
-                if (Object *object = ptr->GetPointer<Object>()) {
-                    const vm::TypeInfo *type_ptr = object->GetTypePtr();
-                    ASSERT(type_ptr != nullptr);
-
-                    const size_t size = type_ptr->GetSize();
-                    for (size_t i = 0; i < size; i++) {
-                        object->GetMember(i).value.Mark();
-                    }
-
-                    // mark the type
-                    object->GetTypePtrValue().Mark();
-                } else if (Array *array = ptr->GetPointer<Array>()) {
-                    const size_t size = array->GetSize();
-                    for (int i = 0; i < size; i++) {
-                        array->AtIndex(i).Mark();
-                    }
-                }
-
-                ptr->GetFlags() |= GC_MARKED;
-            }
-        }
-
-        default: break;
-    }
 }
+#endif
 
 const char *Value::GetTypeString() const
 {
-    switch (m_type) {
+    switch (GetType()) {
         case I32: // fallthrough
         case I64: return "Int";
         case F32: // fallthrough
         case F64: return "Float";
         case BOOLEAN: return "Boolean";
         case VALUE_REF:
-            ASSERT(m_value.value_ref != nullptr);
-            return m_value.value_ref->GetTypeString();
+            ASSERT(GetValueRef() != nullptr);
+            return GetValueRef()->GetTypeString();
 
         case HEAP_POINTER: 
-            if (m_value.ptr == nullptr) {
+            if (GetHeapPointer() == nullptr) {
                 return "Null";
-            } else if (m_value.ptr->GetPointer<ImmutableString>()) {
-                return "String";
-            } else if (m_value.ptr->GetPointer<Array>()) {
-                return "Array";
-            } else if (Object *object = m_value.ptr->GetPointer<Object>()) {
-                ASSERT(object->GetTypePtr() != nullptr);
-                return object->GetTypePtr()->GetName();
             }
-            return "Object";
+
+            switch (GetHeapPointer()->GetType()) {
+                case HEAP_STRING: return "String";
+                case HEAP_ARRAY: return "Array";
+                case HEAP_OBJECT: {
+                    Object *object = GetHeapPointer()->GetRawPointer<Object>();
+                    ASSERT(object->GetTypePtr() != nullptr);
+                    return object->GetTypePtr()->GetName();
+                }
+                default: return "Object";
+            }
             
         case FUNCTION: return "Function";
         case NATIVE_FUNCTION: return "NativeFunction";
         case ADDRESS: return "Address";
-        case FUNCTION_CALL: return "FunctionCallInfo";
         case TRY_CATCH_INFO: return "TryCatchInfo";
         default: return "??";
     }
 }
 
-ImmutableString Value::ToString() const
-{
-    const size_t buf_size = 256;
-    char buf[buf_size] = {0};
-
-    switch (m_type) {
-        case Value::I32: {
-            int n = snprintf(buf, buf_size, "%d", m_value.i32);
-            return ImmutableString(buf, n);
-        }
-
-        case Value::I64: {
-            int n = snprintf(
-                buf,
-                buf_size,
-                "%" PRId64,
-                m_value.i64
-            );
-            return ImmutableString(buf, n);
-        }
+// longest number that FormatNumber writes, which is
+// more than enough for an int64, a pointer or a %g double
+static const size_t NUMBER_BUF_SIZE = NUMBER_FORMAT_MAX;
 
-        case Value::F32: {
-            int n = snprintf(
-                buf,
-                buf_size,
-                "%g",
-                m_value.f
-            );
-            return ImmutableString(buf, n);
-        }
+// writes a number value into the buffer, returning the
+// number of characters written (without the terminator)
+static inline size_t FormatNumber(const Value &value, char *buf)
+{
+    switch (value.GetType()) {
+        case Value::I32: return FormatI32(value.GetI32(), buf);
+        case Value::I64: return FormatI64(value.GetI64(), buf);
+        case Value::F32: return FormatF32(value.GetF32(), buf);
+        case Value::F64: return FormatF64(value.GetF64(), buf);
+        default: ASSERT_MSG(false, "not a number"); return 0;
+    }
+}
 
+ImmutableString Value::ToString() const
+{
+    switch (GetType()) {
+        case Value::I32: // fallthrough
+        case Value::I64: // fallthrough
+        case Value::F32: // fallthrough
         case Value::F64: {
-            int n = snprintf(
-                buf,
-                buf_size,
-                "%g",
-                m_value.d
-            );
+            char buf[NUMBER_BUF_SIZE];
+            const size_t n = FormatNumber(*this, buf);
             return ImmutableString(buf, n);
         }
 
         case Value::BOOLEAN:
-            return BOOLEAN_STRINGS[m_value.b];
+            return BOOLEAN_STRINGS[GetBoolean()];
 
         case Value::VALUE_REF:
-            ASSERT(m_value.value_ref != nullptr);
-            return m_value.value_ref->ToString();
+            ASSERT(GetValueRef() != nullptr);
+            return GetValueRef()->ToString();
 
         case Value::HEAP_POINTER: {
-            if (m_value.ptr == nullptr) {
+            if (GetHeapPointer() == nullptr) {
                 return NULL_STRING;
-            } else if (ImmutableString *string = m_value.ptr->GetPointer<ImmutableString>()) {
+            } else if (ImmutableString *string = GetHeapPointer()->GetPointer<ImmutableString>()) {
                 return *string;
-            } else if (Array *array = m_value.ptr->GetPointer<Array>()) {
-                std::stringstream ss;
-                array->GetRepresentation(ss, true);
-                const std::string &str = ss.str();
-                return ImmutableString(str.c_str());
-            } else if (Object *object = m_value.ptr->GetPointer<Object>()) {
-                std::stringstream ss;
-                object->GetRepresentation(ss, true);
-                const std::string &str = ss.str();
-                return ImmutableString(str.c_str());
+            }
+
+            // build anything else in place
+            StringBuilder sb;
+            ToString(sb);
+            return sb.Finish();
+        }
+
+        default: return ImmutableString::Intern(GetTypeString());
+    }
+}
+
+void Value::ToString(StringBuilder &out) const
+{
+    switch (GetType()) {
+        case Value::I32: // fallthrough
+        case Value::I64: // fallthrough
+        case Value::F32: // fallthrough
+        case Value::F64:
+            out.Commit(FormatNumber(*this, out.Prepare(NUMBER_BUF_SIZE)));
+            break;
+
+        case Value::BOOLEAN:
+            out.Append(BOOLEAN_STRINGS[GetBoolean()]);
+            break;
+
+        case Value::VALUE_REF:
+            ASSERT(GetValueRef() != nullptr);
+            GetValueRef()->ToString(out);
+            break;
+
+        case Value::HEAP_POINTER:
+            if (GetHeapPointer() == nullptr) {
+                out.Append(NULL_STRING);
+            } else if (ImmutableString *string = GetHeapPointer()->GetPointer<ImmutableString>()) {
+                out.Append(*string);
+            } else if (Array *array = GetHeapPointer()->GetPointer<Array>()) {
+                array->GetRepresentation(out, true);
+            } else if (Object *object = GetHeapPointer()->GetPointer<Object>()) {
+                object->GetRepresentation(out, true);
             } else {
-                // return memory address as string
-                int n = snprintf(buf, buf_size, "%p", (void*)m_value.ptr);
-                return ImmutableString(buf, n);
+                // memory address
+                const int n = snprintf(out.Prepare(NUMBER_BUF_SIZE), NUMBER_BUF_SIZE,
+                    "%p", (void*)GetHeapPointer());
+                out.Commit(n > 0 ? (size_t)n : 0);
             }
 
             break;
-        }
 
-        default: return ImmutableString(GetTypeString());
+        default:
+            out.Append(GetTypeString());
     }
 }
 
-void Value::ToRepresentation(std::stringstream &ss, bool add_type_name) const
+void Value::ToRepresentation(StringBuilder &out, bool add_type_name) const
 {
-    switch (m_type) {
+    switch (GetType()) {
         case Value::VALUE_REF:
-            ASSERT(m_value.value_ref != nullptr);
-            m_value.value_ref->ToRepresentation(ss, add_type_name);
+            ASSERT(GetValueRef() != nullptr);
+            GetValueRef()->ToRepresentation(out, add_type_name);
             return;
 
         case Value::HEAP_POINTER:
-            if (m_value.ptr == nullptr) {
-                ss << "null";
-            } else if (ImmutableString *string = m_value.ptr->GetPointer<ImmutableString>()) {
-                ss << '\"';
-                ss << string->GetData();
-                ss << '\"';
-            } else if (Array *array = m_value.ptr->GetPointer<Array>()) {
-                array->GetRepresentation(ss, add_type_name);
-            } else if (Object *object = m_value.ptr->GetPointer<Object>()) {
-                object->GetRepresentation(ss, add_type_name);
+            if (GetHeapPointer() == nullptr) {
+                out.Append(NULL_STRING);
+            } else if (ImmutableString *string = GetHeapPointer()->GetPointer<ImmutableString>()) {
+                out.Append('\"');
+                out.Append(*string);
+                out.Append('\"');
+            } else if (Array *array = GetHeapPointer()->GetPointer<Array>()) {
+                array->GetRepresentation(out, add_type_name);
+            } else if (Object *object = GetHeapPointer()->GetPointer<Object>()) {
+                object->GetRepresentation(out, add_type_name);
             } else {
                 if (add_type_name) {
-                    ss << GetTypeString();
-                    ss << '(';
+                    out.Append(GetTypeString());
+                    out.Append('(');
                 }
                 
-                ss << ToString().GetData();
+                ToString(out);
 
                 if (add_type_name) {
-                    ss << ')';
+                    out.Append(')');
                 }
             }
 
             break;
         default:
-            ss << ToString().GetData();
+            ToString(out);
     }
 }
 
@@ -178,8 +178,7 @@ void API::ModuleDefine::BindNativeVariable(
 
     // create the object that will be stored
     Value obj;
-    obj.m_type = Value::HEAP_POINTER;
-    obj.m_value.ptr = nullptr;
+    obj.SetHeapPointer(nullptr);
 
     // call the initializer
     def.initializer_ptr(&vm->GetState(), main_thread, &obj);
@@ -31,6 +31,7 @@
 #include <ace-vm/Object.hpp>
 #include <ace-vm/Array.hpp>
 #include <ace-vm/ImmutableString.hpp>
+#include <ace-vm/StringBuilder.hpp>
 #include <ace-vm/Value.hpp>
 #include <ace-vm/InstructionHandler.hpp>
 
@@ -64,20 +65,25 @@ std::vector<std::thread> threads;
 
 std::string exec_path;
 
+// print inline cache counters after running a program (--ic-stats)
+bool print_ic_stats = false;
+// print garbage collector timings after running a program (--gc-stats)
+bool print_gc_stats = false;
+
 void Events_call_action(ace::sdk::Params params)
 {
     ACE_CHECK_ARGS(>=, 2);
 
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
-    vm::Value *value_ptr = params.args[1];
+    vm::Value *value_ptr = &params.args[1];
     ASSERT(value_ptr != nullptr);
 
     vm::Exception ex("call_action() expects an Object or Function as the first argument");
     vm::Exception ex1("Each item in event array should be of type Array");
 
-    if (value_ptr->m_type == vm::Value::FUNCTION && (value_ptr->m_value.func.m_flags & FunctionFlags::GENERATOR)) {
+    if (value_ptr->GetType() == vm::Value::FUNCTION && (value_ptr->GetFunctionFlags() & FunctionFlags::GENERATOR)) {
         // if the key is a generator, it should look like this internally:
         /*
             () {
@@ -95,38 +101,30 @@ void Events_call_action(ace::sdk::Params params)
         ace::vm::Value tmp(*target_ptr);
         *target_ptr = *value_ptr;
         *value_ptr = tmp;
-    } else if (value_ptr->m_type == vm::Value::HEAP_POINTER && value_ptr->m_value.ptr != nullptr) {
-        if (vm::Object *object = value_ptr->m_value.ptr->GetPointer<vm::Object>()) {
-            if (vm::Member *member = object->LookupMemberFromHash(hash_fnv_1("$invoke"))) {
-                if (member->value.m_type == vm::Value::FUNCTION && (member->value.m_value.func.m_flags & FunctionFlags::GENERATOR)) {
+    } else if (value_ptr->GetType() == vm::Value::HEAP_POINTER && value_ptr->GetHeapPointer() != nullptr) {
+        if (vm::Object *object = value_ptr->GetHeapPointer()->GetPointer<vm::Object>()) {
+            if (vm::Value *member = object->LookupMemberFromHash(vm::Object::INVOKE_HASH)) {
+                if (member->GetType() == vm::Value::FUNCTION && (member->GetFunctionFlags() & FunctionFlags::GENERATOR)) {
 
 
                     // keep track of function depth so we can
                     // quit the thread when the function returns
-                    const int func_depth_start = params.handler->thread->m_func_depth;
+                    const int func_depth_start = params.handler->thread->GetFuncDepth();
 
                     params.handler->thread->GetStack().Push(*value_ptr);
 
                     // call the generator function
                     vm::VM::Invoke(
                         params.handler,
-                        member->value,
+                        *member,
                         1
                     );
 
-                    while (!params.handler->bs->Eof() && params.handler->state->good && (params.handler->thread->m_func_depth - func_depth_start)) {
-                        uint8_t code;
-                        params.handler->bs->Read(&code, 1);
-
-                        utf::cout << "pos : " << params.handler->bs->Position() << "\n";
-                        utf::cout << "code : " << (int)code << "\n";
-
-                        params.handler->state->m_vm->HandleInstruction(
-                            params.handler,
-                            code
-                        );
-                        utf::cout << "next\n";
-                    }
+                    // run until the generator function returns
+                    params.handler->state->m_vm->Run(
+                        params.handler,
+                        func_depth_start
+                    );
 
                     params.handler->thread->GetStack().Pop();
 
@@ -143,15 +141,15 @@ void Events_call_action(ace::sdk::Params params)
 
     switch (target_ptr->GetType()) {
         case vm::Value::HEAP_POINTER: {
-            if (target_ptr->m_value.ptr == nullptr) {
+            if (target_ptr->GetHeapPointer() == nullptr) {
                 goto return_null_handler;
             }
 
             // lookup '$events' member
-            if (vm::Object *object = target_ptr->m_value.ptr->GetPointer<vm::Object>()) {
-                if (vm::Member *member = object->LookupMemberFromHash(hash_fnv_1("$events"))) {
+            if (vm::Object *object = target_ptr->GetHeapPointer()->GetPointer<vm::Object>()) {
+                if (vm::Value *member = object->LookupMemberFromHash(hash_fnv_1("$events"))) {
                     // $events member found
-                    if (member->value.m_type != vm::Value::ValueType::HEAP_POINTER) {
+                    if (member->GetType() != vm::Value::ValueType::HEAP_POINTER) {
                         params.handler->state->ThrowException(
                             params.handler->thread,
                             vm::Exception("$events must be an Array")
@@ -159,7 +157,7 @@ void Events_call_action(ace::sdk::Params params)
                         return;
                     }
 
-                    if (vm::Array *array = member->value.m_value.ptr->GetPointer<vm::Array>()) {
+                    if (vm::Array *array = member->GetHeapPointer()->GetPointer<vm::Array>()) {
                         // used for comparing values
                         union {
                             aint64 i;
@@ -177,7 +175,7 @@ void Events_call_action(ace::sdk::Params params)
                         for (size_t i = 0; i < array->GetSize(); i++) {
                             vm::Value &el = array->AtIndex(i);
 
-                            if (el.m_type != vm::Value::HEAP_POINTER) {
+                            if (el.GetType() != vm::Value::HEAP_POINTER) {
                                 params.handler->state->ThrowException(
                                     params.handler->thread,
                                     ex1
@@ -187,7 +185,7 @@ void Events_call_action(ace::sdk::Params params)
 
                             // make sure each item is an array (this could be changed to a tuple,
                             // or something more efficient?)
-                            if (vm::Array *el_array = el.m_value.ptr->GetPointer<vm::Array>()) {
+                            if (vm::Array *el_array = el.GetHeapPointer()->GetPointer<vm::Array>()) {
                                 if (el_array->GetSize() < 2) { // each item has at least 2 elements
                                     params.handler->state->ThrowException(
                                         params.handler->thread,
@@ -212,14 +210,14 @@ void Events_call_action(ace::sdk::Params params)
                                         res_func = &handler_func;
                                         break;
                                     }
-                                } else if (value_ptr->m_type == vm::Value::BOOLEAN && handler_value.m_type == vm::Value::BOOLEAN) {
-                                    if (match_mode == MATCH_TYPES || value_ptr->m_value.b == handler_value.m_value.b) {
+                                } else if (value_ptr->GetType() == vm::Value::BOOLEAN && handler_value.GetType() == vm::Value::BOOLEAN) {
+                                    if (match_mode == MATCH_TYPES || value_ptr->GetBoolean() == handler_value.GetBoolean()) {
                                         res_func = &handler_func;
                                         break;
                                     }
-                                } else if (value_ptr->m_type == vm::Value::HEAP_POINTER && handler_value.m_type == vm::Value::HEAP_POINTER) {
-                                    vm::HeapValue *hv_a = value_ptr->m_value.ptr;
-                                    vm::HeapValue *hv_b = handler_value.m_value.ptr;
+                                } else if (value_ptr->GetType() == vm::Value::HEAP_POINTER && handler_value.GetType() == vm::Value::HEAP_POINTER) {
+                                    vm::HeapValue *hv_a = value_ptr->GetHeapPointer();
+                                    vm::HeapValue *hv_b = handler_value.GetHeapPointer();
 
                                     // drop out early for same pointer value
                                     if (hv_a == hv_b) {
@@ -258,13 +256,13 @@ void Events_call_action(ace::sdk::Params params)
                             return;
                         }
                     }
-                } else if (vm::Member *member = object->LookupMemberFromHash(hash_fnv_1("$invoke"))) {
-                    if (member->value.m_type == vm::Value::FUNCTION ||
-                        member->value.m_type == vm::Value::NATIVE_FUNCTION) {
+                } else if (vm::Value *member = object->LookupMemberFromHash(vm::Object::INVOKE_HASH)) {
+                    if (member->GetType() == vm::Value::FUNCTION ||
+                        member->GetType() == vm::Value::NATIVE_FUNCTION) {
                         // callable object
                         vm::VM::Invoke(
                             params.handler,
-                            member->value,
+                            *member,
                             params.nargs
                         );
                         return;
@@ -290,8 +288,7 @@ void Events_call_action(ace::sdk::Params params)
 return_null_handler:
     // not found, return null
     vm::Value res;
-    res.m_type = vm::Value::HEAP_POINTER;
-    res.m_value.ptr = nullptr;
+    res.SetHeapPointer(nullptr);
     ACE_RETURN(res);
 }
 
@@ -299,10 +296,10 @@ void Events_get_action_handler(ace::sdk::Params params)
 {
     ACE_CHECK_ARGS(==, 2);
 
-    const vm::Value *target_ptr = params.args[0];
+    const vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
-    const vm::Value *value_ptr = params.args[1];
+    const vm::Value *value_ptr = &params.args[1];
     ASSERT(value_ptr != nullptr);
 
     const vm::Value &value = *value_ptr;
@@ -312,17 +309,17 @@ void Events_get_action_handler(ace::sdk::Params params)
 
     switch (target_ptr->GetType()) {
         case vm::Value::ValueType::HEAP_POINTER: {
-            if (target_ptr->m_value.ptr == nullptr) {
+            if (target_ptr->GetHeapPointer() == nullptr) {
                 goto return_null_handler;
             }
 
             // lookup '$events' member
-            if (vm::Object *object = target_ptr->m_value.ptr->GetPointer<vm::Object>()) {
+            if (vm::Object *object = target_ptr->GetHeapPointer()->GetPointer<vm::Object>()) {
                 const std::uint32_t hash = hash_fnv_1("$events");
 
-                if (vm::Member *member = object->LookupMemberFromHash(hash)) {
+                if (vm::Value *member = object->LookupMemberFromHash(hash)) {
                     // $events member found
-                    if (member->value.m_type != vm::Value::ValueType::HEAP_POINTER) {
+                    if (member->GetType() != vm::Value::ValueType::HEAP_POINTER) {
                         params.handler->state->ThrowException(
                             params.handler->thread,
                             vm::Exception("$events must be an Array")
@@ -330,7 +327,7 @@ void Events_get_action_handler(ace::sdk::Params params)
                         return;
                     }
 
-                    if (vm::Array *array = member->value.m_value.ptr->GetPointer<vm::Array>()) {
+                    if (vm::Array *array = member->GetHeapPointer()->GetPointer<vm::Array>()) {
                         // used for comparing values
                         union {
                             aint64 i;
@@ -348,7 +345,7 @@ void Events_get_action_handler(ace::sdk::Params params)
                         for (size_t i = 0; i < array->GetSize(); i++) {
                             vm::Value &el = array->AtIndex(i);
 
-                            if (el.m_type != vm::Value::HEAP_POINTER) {
+                            if (el.GetType() != vm::Value::HEAP_POINTER) {
                                 params.handler->state->ThrowException(
                                     params.handler->thread,
                                     ex1
@@ -358,7 +355,7 @@ void Events_get_action_handler(ace::sdk::Params params)
 
                             // make sure each item is an array (this could be changed to a tuple,
                             // or something more efficient?)
-                            if (vm::Array *el_array = el.m_value.ptr->GetPointer<vm::Array>()) {
+                            if (vm::Array *el_array = el.GetHeapPointer()->GetPointer<vm::Array>()) {
                                 if (el_array->GetSize() < 2) { // each item has at least 2 elements
                                     params.handler->state->ThrowException(
                                         params.handler->thread,
@@ -383,14 +380,14 @@ void Events_get_action_handler(ace::sdk::Params params)
                                         res_func = &handler_func;
                                         break;
                                     }
-                                } else if (value.m_type == vm::Value::BOOLEAN && handler_value.m_type == vm::Value::BOOLEAN) {
-                                    if (match_mode == MATCH_TYPES || value.m_value.b == handler_value.m_value.b) {
+                                } else if (value.GetType() == vm::Value::BOOLEAN && handler_value.GetType() == vm::Value::BOOLEAN) {
+                                    if (match_mode == MATCH_TYPES || value.GetBoolean() == handler_value.GetBoolean()) {
                                         res_func = &handler_func;
                                         break;
                                     }
-                                } else if (value.m_type == vm::Value::HEAP_POINTER && handler_value.m_type == vm::Value::HEAP_POINTER) {
-                                    vm::HeapValue *hv_a = value.m_value.ptr;
-                                    vm::HeapValue *hv_b = handler_value.m_value.ptr;
+                                } else if (value.GetType() == vm::Value::HEAP_POINTER && handler_value.GetType() == vm::Value::HEAP_POINTER) {
+                                    vm::HeapValue *hv_a = value.GetHeapPointer();
+                                    vm::HeapValue *hv_b = handler_value.GetHeapPointer();
 
                                     // drop out early for same pointer value
                                     if (hv_a == hv_b) {
@@ -426,8 +423,7 @@ void Events_get_action_handler(ace::sdk::Params params)
         return_null_handler:
             // not found, return null
             vm::Value res;
-            res.m_type = vm::Value::HEAP_POINTER;
-            res.m_value.ptr = nullptr;
+            res.SetHeapPointer(nullptr);
             ACE_RETURN(res);
         }
         case vm::Value::ValueType::FUNCTION:
@@ -451,8 +447,21 @@ void Time_now(ace::sdk::Params params)
 
     // return the timestamp
     vm::Value res;
-    res.m_type = vm::Value::ValueType::I64;
-    res.m_value.i64 = unix_timestamp;
+    res.SetI64(unix_timestamp);
+    ACE_RETURN(res);
+}
+
+void Time_clock(ace::sdk::Params params)
+{
+    ACE_CHECK_ARGS(==, 0);
+
+    static const auto epoch = std::chrono::steady_clock::now();
+
+    // seconds since the first call, with sub-microsecond resolution
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - epoch;
+
+    vm::Value res;
+    res.SetF64(elapsed.count());
     ACE_RETURN(res);
 }
 
@@ -491,12 +500,11 @@ void Runtime_typeof(ace::sdk::Params params)
     // create heap value for string
     vm::HeapValue *ptr = params.handler->state->HeapAlloc(params.handler->thread);
     ASSERT(ptr != nullptr);
-    ptr->Assign(vm::ImmutableString(params.args[0]->GetTypeString()));
+    ptr->Assign(vm::ImmutableString::Intern(params.args[0].GetTypeString()));
 
     vm::Value res;
     // assign register value to the allocated object
-    res.m_type = vm::Value::HEAP_POINTER;
-    res.m_value.ptr = ptr;
+    res.SetHeapPointer(ptr);
 
     ACE_RETURN(res);
 }
@@ -505,18 +513,18 @@ void Runtime_load_library(ace::sdk::Params params)
 {
     ACE_CHECK_ARGS(==, 1);
 
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
     vm::Exception e("load_library() expects a String as the first argument");
 
     if (target_ptr->GetType() == vm::Value::ValueType::HEAP_POINTER) {
-        if (target_ptr->GetValue().ptr == nullptr) {
+        if (target_ptr->GetHeapPointer() == nullptr) {
             params.handler->state->ThrowException(
                 params.handler->thread,
                 vm::Exception::NullReferenceException()
             );
-        } else if (vm::ImmutableString *strptr = target_ptr->GetValue().ptr->GetPointer<vm::ImmutableString>()) {
+        } else if (vm::ImmutableString *strptr = target_ptr->GetHeapPointer()->GetPointer<vm::ImmutableString>()) {
             // load library from string
             std::string full_path;
 
@@ -547,8 +555,7 @@ void Runtime_load_library(ace::sdk::Params params)
 
                 vm::Value res;
                 // assign register value to the allocated object
-                res.m_type = vm::Value::HEAP_POINTER;
-                res.m_value.ptr = ptr;
+                res.SetHeapPointer(ptr);
 
                 ACE_RETURN(res);
             }
@@ -564,10 +571,10 @@ void Runtime_load_function(ace::sdk::Params params)
 {
     ACE_CHECK_ARGS(==, 2);
 
-    vm::Value *arg0 = params.args[0];
+    vm::Value *arg0 = &params.args[0];
     ASSERT(arg0 != nullptr);
 
-    vm::Value *arg1 = params.args[1];
+    vm::Value *arg1 = &params.args[1];
     ASSERT(arg1 != nullptr);
 
     vm::Exception e("load_function() expects arguments of type Library and String");
@@ -576,18 +583,18 @@ void Runtime_load_function(ace::sdk::Params params)
     vm::ImmutableString *str_ptr = nullptr;
 
     if (arg0->GetType() == vm::Value::ValueType::HEAP_POINTER) {
-        if (arg0->GetValue().ptr == nullptr) {
+        if (arg0->GetHeapPointer() == nullptr) {
             params.handler->state->ThrowException(params.handler->thread, vm::Exception::NullReferenceException());
-        } else if ((lib_ptr = arg0->GetValue().ptr->GetPointer<Library>()) == nullptr) {
+        } else if ((lib_ptr = arg0->GetHeapPointer()->GetPointer<Library>()) == nullptr) {
             params.handler->state->ThrowException(params.handler->thread, e);
         } else {
             if (arg1->GetType() == vm::Value::ValueType::HEAP_POINTER) {
-                if (arg1->GetValue().ptr == nullptr) {
+                if (arg1->GetHeapPointer() == nullptr) {
                     params.handler->state->ThrowException(
                         params.handler->thread,
                         vm::Exception::NullReferenceException()
                     );
-                } else if ((str_ptr = arg1->GetValue().ptr->GetPointer<vm::ImmutableString>()) == nullptr) {
+                } else if ((str_ptr = arg1->GetHeapPointer()->GetPointer<vm::ImmutableString>()) == nullptr) {
                     params.handler->state->ThrowException(params.handler->thread, e);
                 } else {
                     NativeFunctionPtr_t func = lib_ptr->GetFunction(str_ptr->GetData());
@@ -599,8 +606,7 @@ void Runtime_load_function(ace::sdk::Params params)
                         );
                     } else {
                         vm::Value res;
-                        res.m_type = vm::Value::NATIVE_FUNCTION;
-                        res.m_value.native_func = func;
+                        res.SetNativeFunction(func);
 
                         ACE_RETURN(res);
                     }
@@ -619,14 +625,16 @@ void Global_get_keys(ace::sdk::Params params)
     ACE_CHECK_ARGS(==, 1);
 
     // get value
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
     // create array
     vm::Array keys_arr;
+    // the keys are only in keys_arr until it is on the heap
+    ace::sdk::HandleScope scope(params);
 
-    if (target_ptr->m_type == vm::Value::HEAP_POINTER && target_ptr->m_value.ptr != nullptr) {
-        if (vm::Object *object = target_ptr->m_value.ptr->GetPointer<vm::Object>()) {
+    if (target_ptr->GetType() == vm::Value::HEAP_POINTER && target_ptr->GetHeapPointer() != nullptr) {
+        if (vm::Object *object = target_ptr->GetHeapPointer()->GetPointer<vm::Object>()) {
             ASSERT(object->GetTypePtr() != nullptr);
 
             keys_arr.Resize(object->GetTypePtr()->GetSize());
@@ -634,11 +642,11 @@ void Global_get_keys(ace::sdk::Params params)
             for (size_t i = 0; i < object->GetTypePtr()->GetSize(); i++) {
                 vm::HeapValue *ptr = params.handler->state->HeapAlloc(params.handler->thread);
                 ASSERT(ptr != nullptr);
-                ptr->Assign(vm::ImmutableString(object->GetTypePtr()->GetNames()[i]));
+                ptr->Assign(vm::ImmutableString::Intern(object->GetTypePtr()->GetNames()[i]));
+                scope.Add(ptr);
 
                 vm::Value res;
-                res.m_type = vm::Value::HEAP_POINTER;
-                res.m_value.ptr = ptr;
+                res.SetHeapPointer(ptr);
 
                 keys_arr.Push(res);
             }
@@ -652,14 +660,14 @@ void Global_get_keys(ace::sdk::Params params)
 
     vm::Value res;
     // assign register value to the allocated object
-    res.m_type = vm::Value::HEAP_POINTER;
-    res.m_value.ptr = ptr;
+    res.SetHeapPointer(ptr);
 
     ACE_RETURN(res);
 }
 
+// the arrays pushed are added to the scope, as `arr` is not on the heap
 static void PushObjectKeysToArray(ace::sdk::Params &params,
-    vm::Object *object, vm::Array *arr)
+    ace::sdk::HandleScope &scope, vm::Object *object, vm::Array *arr)
 {
     ASSERT(arr != nullptr);
 
@@ -671,22 +679,22 @@ static void PushObjectKeysToArray(ace::sdk::Params &params,
 
         vm::HeapValue *key_ptr = params.handler->state->HeapAlloc(params.handler->thread);
         ASSERT(key_ptr != nullptr);
-        key_ptr->Assign(vm::ImmutableString(object->GetTypePtr()->GetNames()[i]));
+        key_ptr->Assign(vm::ImmutableString::Intern(object->GetTypePtr()->GetNames()[i]));
+        scope.Add(key_ptr);
 
         vm::Value key;
-        key.m_type = vm::Value::HEAP_POINTER;
-        key.m_value.ptr = key_ptr;
+        key.SetHeapPointer(key_ptr);
 
         member_arr.AtIndex(0, key);
-        member_arr.AtIndex(1, object->GetMembers()[i].value);
+        member_arr.AtIndex(1, object->GetMembers()[i]);
 
         vm::HeapValue *member_arr_ptr = params.handler->state->HeapAlloc(params.handler->thread);
         ASSERT(member_arr_ptr != nullptr);
         member_arr_ptr->Assign(member_arr);
+        scope.Add(member_arr_ptr);
 
         vm::Value member_arr_value;
-        member_arr_value.m_type = vm::Value::HEAP_POINTER;
-        member_arr_value.m_value.ptr = member_arr_ptr;
+        member_arr_value.SetHeapPointer(member_arr_ptr);
 
         arr->Push(member_arr_value);
     }
@@ -697,17 +705,18 @@ void Global_to_multi_array(ace::sdk::Params params)
     ACE_CHECK_ARGS(==, 1);
 
     // get value
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
     // create array
     vm::Array res_arr;
+    ace::sdk::HandleScope scope(params);
 
     // if there is 1 arg, transform the target
     // an Object will be transformed to a 2d array of arrays containing keys and values
-    if (target_ptr->m_type == vm::Value::HEAP_POINTER && target_ptr->m_value.ptr != nullptr) {
-        if (vm::Object *object = target_ptr->m_value.ptr->GetPointer<vm::Object>()) {
-            PushObjectKeysToArray(params, object, &res_arr);
+    if (target_ptr->GetType() == vm::Value::HEAP_POINTER && target_ptr->GetHeapPointer() != nullptr) {
+        if (vm::Object *object = target_ptr->GetHeapPointer()->GetPointer<vm::Object>()) {
+            PushObjectKeysToArray(params, scope, object, &res_arr);
         } else {
             res_arr.Resize(1);
             res_arr.PushMany(1, params.args);
@@ -724,8 +733,7 @@ void Global_to_multi_array(ace::sdk::Params params)
 
     vm::Value res;
     // assign register value to the allocated object
-    res.m_type = vm::Value::HEAP_POINTER;
-    res.m_value.ptr = ptr;
+    res.SetHeapPointer(ptr);
 
     ACE_RETURN(res);
 }
@@ -735,7 +743,7 @@ void Global_to_array(ace::sdk::Params params)
     ACE_CHECK_ARGS(>=, 2);
 
     // get value
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
     // create array
@@ -743,8 +751,8 @@ void Global_to_array(ace::sdk::Params params)
 
     // if there is 1 arg, transform the target
     // an Object will be transformed to a 2d array of arrays containing keys and values
-    if (params.nargs == 1 && target_ptr->m_type == vm::Value::HEAP_POINTER && target_ptr->m_value.ptr != nullptr) {
-        if (vm::Array *array = target_ptr->m_value.ptr->GetPointer<vm::Array>()) {
+    if (params.nargs == 1 && target_ptr->GetType() == vm::Value::HEAP_POINTER && target_ptr->GetHeapPointer() != nullptr) {
+        if (vm::Array *array = target_ptr->GetHeapPointer()->GetPointer<vm::Array>()) {
             ACE_RETURN(*target_ptr);
         } else {
             res_arr.Resize(1);
@@ -762,8 +770,7 @@ void Global_to_array(ace::sdk::Params params)
 
     vm::Value res;
     // assign register value to the allocated object
-    res.m_type = vm::Value::HEAP_POINTER;
-    res.m_value.ptr = ptr;
+    res.SetHeapPointer(ptr);
 
     ACE_RETURN(res);
 }
@@ -773,38 +780,35 @@ void Global_to_json(ace::sdk::Params params)
     ACE_CHECK_ARGS(==, 1);
 
     // get value
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
     // convert to json string
-    std::stringstream ss;
-    target_ptr->ToRepresentation(ss, false /* do not add type names */);
-
-    const std::string &str = ss.str();
+    vm::StringBuilder sb;
+    target_ptr->ToRepresentation(sb, false /* do not add type names */);
 
     // store in memory
     vm::HeapValue *ptr = params.handler->state->HeapAlloc(params.handler->thread);
     ASSERT(ptr != nullptr);
-    ptr->Assign(vm::ImmutableString(str.data()));
+    ptr->Assign(sb.Finish());
 
     vm::Value res;
     // assign register value to the allocated object
-    res.m_type = vm::Value::HEAP_POINTER;
-    res.m_value.ptr = ptr;
+    res.SetHeapPointer(ptr);
 
     ACE_RETURN(res);
 }
 
-static void MergeIntoArray(ace::sdk::Params &params, vm::Array *res_arr)
+static void MergeIntoArray(ace::sdk::Params &params,
+    ace::sdk::HandleScope &scope, vm::Array *res_arr)
 {
     for (size_t i = 1; i < params.nargs; i++) {
-        ASSERT(params.args[i] != nullptr);
-        if (params.args[i]->m_type == vm::Value::HEAP_POINTER && params.args[i]->m_value.ptr != nullptr) {
-            if (vm::Array *array = params.args[i]->m_value.ptr->GetPointer<vm::Array>()) {
+        if (params.args[i].GetType() == vm::Value::HEAP_POINTER && params.args[i].GetHeapPointer() != nullptr) {
+            if (vm::Array *array = params.args[i].GetHeapPointer()->GetPointer<vm::Array>()) {
                 res_arr->PushMany(array->GetSize(), array->GetBuffer());
-            } else if (vm::Object *object = params.args[i]->m_value.ptr->GetPointer<vm::Object>()) {
+            } else if (vm::Object *object = params.args[i].GetHeapPointer()->GetPointer<vm::Object>()) {
                 // merge all keys and values into array
-                PushObjectKeysToArray(params, object, res_arr);
+                PushObjectKeysToArray(params, scope, object, res_arr);
             } else {
                 res_arr->PushMany(1, &params.args[i]);
             }
@@ -822,20 +826,21 @@ void Global_merge(ace::sdk::Params params)
     ACE_CHECK_ARGS(>=, 2);
 
     // get value
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
 
     vm::Array res_arr;
     res_arr.Resize(params.nargs);
+    ace::sdk::HandleScope scope(params);
 
     // if there is 1 arg, transform the target
     // an Object will be transformed to a 2d array of arrays containing keys and values
-    if (target_ptr->m_type == vm::Value::HEAP_POINTER && target_ptr->m_value.ptr != nullptr) {
-        if (vm::Array *array = target_ptr->m_value.ptr->GetPointer<vm::Array>()) {
+    if (target_ptr->GetType() == vm::Value::HEAP_POINTER && target_ptr->GetHeapPointer() != nullptr) {
+        if (vm::Array *array = target_ptr->GetHeapPointer()->GetPointer<vm::Array>()) {
             res_arr.PushMany(array->GetSize(), array->GetBuffer());
-        } else if (vm::Object *object = target_ptr->m_value.ptr->GetPointer<vm::Object>()) {
-            PushObjectKeysToArray(params, object, &res_arr);
+        } else if (vm::Object *object = target_ptr->GetHeapPointer()->GetPointer<vm::Object>()) {
+            PushObjectKeysToArray(params, scope, object, &res_arr);
         } else {
             res_arr.PushMany(1, params.args);
         }
@@ -843,7 +848,7 @@ void Global_merge(ace::sdk::Params params)
         res_arr.PushMany(1, params.args);
     }
 
-    MergeIntoArray(params, &res_arr);
+    MergeIntoArray(params, scope, &res_arr);
 
     // store in memory
     vm::HeapValue *ptr = params.handler->state->HeapAlloc(params.handler->thread);
@@ -852,8 +857,7 @@ void Global_merge(ace::sdk::Params params)
 
     vm::Value res;
     // assign register value to the allocated object
-    res.m_type = vm::Value::HEAP_POINTER;
-    res.m_value.ptr = ptr;
+    res.SetHeapPointer(ptr);
 
     ACE_RETURN(res);
 }
@@ -863,13 +867,13 @@ void Global_decompile(ace::sdk::Params params)
     ACE_CHECK_ARGS(==, 1);
 
     // get value
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
     std::string bytecode_str;
 
-    if (target_ptr->m_type != vm::Value::FUNCTION) {
-        if (target_ptr->m_type == vm::Value::NATIVE_FUNCTION) {
+    if (target_ptr->GetType() != vm::Value::FUNCTION) {
+        if (target_ptr->GetType() == vm::Value::NATIVE_FUNCTION) {
             bytecode_str.append("<Native Code>");
         } else {
             char buffer[256];
@@ -886,7 +890,7 @@ void Global_decompile(ace::sdk::Params params)
     } else {
         ASSERT(params.handler->bs != nullptr);
 
-        const size_t pos = target_ptr->m_value.func.m_addr;
+        const size_t pos = target_ptr->GetFunctionAddress();
         ASSERT(pos < params.handler->bs->Size());
 
         // create required objects
@@ -930,8 +934,7 @@ void Global_decompile(ace::sdk::Params params)
 
     vm::Value res;
     // assign register value to the allocated object
-    res.m_type = vm::Value::HEAP_POINTER;
-    res.m_value.ptr = ptr;
+    res.SetHeapPointer(ptr);
 
     ACE_RETURN(res);
 }
@@ -940,15 +943,15 @@ void Global_prompt(ace::sdk::Params params)
 {
     ACE_CHECK_ARGS(==, 1);
 
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
     vm::Exception e("prompt() expects a String as the first argument");
 
     if (target_ptr->GetType() == vm::Value::ValueType::HEAP_POINTER) {
-        if (target_ptr->GetValue().ptr == nullptr) {
+        if (target_ptr->GetHeapPointer() == nullptr) {
             params.handler->state->ThrowException(params.handler->thread, vm::Exception::NullReferenceException());
-        } else if (vm::ImmutableString *string = target_ptr->GetValue().ptr->GetPointer<vm::ImmutableString>()) {
+        } else if (vm::ImmutableString *string = target_ptr->GetHeapPointer()->GetPointer<vm::ImmutableString>()) {
             utf::cout << string->GetData() << ' ';
 
             // read input...
@@ -962,8 +965,7 @@ void Global_prompt(ace::sdk::Params params)
 
                 vm::Value res;
                 // assign register value to the allocated object
-                res.m_type = vm::Value::HEAP_POINTER;
-                res.m_value.ptr = ptr;
+                res.SetHeapPointer(ptr);
 
                 ACE_RETURN(res);
             } else {
@@ -988,12 +990,11 @@ void Global_to_string(ace::sdk::Params params)
     // create heap value for string
     vm::HeapValue *ptr = params.handler->state->HeapAlloc(params.handler->thread);
     ASSERT(ptr != nullptr);
-    ptr->Assign(params.args[0]->ToString());
+    ptr->Assign(params.args[0].ToString());
 
     vm::Value res;
     // assign register value to the allocated object
-    res.m_type = vm::Value::HEAP_POINTER;
-    res.m_value.ptr = ptr;
+    res.SetHeapPointer(ptr);
 
     ACE_RETURN(res);
 }
@@ -1002,79 +1003,150 @@ void Global_fmt(ace::sdk::Params params)
 {
     ACE_CHECK_ARGS(>=, 1);
 
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
-    vm::Exception e("fmt() expects a String as the first argument");
-
     if (target_ptr->GetType() == vm::Value::ValueType::HEAP_POINTER) {
-        if (target_ptr->GetValue().ptr == nullptr) {
+        if (target_ptr->GetHeapPointer() == nullptr) {
             params.handler->state->ThrowException(params.handler->thread, vm::Exception::NullReferenceException());
-        } else if (vm::ImmutableString *str_ptr = target_ptr->GetValue().ptr->GetPointer<vm::ImmutableString>()) {
+        } else if (vm::ImmutableString *str_ptr = target_ptr->GetHeapPointer()->GetPointer<vm::ImmutableString>()) {
             // scan through string and merge each argument where there is a '%'
             const size_t original_length = str_ptr->GetLength();
-
-            std::string result_string;
-            result_string.reserve(original_length);
-
             const char *original_data = str_ptr->GetData();
             ASSERT(original_data != nullptr);
 
-            const int buffer_size = 256;
-            char buffer[buffer_size + 1] = {0};
+            vm::StringBuilder sb(original_length);
 
             // number of '%' characters handled
             int num_fmts = 0;
-            int buffer_idx = 0;
+            // start of the text since the last '%'
+            size_t run_start = 0;
 
             for (size_t i = 0; i < original_length; i++) {
-
                 if (original_data[i] == '%' && num_fmts < params.nargs - 1) {
-                    // set end of buffer to be NUL
-                    buffer[buffer_idx + 1] = '\0';
-                    // now upload to result string
-                    result_string += buffer;
-                    // clear buffer
-                    buffer_idx = 0;
-                    buffer[0] = '\0';
+                    sb.Append(original_data + run_start, i - run_start);
+                    run_start = i + 1;
 
-                    vm::ImmutableString str = params.args[++num_fmts]->ToString();
-
-                    result_string.append(str.GetData());
-                } else {
-                    buffer[buffer_idx] = original_data[i];
-
-                    if (buffer_idx == buffer_size - 1 || i == original_length - 1) {
-                        // set end of buffer to be NUL
-                        buffer[buffer_idx + 1] = '\0';
-                        // now upload to result string
-                        result_string += buffer;
-                        //clear buffer
-                        buffer_idx = 0;
-                        buffer[0] = '\0';
-                    } else {
-                        buffer_idx++;
-                    }
+                    params.args[++num_fmts].ToString(sb);
                 }
             }
 
+            sb.Append(original_data + run_start, original_length - run_start);
+
             // store the result in a variable
             vm::HeapValue *ptr = params.handler->state->HeapAlloc(params.handler->thread);
             ASSERT(ptr != nullptr);
             // assign it to the formatted string
-            ptr->Assign(vm::ImmutableString(result_string.data()));
+            ptr->Assign(sb.Finish());
 
             vm::Value res;
             // assign register value to the allocated object
-            res.m_type = vm::Value::HEAP_POINTER;
-            res.m_value.ptr = ptr;
+            res.SetHeapPointer(ptr);
 
             ACE_RETURN(res);
         } else {
-            params.handler->state->ThrowException(params.handler->thread, e);
+            params.handler->state->ThrowException(
+                params.handler->thread,
+                vm::Exception("fmt() expects a String as the first argument")
+            );
         }
     } else {
-        params.handler->state->ThrowException(params.handler->thread, e);
+        params.handler->state->ThrowException(
+            params.handler->thread,
+            vm::Exception("fmt() expects a String as the first argument")
+        );
+    }
+}
+
+// the builder that the first argument holds, throwing an exception if it is not one
+static vm::StringBuilder *GetStringBuilderArg(ace::sdk::Params &params)
+{
+    vm::Value *target_ptr = &params.args[0];
+    ASSERT(target_ptr != nullptr);
+
+    if (target_ptr->GetType() == vm::Value::HEAP_POINTER) {
+        if (target_ptr->GetHeapPointer() == nullptr) {
+            params.handler->state->ThrowException(params.handler->thread, vm::Exception::NullReferenceException());
+            return nullptr;
+        } else if (vm::StringBuilder *sb = target_ptr->GetHeapPointer()->GetPointer<vm::StringBuilder>()) {
+            return sb;
+        }
+    }
+
+    params.handler->state->ThrowException(
+        params.handler->thread,
+        vm::Exception("Expected a StringBuilder as the first argument")
+    );
+
+    return nullptr;
+}
+
+void StringBuilder_create(ace::sdk::Params params)
+{
+    ACE_CHECK_ARGS(==, 0);
+
+    vm::HeapValue *ptr = params.handler->state->HeapAlloc(params.handler->thread);
+    ASSERT(ptr != nullptr);
+    ptr->Assign(vm::StringBuilder());
+
+    vm::Value res;
+    res.SetHeapPointer(ptr);
+
+    ACE_RETURN(res);
+}
+
+void StringBuilder_append(ace::sdk::Params params)
+{
+    ACE_CHECK_ARGS(>=, 1);
+
+    if (vm::StringBuilder *sb = GetStringBuilderArg(params)) {
+        // each argument is written straight into the builder,
+        // without making a string of it first
+        for (int i = 1; i < params.nargs; i++) {
+            params.args[i].ToString(*sb);
+        }
+
+        // return the builder, so that calls can be chained
+        ACE_RETURN(params.args[0]);
+    }
+}
+
+void StringBuilder_reserve(ace::sdk::Params params)
+{
+    ACE_CHECK_ARGS(==, 2);
+
+    if (vm::StringBuilder *sb = GetStringBuilderArg(params)) {
+        aint64 capacity;
+
+        if (!params.args[1].GetInteger(&capacity) || capacity < 0) {
+            params.handler->state->ThrowException(
+                params.handler->thread,
+                vm::Exception("reserve() expects a capacity of type Int that is not negative")
+            );
+            return;
+        }
+
+        sb->Reserve((size_t)capacity);
+
+        ACE_RETURN(params.args[0]);
+    }
+}
+
+void StringBuilder_finish(ace::sdk::Params params)
+{
+    ACE_CHECK_ARGS(==, 1);
+
+    if (vm::StringBuilder *sb = GetStringBuilderArg(params)) {
+        // the builder is reachable from the arguments, so it
+        // stays alive if the allocation runs a collection
+        vm::HeapValue *ptr = params.handler->state->HeapAlloc(params.handler->thread);
+        ASSERT(ptr != nullptr);
+        ptr->Assign(sb->Finish());
+
+        vm::Value res;
+        res.SetHeapPointer(ptr);
+
+        ACE_RETURN(res);
     }
 }
 
@@ -1082,94 +1154,107 @@ void Global_array_push(ace::sdk::Params params)
 {
     ACE_CHECK_ARGS(>=, 2);
 
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
-    const int buffer_size = 256;
-    char buffer[buffer_size];
-    std::snprintf(
-        buffer,
-        buffer_size,
-        "array_push() requires an Array"
-    );
-    vm::Exception e(buffer);
-
     if (target_ptr->GetType() == vm::Value::ValueType::HEAP_POINTER) {
         vm::Array *array_ptr = nullptr;
 
-        if (target_ptr->GetValue().ptr == nullptr) {
+        if (target_ptr->GetHeapPointer() == nullptr) {
             params.handler->state->ThrowException(
                 params.handler->thread,
                 vm::Exception::NullReferenceException()
             );
-        } else if ((array_ptr = target_ptr->GetValue().ptr->GetPointer<vm::Array>()) != nullptr) {
+        } else if ((array_ptr = target_ptr->GetHeapPointer()->GetPointer<vm::Array>()) != nullptr) {
+            const size_t capacity = array_ptr->GetCapacity();
+
             array_ptr->PushMany(params.nargs - 1, &params.args[1]);
+
+            for (int i = 1; i < params.nargs; i++) {
+                params.handler->state->WriteBarrier(params.handler->thread,
+                    target_ptr->GetHeapPointer(), params.args[i]);
+            }
+
+            if (array_ptr->GetCapacity() != capacity) {
+                params.handler->state->NoteGrowth(params.handler->thread,
+                    target_ptr->GetHeapPointer(),
+                    (array_ptr->GetCapacity() - capacity) * sizeof(vm::Value));
+            }
         } else {
-            params.handler->state->ThrowException(params.handler->thread, e);
+            params.handler->state->ThrowException(
+                params.handler->thread,
+                vm::Exception("array_push() requires an Array")
+            );
         }
     } else {
-        params.handler->state->ThrowException(params.handler->thread, e);
+        params.handler->state->ThrowException(
+            params.handler->thread,
+            vm::Exception("array_push() requires an Array")
+        );
     }
 
     // return same value
     ACE_RETURN(*target_ptr);
 }
 
+// only built when it is thrown, as length() is called in tight loops
+static vm::Exception LengthUndefinedException(const vm::Value &value)
+{
+    char buffer[256];
+    std::snprintf(buffer, sizeof(buffer),
+        "length() is undefined for type '%s'", value.GetTypeString());
+
+    return vm::Exception(buffer);
+}
+
 void Global_length(ace::sdk::Params params)
 {
     ACE_CHECK_ARGS(==, 1);
 
     int len = 0;
 
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
-    const int buffer_size = 256;
-    char buffer[buffer_size];
-    std::snprintf(
-        buffer,
-        buffer_size,
-        "length() is undefined for type '%s'",
-        target_ptr->GetTypeString()
-    );
-    vm::Exception e(buffer);
-
     if (target_ptr->GetType() == vm::Value::ValueType::HEAP_POINTER) {
         union {
             vm::ImmutableString *str_ptr;
             vm::Array *array_ptr;
             vm::Object *obj_ptr;
+            vm::StringBuilder *sb_ptr;
         } data;
 
-        if (target_ptr->GetValue().ptr == nullptr) {
+        if (target_ptr->GetHeapPointer() == nullptr) {
             params.handler->state->ThrowException(
                 params.handler->thread,
                 vm::Exception::NullReferenceException()
             );
-        } else if ((data.str_ptr = target_ptr->GetValue().ptr->GetPointer<vm::ImmutableString>()) != nullptr) {
+        } else if ((data.str_ptr = target_ptr->GetHeapPointer()->GetPointer<vm::ImmutableString>()) != nullptr) {
             // get length of string
             len = data.str_ptr->GetLength();
-        } else if ((data.array_ptr = target_ptr->GetValue().ptr->GetPointer<vm::Array>()) != nullptr) {
+        } else if ((data.array_ptr = target_ptr->GetHeapPointer()->GetPointer<vm::Array>()) != nullptr) {
             // get length of array
             len = data.array_ptr->GetSize();
-        } else if ((data.obj_ptr = target_ptr->GetValue().ptr->GetPointer<vm::Object>()) != nullptr) {
+        } else if ((data.obj_ptr = target_ptr->GetHeapPointer()->GetPointer<vm::Object>()) != nullptr) {
             // get number of members in object
             // first, get type
             const vm::TypeInfo *type_ptr = data.obj_ptr->GetTypePtr();
             ASSERT(type_ptr != nullptr);
 
             len = type_ptr->GetSize();
+        } else if ((data.sb_ptr = target_ptr->GetHeapPointer()->GetPointer<vm::StringBuilder>()) != nullptr) {
+            // get length of the string built so far
+            len = data.sb_ptr->GetLength();
         } else {
-            params.handler->state->ThrowException(params.handler->thread, e);
+            params.handler->state->ThrowException(params.handler->thread, LengthUndefinedException(*target_ptr));
         }
     } else {
-        params.handler->state->ThrowException(params.handler->thread, e);
+        params.handler->state->ThrowException(params.handler->thread, LengthUndefinedException(*target_ptr));
     }
 
     vm::Value res;
     // assign register value to the length
-    res.m_type = vm::Value::I32;
-    res.m_value.i32 = len;
+    res.SetI32(len);
 
     ACE_RETURN(res);
 }
@@ -1178,7 +1263,7 @@ void Global_call(ace::sdk::Params params)
 {
     ACE_CHECK_ARGS(>=, 1);
 
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
     // copy target, as args may change
@@ -1196,7 +1281,7 @@ void Global_spawn_thread(ace::sdk::Params params)
 {
     ACE_CHECK_ARGS(>=, 1);
 
-    vm::Value *target_ptr = params.args[0];
+    vm::Value *target_ptr = &params.args[0];
     ASSERT(target_ptr != nullptr);
 
     vm::Value target(*target_ptr);
@@ -1211,8 +1296,8 @@ void Global_spawn_thread(ace::sdk::Params params)
     );
     vm::Exception e(buffer);
 
-    // the position of the bytecode stream before thread execution
-    const size_t pos = params.handler->bs->Position();
+    // the position in the program before thread execution
+    const uint32_t pc = params.handler->pc;
 
     if (target.GetType() == vm::Value::ValueType::FUNCTION) {
         // create the thread
@@ -1221,31 +1306,37 @@ void Global_spawn_thread(ace::sdk::Params params)
 
         // copy values to the new stack
         for (int i = 1; i < params.nargs; i++) {
-            if (params.args[i] != nullptr) {
-                new_thread->GetStack().Push(*params.args[i]);
-            }
+            new_thread->GetStack().Push(params.args[i]);
         }
         ASSERT(params.handler != nullptr);
         ASSERT(params.handler->bs != nullptr);
 
         const vm::BytecodeStream bs_before = *params.handler->bs;
+        vm::DecodedProgram *program = params.handler->program;
         vm::VMState *vm_state = params.handler->state;
         const size_t nargs = params.nargs;
 
-        threads.emplace_back(std::thread([new_thread, bs_before, vm_state, target, nargs, pos] () {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        threads.emplace_back(std::thread([new_thread, bs_before, program, vm_state, target, nargs, pc] () {
             // create copy of byte stream
             vm::BytecodeStream newBs = bs_before;
-            newBs.SetPosition(pos);
 
             vm::InstructionHandler instruction_handler(
                 vm_state,
                 new_thread,
-                &newBs
+                &newBs,
+                program,
+                pc
             );
 
             // keep track of function depth so we can
             // quit the thread when the function returns
-            const int func_depth_start = new_thread->m_func_depth;
+            const int func_depth_start = new_thread->GetFuncDepth();
+
+            // from here on, this thread runs without any global lock,
+            // and must reach a safepoint for the gc to be able to run
+            vm_state->BeginExecution();
 
             // call the function
             vm::VM::Invoke(
@@ -1254,18 +1345,15 @@ void Global_spawn_thread(ace::sdk::Params params)
                 nargs - 1
             );
 
-            while (!newBs.Eof() && vm_state->good && (new_thread->m_func_depth - func_depth_start)) {
-                uint8_t code;
-                newBs.Read(&code, 1);
+            // run until the function returns
+            vm_state->m_vm->Run(
+                &instruction_handler,
+                func_depth_start
+            );
 
-                vm_state->m_vm->HandleInstruction(
-                    &instruction_handler,
-                    code
-                );
-            }
+            vm_state->EndExecution();
 
             // remove the thread
-            std::lock_guard<std::mutex> lock(mtx);
             vm_state->DestroyThread(new_thread->GetId());
         }));
     } else {
@@ -1321,7 +1409,25 @@ static int RunBytecodeFile(
 
     vm->Execute(&bytecode_stream);
 
+    // wait for threads
+    // (threads may spawn more threads, so do not hold the lock while joining)
+    for (size_t i = 0;; i++) {
+        std::thread thread;
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (i >= threads.size()) {
+                break;
+            }
+            thread = std::move(threads[i]);
+        }
+
+        thread.join();
+    }
+    threads.clear();
+
     if (record_time) {
+        // includes the time spent waiting for spawned threads
         auto end = std::chrono::high_resolution_clock::now();
         auto elapsed_ms = std::chrono::duration_cast<
             std::chrono::duration<double, std::ratio<1>>
@@ -1329,11 +1435,21 @@ static int RunBytecodeFile(
         utf::cout << "Elapsed time: " << elapsed_ms << "s\n";
     }
 
-    // wait for threads
-    for (std::thread &thread : threads) {
-        thread.join();
+    if (print_ic_stats) {
+        // every thread has finished by now
+        const vm::InlineCacheStats stats = vm->GetState().GetInlineCacheStats();
+        utf::cout << "Inline cache: " << stats.hits << " hits, " << stats.misses << " misses\n";
+    }
+
+    if (print_gc_stats) {
+        const vm::GCStats &stats = vm->GetState().GetGCStats();
+        utf::cout << "GC: " << stats.num_collections << " collections "
+            << "(" << stats.num_minor_collections << " minor, "
+            << stats.num_steps << " incremental steps), "
+            << "mark " << stats.mark_time << "s, "
+            << "sweep " << stats.sweep_time << "s, "
+            << "longest pause " << stats.max_pause << "s\n";
     }
-    threads.clear();
 
     delete[] bytecodes;
 
@@ -1353,6 +1469,9 @@ static int REPL(
     int bracket_counter = 0;
 
     size_t offset = 0;
+    // kept between inputs, so functions from earlier
+    // inputs can still be called directly
+    BuildParams build_params;
 
     utf::Utf8String code;
     utf::Utf8String out_filename = "tmp.aex";
@@ -1533,7 +1652,6 @@ static int REPL(
                 } else {
                     int64_t bytecode_file_size;
 
-                    BuildParams build_params;
                     // set offset
                     build_params.block_offset = offset;
                     build_params.local_offset = 0;
@@ -1608,8 +1726,7 @@ static int REPL(
 
                             // trigger the GC after popping items from stack,
                             // to clean up any heap variables no longer in use.
-                            main_thread->GetStack().MarkAll();
-                            vm->GetState().GetHeap().Sweep();
+                            vm->GetState().GC();
 
                             // clear vm exception state
                             main_thread->GetExceptionState().Reset();
@@ -1681,6 +1798,23 @@ static int REPL(
     return 0;
 }
 
+/** Parses a number of bytes, optionally followed by K, M or G */
+static size_t ParseByteSize(const char *str)
+{
+    char *end = nullptr;
+    size_t num_bytes = std::strtoull(str, &end, 10);
+
+    // each suffix falls through to the ones below it
+    switch (*end) {
+        case 'G': case 'g': num_bytes *= 1024;
+        case 'M': case 'm': num_bytes *= 1024;
+        case 'K': case 'k': num_bytes *= 1024;
+        default: break;
+    }
+
+    return num_bytes;
+}
+
 void HandleArgs(
     int argc,
     char *argv[],
@@ -1712,6 +1846,42 @@ void HandleArgs(
             native_mode = true;
         }
 
+        // select the interpreter loop, mostly for comparing the two
+        if (CLI::HasOption(argv, argv + argc, "--dispatch-switch")) {
+            vm.SetDispatchMode(vm::DISPATCH_SWITCH);
+        } else if (CLI::HasOption(argv, argv + argc, "--dispatch-threaded")) {
+            vm.SetDispatchMode(vm::DISPATCH_THREADED);
+        }
+
+        if (CLI::HasOption(argv, argv + argc, "--ic-stats")) {
+            print_ic_stats = true;
+        }
+
+        if (CLI::HasOption(argv, argv + argc, "--gc-stats")) {
+            print_gc_stats = true;
+        }
+
+        // garbage collector pacing, see VMState::SetGCGrowth and SetHeapLimit
+        if (const char *growth = CLI::GetOptionValue(argv, argv + argc, "--gc-growth")) {
+            vm.GetState().SetGCGrowth((unsigned)std::strtoul(growth, nullptr, 10));
+        }
+
+        if (const char *limit = CLI::GetOptionValue(argv, argv + argc, "--heap-limit")) {
+            vm.GetState().SetHeapLimit(ParseByteSize(limit));
+        }
+
+        // threads to split full collections across
+        if (const char *workers = CLI::GetOptionValue(argv, argv + argc, "--gc-workers")) {
+            vm.GetState().SetGCWorkers(std::strtoul(workers, nullptr, 10));
+        }
+
+        // collect a step at a time, see VMState::SetIncrementalGC
+        if (const char *budget = CLI::GetOptionValue(argv, argv + argc, "--gc-step")) {
+            vm.GetState().SetIncrementalGC(std::strtoul(budget, nullptr, 10));
+        } else if (CLI::HasOption(argv, argv + argc, "--gc-incremental")) {
+            vm.GetState().SetIncrementalGC(GC_DEFAULT_STEP_BUDGET);
+        }
+
         if (CLI::HasOption(argv, argv + argc, "-d")) {
             // disassembly mode
             mode = DECOMPILE_BYTECODE;
@@ -1819,7 +1989,29 @@ void BuildLibraries(
         }, Events_call_action);
 
     api.Module("time")
-        .Function("now", BuiltinTypes::INT, {}, Time_now);
+        .Function("now", BuiltinTypes::INT, {}, Time_now)
+        .Function("clock", BuiltinTypes::FLOAT, {}, Time_clock);
+
+    api.Module("string_builder")
+        .Function("create", BuiltinTypes::ANY, {}, StringBuilder_create)
+        .Function("append", BuiltinTypes::ANY, {
+            { "builder", BuiltinTypes::ANY },
+            { "args", SymbolType::GenericInstance(
+                BuiltinTypes::VAR_ARGS,
+                GenericInstanceTypeInfo {
+                    {
+                        { "arg", BuiltinTypes::ANY }
+                    }
+                }
+            ) }
+        }, StringBuilder_append)
+        .Function("reserve", BuiltinTypes::ANY, {
+            { "builder", BuiltinTypes::ANY },
+            { "capacity", BuiltinTypes::INT }
+        }, StringBuilder_reserve)
+        .Function("finish", BuiltinTypes::STRING, {
+            { "builder", BuiltinTypes::ANY }
+        }, StringBuilder_finish);
 
     api.Module("runtime")
         .Function("gc", BuiltinTypes::NULL_TYPE, {}, Runtime_gc)
@@ -1848,16 +2040,13 @@ void BuildLibraries(
 
                 // create each version object
                 vm::Value sv_major;
-                sv_major.m_type = vm::Value::ValueType::I32;
-                sv_major.m_value.i32 = Runtime::VERSION_MAJOR;
+                sv_major.SetI32(Runtime::VERSION_MAJOR);
 
                 vm::Value sv_minor;
-                sv_minor.m_type = vm::Value::ValueType::I32;
-                sv_minor.m_value.i32 = Runtime::VERSION_MINOR;
+                sv_minor.SetI32(Runtime::VERSION_MINOR);
 
                 vm::Value sv_patch;
-                sv_patch.m_type = vm::Value::ValueType::I32;
-                sv_patch.m_value.i32 = Runtime::VERSION_PATCH;
+                sv_patch.SetI32(Runtime::VERSION_PATCH);
 
                 // create array
                 vm::Array res(3);
@@ -1869,8 +2058,7 @@ void BuildLibraries(
                 hv->Assign(res);
 
                 // assign the out value to this
-                out->m_type = vm::Value::ValueType::HEAP_POINTER;
-                out->m_value.ptr = hv;
+                out->SetHeapPointer(hv);
             }
         )
         .Variable(
@@ -1885,11 +2073,10 @@ void BuildLibraries(
                 ASSERT(hv != nullptr);
 
                 // create string and set to to hold the name
-                hv->Assign(vm::ImmutableString(Runtime::OS_NAME));
+                hv->Assign(vm::ImmutableString::Intern(Runtime::OS_NAME));
 
                 // assign the out value to this
-                out->m_type = vm::Value::ValueType::HEAP_POINTER;
-                out->m_value.ptr = hv;
+                out->SetHeapPointer(hv);
             }
         );
 
@@ -10,6 +10,7 @@ void AEXGenerator::Visit(BytecodeChunk *chunk)
 {
     BuildParams new_params;
     new_params.block_offset = build_params.block_offset + m_ibs.GetSize();
+    new_params.static_functions = build_params.static_functions;
 
     AEXGenerator chunk_generator(new_params);
     for (auto &buildable : chunk->buildables) {
@@ -78,6 +79,26 @@ void AEXGenerator::Visit(FunctionCall *node)
     m_ibs.Put(node->nargs);
 }
 
+void AEXGenerator::Visit(StaticFunctionMarker *node)
+{
+    (*build_params.static_functions)[node->static_id] =
+        (LabelPosition)(build_params.block_offset + m_ibs.GetSize());
+}
+
+void AEXGenerator::Visit(StaticFunctionCall *node)
+{
+    // the function is always built before any call to it,
+    // so its address is known by now
+    auto it = build_params.static_functions->find(node->static_id);
+    ASSERT_MSG(it != build_params.static_functions->end(), "No function with static ID was found");
+
+    const LabelPosition addr = it->second;
+
+    m_ibs.Put(Instructions::CALL_STATIC);
+    m_ibs.Put((byte*)&addr, sizeof(addr));
+    m_ibs.Put(node->nargs);
+}
+
 void AEXGenerator::Visit(Return *node)
 {
     m_ibs.Put(Instructions::RET);
@@ -245,6 +266,24 @@ void AEXGenerator::Visit(StorageOperation *node)
 
                     break;
                 
+                case Strategies::BY_FRAME_INDEX:
+                    switch (node->operation) {
+                        case Operations::LOAD:
+                            m_ibs.Put(Instructions::LOAD_LOCAL);
+                            m_ibs.Put((byte*)&node->op.a.reg, sizeof(node->op.a.reg));
+                            m_ibs.Put((byte*)&node->op.b.index, sizeof(node->op.b.index));
+
+                            break;
+                        case Operations::STORE:
+                            m_ibs.Put(Instructions::MOV_LOCAL);
+                            m_ibs.Put((byte*)&node->op.b.index, sizeof(node->op.b.index));
+                            m_ibs.Put((byte*)&node->op.a.reg, sizeof(node->op.a.reg));
+
+                            break;
+                    }
+
+                    break;
+
                 case Strategies::BY_HASH:
                     ASSERT_MSG(false, "Not implemented");
 
@@ -256,6 +295,7 @@ void AEXGenerator::Visit(StorageOperation *node)
         case Methods::STATIC:
             switch (node->strategy) {
                 case Strategies::BY_OFFSET:
+                case Strategies::BY_FRAME_INDEX:
                     ASSERT_MSG(false, "Not implemented");
                     
                     break;
@@ -287,6 +327,7 @@ void AEXGenerator::Visit(StorageOperation *node)
         case Methods::ARRAY:
             switch (node->strategy) {
                 case Strategies::BY_OFFSET:
+                case Strategies::BY_FRAME_INDEX:
                     ASSERT_MSG(false, "Not implemented");
                     
                     break;
@@ -322,6 +363,7 @@ void AEXGenerator::Visit(StorageOperation *node)
         case Methods::MEMBER:
             switch (node->strategy) {
                 case Strategies::BY_OFFSET:
+                case Strategies::BY_FRAME_INDEX:
                     ASSERT_MSG(false, "Not implemented");
                     
                     break;